@@ -20,6 +20,26 @@ for i in "${YOLO_SIZES[@]}"; do
     python3 export.py --weights yolov5$i.pt --include onnx
 done
 
+echo " - Convert small models with reduced input size"
+SMALL_SIZES=("n" "s")
+INPUT_SIZES=("320" "416")
+
+for i in "${SMALL_SIZES[@]}"; do
+    for j in "${INPUT_SIZES[@]}"; do
+        python3 export.py --weights yolov5$i.pt --include onnx --imgsz $j
+        mv yolov5$i.onnx yolov5$i-$j.onnx
+    done
+    python3 export.py --weights yolov5$i.pt --include onnx
+done
+
+echo " - Quantize models to INT8"
+pip3 install onnxruntime
+QUANTIZED=("s" "m")
+
+for i in "${QUANTIZED[@]}"; do
+    python3 -c "from onnxruntime.quantization import quantize_dynamic, QuantType; quantize_dynamic('yolov5$i.onnx', 'yolov5$i-int8.onnx', weight_type=QuantType.QUInt8)"
+done
+
 echo " - Copy files to models"
 cp *.onnx ../../models/yolo/.
 
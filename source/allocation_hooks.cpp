@@ -0,0 +1,51 @@
+#include <cstdlib>
+#include <new>
+
+#include "allocation_tracker.cpp"
+
+#pragma once
+
+/**
+ * Replacement of the global operator new that counts the heap allocations of each thread (AllocationTracker::heap()).
+ *
+ * Must be included once per program, in the file that defines main(). Array and nothrow versions of the standard library call these functions.
+ */
+
+void *operator new(std::size_t size) {
+	AllocationTracker::recordHeap(size);
+
+	if (size == 0) {
+		size = 1;
+	}
+
+	void *ptr;
+	while ((ptr = std::malloc(size)) == nullptr) {
+		std::new_handler handler = std::get_new_handler();
+		if (handler == nullptr) {
+			throw std::bad_alloc();
+		}
+		handler();
+	}
+
+	return ptr;
+}
+
+void *operator new[](std::size_t size) {
+	return ::operator new(size);
+}
+
+void operator delete(void *ptr) noexcept {
+	std::free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept {
+	std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept {
+	std::free(ptr);
+}
+
+void operator delete[](void *ptr, std::size_t) noexcept {
+	std::free(ptr);
+}
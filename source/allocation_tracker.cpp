@@ -0,0 +1,131 @@
+#include <fstream>
+#include <cstddef>
+#include <cstdint>
+
+#include <unistd.h>
+
+#include <opencv2/core.hpp>
+
+#pragma once
+
+/**
+ * @brief Number of allocations and bytes allocated.
+ */
+struct AllocationStats {
+	uint64_t count = 0;
+
+	uint64_t bytes = 0;
+
+	AllocationStats &operator+=(const AllocationStats &other) {
+		this->count += other.count;
+		this->bytes += other.bytes;
+		return *this;
+	}
+
+	AllocationStats operator-(const AllocationStats &other) const {
+		AllocationStats difference;
+		difference.count = this->count - other.count;
+		difference.bytes = this->bytes - other.bytes;
+		return difference;
+	}
+};
+
+/**
+ * @brief Counts the allocations made by each thread, heap allocations (operator new) and cv::Mat buffers separately.
+ *
+ * Counters are per thread so a stage can be measured by the difference of thread() before and after it runs, without synchronization. Work done by the OpenCV thread pool is counted in the pool threads, with a single OpenCV thread everything runs in the calling thread.
+ *
+ * Heap allocations are only counted in programs that include allocation_hooks.cpp, cv::Mat buffers once install() is called.
+ */
+class AllocationTracker {
+	public:
+		/**
+		 * @brief Heap allocations of the calling thread.
+		 */
+		static AllocationStats &heap() {
+			static thread_local AllocationStats stats;
+			return stats;
+		}
+
+		/**
+		 * @brief cv::Mat buffers allocated by the calling thread.
+		 */
+		static AllocationStats &mat() {
+			static thread_local AllocationStats stats;
+			return stats;
+		}
+
+		/**
+		 * @brief All the allocations of the calling thread.
+		 */
+		static AllocationStats thread() {
+			AllocationStats stats = heap();
+			stats += mat();
+			return stats;
+		}
+
+		static void recordHeap(size_t size) noexcept {
+			AllocationStats &stats = heap();
+			stats.count++;
+			stats.bytes += size;
+		}
+
+		/**
+		 * @brief Count the cv::Mat buffers allocated from now on, matrices already allocated are not affected.
+		 */
+		static void install();
+
+		/**
+		 * @brief Resident memory of the process (bytes), 0 if unknown.
+		 */
+		static size_t residentMemory() {
+			std::ifstream file("/proc/self/statm");
+			size_t size = 0, resident = 0;
+			if (!(file >> size >> resident)) {
+				return 0;
+			}
+
+			return resident * sysconf(_SC_PAGESIZE);
+		}
+};
+
+/**
+ * @brief Default allocator of cv::Mat that counts the buffers allocated and delegates to the standard allocator.
+ *
+ * Buffers keep the standard allocator as their owner, they are released by it directly.
+ */
+class CountingMatAllocator : public cv::MatAllocator {
+	public:
+		CountingMatAllocator(cv::MatAllocator *parent) {
+			this->parent = parent;
+		}
+
+		cv::UMatData *allocate(int dims, const int *sizes, int type, void *data, size_t *step, cv::AccessFlag flags, cv::UMatUsageFlags usage) const override {
+			cv::UMatData *u = this->parent->allocate(dims, sizes, type, data, step, flags, usage);
+
+			// Matrices wrapping user data do not allocate
+			if (u != nullptr && data == nullptr) {
+				AllocationStats &stats = AllocationTracker::mat();
+				stats.count++;
+				stats.bytes += u->size;
+			}
+
+			return u;
+		}
+
+		bool allocate(cv::UMatData *data, cv::AccessFlag flags, cv::UMatUsageFlags usage) const override {
+			return this->parent->allocate(data, flags, usage);
+		}
+
+		void deallocate(cv::UMatData *data) const override {
+			this->parent->deallocate(data);
+		}
+
+	private:
+		cv::MatAllocator *parent;
+};
+
+inline void AllocationTracker::install() {
+	static CountingMatAllocator allocator(cv::Mat::getStdAllocator());
+	cv::Mat::setDefaultAllocator(&allocator);
+}
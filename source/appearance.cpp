@@ -0,0 +1,221 @@
+#include <vector>
+#include <functional>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "street_object.cpp"
+
+#pragma once
+
+/**
+ * @brief Cheap appearance signature of an object, a normalized hue/saturation histogram of its box.
+ *
+ * The box is reduced to a small patch before the histogram is computed, so the cost does not depend on the size of the object. The patch buffers are reused between calls.
+ */
+class AppearanceSignature {
+	public:
+		/**
+		 * @brief Size of the patch the box is reduced to.
+		 */
+		static const int patch_size = 16;
+
+		static const int hue_bins = 8;
+
+		static const int saturation_bins = 4;
+
+		/**
+		 * @brief Compute the signature of a box of the frame.
+		 *
+		 * @param frame Frame (BGR).
+		 * @param box Box of the object, clipped to the frame.
+		 * @param signature Histogram (empty if the box is outside of the frame), reuses the buffer of the signature.
+		 */
+		void compute(const cv::Mat &frame, cv::Rect box, cv::Mat &signature) {
+			box &= cv::Rect(0, 0, frame.cols, frame.rows);
+			if (box.width < 2 || box.height < 2) {
+				signature.release();
+				return;
+			}
+
+			// Area interpolation averages all the pixels of the box, linear would sample a few pixels of large boxes
+			cv::resize(frame(box), this->patch, cv::Size(patch_size, patch_size), 0, 0, cv::INTER_AREA);
+			cv::cvtColor(this->patch, this->hsv, cv::COLOR_BGR2HSV);
+
+			signature.create(hue_bins, saturation_bins, CV_32FC1);
+			signature.setTo(0);
+
+			// Each pixel adds the same weight, the histogram sums 1
+			float weight = 1.0 / (patch_size * patch_size);
+			for (int y = 0; y < patch_size; y++) {
+				const cv::Vec3b *row = this->hsv.ptr<cv::Vec3b>(y);
+				for (int x = 0; x < patch_size; x++) {
+					signature.at<float>(row[x][0] * hue_bins / 180, row[x][1] * saturation_bins / 256) += weight;
+				}
+			}
+		}
+
+		/**
+		 * @brief Blend a new observation into the signature of a track.
+		 *
+		 * @param signature Signature of the track, replaced when empty.
+		 * @param observation Signature computed in the current frame.
+		 * @param weight Weight of the new observation.
+		 */
+		static void update(cv::Mat &signature, const cv::Mat &observation, double weight = 0.3) {
+			if (observation.empty()) {
+				return;
+			}
+
+			if (signature.empty()) {
+				observation.copyTo(signature);
+				return;
+			}
+
+			cv::addWeighted(signature, 1.0 - weight, observation, weight, 0.0, signature);
+		}
+
+		/**
+		 * @brief Distance between two signatures, from 0 (same colors) to 1 (no overlap).
+		 */
+		static double distance(const cv::Mat &a, const cv::Mat &b) {
+			if (a.empty() || b.empty()) {
+				return 1.0;
+			}
+
+			return cv::compareHist(a, b, cv::HISTCMP_BHATTACHARYYA);
+		}
+
+	private:
+		cv::Mat patch;
+
+		cv::Mat hsv;
+};
+
+/**
+ * @brief Tracks removed recently (e.g. occluded by a larger vehicle), kept for a short time so that they can be re-linked when the object reappears.
+ *
+ * A lost track matches a new object when the object is near the position predicted from the last direction of the track and their appearance signatures are similar. Re-linked tracks keep their identifier, category and trajectory.
+ */
+class LostTrackCache {
+	public:
+		/**
+		 * @brief Track waiting to be re-linked.
+		 */
+		struct Entry {
+			StreetObject object;
+
+			/**
+			 * @brief Frame when the track was lost.
+			 */
+			int lost_frame;
+
+			/**
+			 * @brief Displacement per frame when the track was lost.
+			 */
+			cv::Point2f velocity;
+		};
+
+		/**
+		 * @brief Tracks waiting to be re-linked, oldest first.
+		 */
+		std::vector<Entry> entries;
+
+		/**
+		 * @brief Number of frames a lost track is kept, 0 disables the cache.
+		 */
+		int max_frames = 60;
+
+		/**
+		 * @brief Maximum number of lost tracks kept, the oldest track is finished first.
+		 */
+		size_t capacity = 64;
+
+		/**
+		 * @brief Maximum distance (pixels) between the predicted position and the new object, grows with the time lost.
+		 */
+		float radius = 40.0;
+
+		/**
+		 * @brief Maximum appearance distance to re-link a track.
+		 */
+		double max_distance = 0.35;
+
+		/**
+		 * @brief Keep a track that was removed.
+		 *
+		 * @param object Track removed.
+		 * @param frame Frame when the track was lost.
+		 * @param finish Function called for the tracks that no longer fit in the cache.
+		 */
+		void add(StreetObject &object, int frame, std::function<void(StreetObject &)> finish) {
+			// Velocity from the direction vector (covers 4 frame steps)
+			cv::Point direction = object.direction();
+			this->entries.push_back({object, frame, cv::Point2f(direction.x / 4.0, direction.y / 4.0)});
+
+			while (this->entries.size() > this->capacity) {
+				finish(this->entries.front().object);
+				this->entries.erase(this->entries.begin());
+			}
+		}
+
+		/**
+		 * @brief Find the lost track that best matches a new object.
+		 *
+		 * @param position Position of the new object.
+		 * @param signature Appearance signature of the new object.
+		 * @param frame Current frame.
+		 * @return Index of the entry, -1 if no track matches.
+		 */
+		int find(cv::Point position, const cv::Mat &signature, int frame) {
+			int best = -1;
+			double best_score = 0.0;
+
+			for (size_t i = 0; i < this->entries.size(); i++) {
+				Entry &entry = this->entries[i];
+
+				// Objects keep moving while hidden
+				int elapsed = frame - entry.object.frame;
+				cv::Point last = entry.object.position();
+				cv::Point2f predicted(last.x + entry.velocity.x * elapsed, last.y + entry.velocity.y * elapsed);
+
+				float gap = ::size(cv::Point(position.x - predicted.x, position.y - predicted.y));
+				float limit = this->radius + 0.5 * ::size(cv::Point(entry.velocity.x * elapsed, entry.velocity.y * elapsed));
+				if (gap > limit) {
+					continue;
+				}
+
+				double distance = AppearanceSignature::distance(entry.object.appearance, signature);
+				if (distance > this->max_distance) {
+					continue;
+				}
+
+				// Appearance and position combined, both normalized to their limits
+				double score = distance / this->max_distance + gap / limit;
+				if (best < 0 || score < best_score) {
+					best = i;
+					best_score = score;
+				}
+			}
+
+			return best;
+		}
+
+		/**
+		 * @brief Finish the tracks lost for longer than max_frames.
+		 *
+		 * @param frame Current frame.
+		 * @param finish Function called for each track finished.
+		 */
+		void expire(int frame, std::function<void(StreetObject &)> finish) {
+			for (auto entry = this->entries.begin(); entry != this->entries.end();) {
+				if (frame - entry->lost_frame > this->max_frames) {
+					finish(entry->object);
+					entry = this->entries.erase(entry);
+					continue;
+				}
+
+				entry++;
+			}
+		}
+};
@@ -1,10 +1,16 @@
 #include <iostream>
+#include <fstream>
 #include <sstream>
+#include <cstdio>
 #include <math.h>
 
 #include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/imgcodecs.hpp>
 #include <opencv2/features2d.hpp>
 
+#include "roi_mask.cpp"
+
 #pragma once
 
 class BackgroundSubtractor {
@@ -35,6 +41,31 @@ class BackgroundSubtractor {
 		 */
 		cv::Mat element = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(3, 3), cv::Point(1, 1));
 
+		/**
+		 * @brief Region of interest of the camera, optional. Only the bounds of the region are modelled and the mask is cleared outside of it.
+		 */
+		const RoiMask *roi = nullptr;
+
+		/**
+		 * @brief Result of background subtraction inside the bounds of the region of interest.
+		 */
+		cv::Mat region_mask;
+
+		/**
+		 * @brief Scale of the background image stored in checkpoints.
+		 */
+		double checkpoint_scale = 0.5;
+
+		/**
+		 * @brief Number of times the restored background is fed to the model, fills the samples of the model with the background.
+		 */
+		int warm_frames = 10;
+
+		/**
+		 * @brief Maximum fraction of pixels of the first frame that can differ from a checkpoint for it to be used (camera moved, day/night change).
+		 */
+		double max_checkpoint_change = 0.25;
+
 		/**
 		 * @brief Compare two images by getting the L2 error (square-root of sum of squared error).
 		 * 
@@ -69,13 +100,31 @@ class BackgroundSubtractor {
 				// TODO <ADD CODE HERE>
 			}
 
-			// Update the background model
-			subtractor->apply(*frame, mask);
+			if (this->roi != nullptr && this->roi->bounds.area() > 0) {
+				// Update the background model only inside the bounds of the region of interest
+				if (mask.size() != frame->size()) {
+					mask = cv::Mat::zeros(frame->size(), CV_8UC1);
+				}
+
+				cv::Mat region = mask(this->roi->bounds);
+				subtractor->apply(this->roi->crop(*frame), region_mask);
+				region_mask.copyTo(region);
+
+				if (close_operation) {
+					cv::erode(region, region, element);
+					cv::dilate(region, region, element);
+				}
 
-			// Close operation
-			if (close_operation) {
-				cv::erode(mask, mask, element);
-				cv::dilate(mask, mask, element);
+				this->roi->apply(mask);
+			} else {
+				// Update the background model
+				subtractor->apply(*frame, mask);
+
+				// Close operation
+				if (close_operation) {
+					cv::erode(mask, mask, element);
+					cv::dilate(mask, mask, element);
+				}
 			}
 
 			// Show the current frame and the fg masks
@@ -86,10 +135,165 @@ class BackgroundSubtractor {
 			return mask;
 		}
 
+		/**
+		 * @brief Write the current background image of the model into a checkpoint (PNG), downsampled by checkpoint_scale.
+		 * 
+		 * The file is replaced atomically, a crash while writing keeps the previous checkpoint.
+		 * 
+		 * @param fname Path of the checkpoint.
+		 * @return True if the checkpoint was written.
+		 */
+		bool save(std::string fname) {
+			cv::Mat background;
+			this->subtractor->getBackgroundImage(background);
+			if (background.empty()) {
+				return false;
+			}
+
+			cv::Mat small;
+			if (this->checkpoint_scale > 0.0 && this->checkpoint_scale < 1.0) {
+				cv::resize(background, small, cv::Size(), this->checkpoint_scale, this->checkpoint_scale, cv::INTER_AREA);
+			} else {
+				small = background;
+			}
+
+			std::vector<uchar> encoded;
+			std::vector<int> params = {cv::IMWRITE_PNG_COMPRESSION, 1};
+			if (!cv::imencode(".png", small, encoded, params)) {
+				return false;
+			}
+
+			std::string temporary = fname + ".tmp";
+			std::ofstream file(temporary, std::ios::binary);
+			file.write((const char *)encoded.data(), encoded.size());
+			file.close();
+
+			if (!file || std::rename(temporary.c_str(), fname.c_str()) != 0) {
+				std::cout << "Error writing background checkpoint " << fname << std::endl;
+				std::remove(temporary.c_str());
+				return false;
+			}
+
+			return true;
+		}
+
+		/**
+		 * @brief Load a checkpoint, it is used by restore() with the first frame.
+		 * 
+		 * @param fname Path of the checkpoint.
+		 * @return True if the checkpoint exists.
+		 */
+		bool load(std::string fname) {
+			this->checkpoint = cv::imread(fname, cv::IMREAD_COLOR);
+			return !this->checkpoint.empty();
+		}
+
+		/**
+		 * @brief Check if a checkpoint is loaded and was not used yet.
+		 */
+		bool hasCheckpoint() {
+			return !this->checkpoint.empty();
+		}
+
+		/**
+		 * @brief Initialize the model with the loaded checkpoint if it matches the frame, the checkpoint is discarded after the check.
+		 * 
+		 * @param frame First frame of the camera.
+		 * @return True if the model was initialized from the checkpoint.
+		 */
+		bool restore(cv::Mat *frame) {
+			if (this->checkpoint.empty()) {
+				return false;
+			}
+
+			cv::Mat region = this->roi != nullptr && this->roi->bounds.area() > 0 ? this->roi->crop(*frame) : *frame;
+
+			cv::Mat checkpoint = this->checkpoint;
+			this->checkpoint.release();
+
+			// Checkpoint of a different region (or camera resolution)
+			double aspect = (double)checkpoint.cols / checkpoint.rows;
+			double region_aspect = (double)region.cols / region.rows;
+			if (std::abs(aspect - region_aspect) > 0.01 * region_aspect) {
+				std::cout << "Background checkpoint does not match the frame size" << std::endl;
+				return false;
+			}
+
+			cv::Mat background;
+			cv::resize(checkpoint, background, region.size(), 0, 0, cv::INTER_LINEAR);
+
+			// Compare at low resolution, objects in the frame change a small part of the image
+			cv::Mat a, b, difference;
+			cv::resize(background, a, cv::Size(160, 160 * region.rows / region.cols), 0, 0, cv::INTER_AREA);
+			cv::resize(region, b, a.size(), 0, 0, cv::INTER_AREA);
+			cv::cvtColor(a, a, cv::COLOR_BGR2GRAY);
+			cv::cvtColor(b, b, cv::COLOR_BGR2GRAY);
+			cv::absdiff(a, b, difference);
+
+			double changed = (double)cv::countNonZero(difference > 40) / difference.total();
+			if (changed > this->max_checkpoint_change) {
+				std::cout << "Background checkpoint rejected, " << std::round(changed * 100) << "% of the scene changed" << std::endl;
+				return false;
+			}
+
+			cv::Mat discard;
+			for (int i = 0; i < this->warm_frames; i++) {
+				this->subtractor->apply(background, discard, 1.0);
+			}
+
+			return true;
+		}
+
 		/**
 		 * @brief Segment blobs from binary image. Useful to segment moving objects in an image after background subtraction has been performed.
+		 * 
+		 * @return Blobs found, valid until the next call.
+		 */
+		const std::vector<cv::KeyPoint> &segmentBlobs(cv::Mat *frame, cv::Mat *mask)
+		{
+			// Detect blobs, only inside the bounds of the region of interest
+			if (this->roi != nullptr && this->roi->bounds.area() > 0) {
+				this->blob_detector->detect(this->roi->crop(*mask), this->keypoints);
+
+				cv::Point offset = this->roi->offset();
+				for (cv::KeyPoint &keypoint : this->keypoints) {
+					keypoint.pt.x += offset.x;
+					keypoint.pt.y += offset.y;
+				}
+			} else {
+				this->blob_detector->detect(*mask, this->keypoints);
+			}
+
+			if (debug) {
+				// DrawMatchesFlags::DRAW_RICH_KEYPOINTS flag ensures the size of the circle corresponds to the size of blob
+				cv::Mat img;
+				cv::drawKeypoints(*frame, this->keypoints, img, cv::Scalar(0, 0, 255), cv::DrawMatchesFlags::DRAW_RICH_KEYPOINTS);
+				cv::imshow("Blob", img);
+			}
+
+			return this->keypoints;
+		}
+
+	private:
+		/**
+		 * @brief Background loaded from a checkpoint, waiting for the first frame.
+		 */
+		cv::Mat checkpoint;
+
+		/**
+		 * @brief Blob detector used by segmentBlobs(), created once and reused for every frame.
+		 */
+		cv::Ptr<cv::SimpleBlobDetector> blob_detector = createBlobDetector();
+
+		/**
+		 * @brief Blobs of the last frame, the buffer is reused between frames.
 		 */
-		std::vector<cv::KeyPoint> segmentBlobs(cv::Mat *frame, cv::Mat *mask)
+		std::vector<cv::KeyPoint> keypoints;
+
+		/**
+		 * @brief Create the blob detector for the binary mask of moving objects.
+		 */
+		static cv::Ptr<cv::SimpleBlobDetector> createBlobDetector()
 		{
 			// Setup SimpleBlobDetector parameters.
 			cv::SimpleBlobDetector::Params params;
@@ -110,21 +314,6 @@ class BackgroundSubtractor {
 			params.maxInertiaRatio = 0.2;
 			params.filterByColor = false;
 
-			// Set up the detector with default parameters.
-			cv::Ptr<cv::SimpleBlobDetector> detector = cv::SimpleBlobDetector::create(params);
-
-			// Detect blobs.
-			std::vector<cv::KeyPoint> keypoints;
-			detector->detect(*mask, keypoints);
-
-			if (debug) {
-				// DrawMatchesFlags::DRAW_RICH_KEYPOINTS flag ensures the size of the circle corresponds to the size of blob
-				cv::Mat img;
-				cv::drawKeypoints(*frame, keypoints, img, cv::Scalar(0, 0, 255), cv::DrawMatchesFlags::DRAW_RICH_KEYPOINTS);
-				cv::imshow("Blob", img);
-			}
-
-			return keypoints;
+			return cv::SimpleBlobDetector::create(params);
 		}
-
 };
\ No newline at end of file
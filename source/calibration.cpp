@@ -0,0 +1,107 @@
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+#include <opencv2/calib3d.hpp>
+
+#pragma once
+
+/**
+ * @brief Maps image coordinates of a camera to metric coordinates on the road plane using a homography.
+ */
+class Calibration {
+	public:
+		/**
+		 * @brief Homography (3x3, double) from image pixels to road meters, empty if the camera is not calibrated.
+		 */
+		cv::Mat homography;
+
+		/**
+		 * @brief Load the calibration from a YAML/XML file (cv::FileStorage).
+		 *
+		 * The file contains either the "homography" matrix or at least four point correspondences as flat coordinate lists, "image_points" (pixels) and "road_points" (meters).
+		 *
+		 * @param fname Path of the calibration file.
+		 * @return True if the calibration was loaded.
+		 */
+		bool load(std::string fname) {
+			cv::FileStorage fs(fname, cv::FileStorage::READ);
+			if (!fs.isOpened()) {
+				std::cout << "Error opening calibration " << fname << std::endl;
+				return false;
+			}
+
+			if (!fs["homography"].empty()) {
+				cv::Mat homography;
+				fs["homography"] >> homography;
+				homography.convertTo(this->homography, CV_64F);
+			} else {
+				std::vector<float> image, road;
+				fs["image_points"] >> image;
+				fs["road_points"] >> road;
+
+				if (!this->fit(toPoints(image), toPoints(road))) {
+					return false;
+				}
+			}
+
+			if (this->homography.rows != 3 || this->homography.cols != 3) {
+				std::cout << "Calibration homography must be 3x3" << std::endl;
+				this->homography = cv::Mat();
+				return false;
+			}
+
+			return true;
+		}
+
+		/**
+		 * @brief Compute the homography from point correspondences.
+		 *
+		 * @param image Points in the image (pixels).
+		 * @param road Same points on the road plane (meters).
+		 * @return True if the homography was computed.
+		 */
+		bool fit(const std::vector<cv::Point2f> &image, const std::vector<cv::Point2f> &road) {
+			if (image.size() < 4 || image.size() != road.size()) {
+				std::cout << "Calibration needs at least 4 image and road points" << std::endl;
+				return false;
+			}
+
+			this->homography = cv::findHomography(image, road);
+
+			return !this->homography.empty();
+		}
+
+		/**
+		 * @brief Check if the camera is calibrated.
+		 */
+		bool empty() const {
+			return this->homography.empty();
+		}
+
+		/**
+		 * @brief Project image points to the road plane, all points are transformed in a single call.
+		 *
+		 * @param image Points in the image (pixels).
+		 * @param road Points on the road (meters).
+		 */
+		void project(const std::vector<cv::Point2f> &image, std::vector<cv::Point2f> &road) const {
+			if (image.empty()) {
+				road.clear();
+				return;
+			}
+
+			cv::perspectiveTransform(image, road, this->homography);
+		}
+
+	private:
+		static std::vector<cv::Point2f> toPoints(const std::vector<float> &coords) {
+			std::vector<cv::Point2f> points;
+			for (size_t i = 0; i + 1 < coords.size(); i += 2) {
+				points.push_back(cv::Point2f(coords[i], coords[i + 1]));
+			}
+
+			return points;
+		}
+};
@@ -0,0 +1,374 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdint>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/videoio.hpp>
+
+#pragma once
+
+/**
+ * @brief Records short clips around speeding events.
+ *
+ * Frames are downscaled and JPEG encoded into a ring buffer bounded in time and memory. When an event is triggered a clip from a few seconds before to a few seconds after the event is written asynchronously.
+ */
+class EventRecorder {
+	public:
+		/**
+		 * @brief Speed above which a track triggers an event (kph).
+		 */
+		float speed_threshold = 60.0;
+
+		/**
+		 * @brief Time recorded before the event (ms).
+		 */
+		int64_t pre_event = 3000;
+
+		/**
+		 * @brief Time recorded after the event (ms).
+		 */
+		int64_t post_event = 3000;
+
+		/**
+		 * @brief Maximum memory used by the encoded frames in the ring buffer (bytes).
+		 */
+		size_t max_bytes = 32 * 1024 * 1024;
+
+		/**
+		 * @brief Frame rate stored in the ring buffer, frames pushed faster are skipped.
+		 */
+		double fps = 10.0;
+
+		/**
+		 * @brief Scale of the stored frames relative to the frames pushed.
+		 */
+		double scale = 0.5;
+
+		/**
+		 * @brief Quality of the JPEG encoding (0 to 100).
+		 */
+		int jpeg_quality = 75;
+
+		/**
+		 * @brief Maximum number of frames waiting to be encoded, frames are dropped when the queue is full.
+		 */
+		size_t capacity = 4;
+
+		/**
+		 * @brief Number of clips written.
+		 */
+		std::atomic<uint64_t> clips{0};
+
+		/**
+		 * @brief Number of frames dropped before being encoded.
+		 */
+		std::atomic<uint64_t> dropped{0};
+
+		/**
+		 * @brief Create a recorder.
+		 *
+		 * @param directory Directory where clips are written.
+		 */
+		EventRecorder(std::string directory) {
+			this->directory = directory;
+			this->encoder = std::thread(&EventRecorder::encode, this);
+			this->writer = std::thread(&EventRecorder::write, this);
+		}
+
+		~EventRecorder() {
+			this->close();
+		}
+
+		/**
+		 * @brief Submit a frame to the ring buffer, encoding happens in a separate thread.
+		 *
+		 * The frame data is shared with the recorder and must not be modified after being pushed.
+		 *
+		 * @param frame Frame processed.
+		 * @param timestamp Timestamp of the frame (ms).
+		 */
+		void push(const cv::Mat &frame, int64_t timestamp) {
+			if (this->last_timestamp != INT64_MIN && timestamp - this->last_timestamp < 1000.0 / this->fps) {
+				return;
+			}
+
+			std::unique_lock<std::mutex> lock(this->mutex);
+
+			if (this->incoming.size() >= this->capacity) {
+				this->dropped++;
+				return;
+			}
+
+			this->last_timestamp = timestamp;
+			this->incoming.push_back(std::make_pair(timestamp, frame));
+			this->condition.notify_one();
+		}
+
+		/**
+		 * @brief Check the speed of a track and trigger an event the first time it is above the threshold.
+		 *
+		 * @param id Identifier of the track.
+		 * @param speed Speed of the track (kph).
+		 * @param timestamp Timestamp of the frame (ms).
+		 */
+		void check(int id, float speed, int64_t timestamp) {
+			if (speed < this->speed_threshold) {
+				return;
+			}
+
+			std::unique_lock<std::mutex> lock(this->mutex);
+
+			// Forget old triggers to keep the map bounded
+			for (auto it = this->triggered.begin(); it != this->triggered.end();) {
+				if (timestamp - it->second > 60000) {
+					it = this->triggered.erase(it);
+				} else {
+					it++;
+				}
+			}
+
+			if (this->triggered.count(id) > 0) {
+				return;
+			}
+
+			this->triggered[id] = timestamp;
+
+			Event event;
+			event.id = id;
+			event.timestamp = timestamp;
+			event.speed = speed;
+			this->events.push_back(event);
+		}
+
+		/**
+		 * @brief Write the pending clips and stop the recorder threads.
+		 */
+		void close() {
+			{
+				std::unique_lock<std::mutex> lock(this->mutex);
+				if (this->stop) {
+					return;
+				}
+				this->stop = true;
+			}
+
+			this->condition.notify_all();
+
+			if (this->encoder.joinable()) {
+				this->encoder.join();
+			}
+			if (this->writer.joinable()) {
+				this->writer.join();
+			}
+		}
+
+	private:
+		/**
+		 * @brief Event waiting for its post-event frames.
+		 */
+		struct Event {
+			int id;
+			int64_t timestamp;
+			float speed;
+		};
+
+		/**
+		 * @brief Encoded frame in the ring buffer, shared with the clips being written.
+		 */
+		struct EncodedFrame {
+			int64_t timestamp;
+			std::shared_ptr<const std::vector<uchar>> data;
+		};
+
+		/**
+		 * @brief Clip waiting to be written.
+		 */
+		struct Clip {
+			Event event;
+			std::vector<EncodedFrame> frames;
+		};
+
+		std::string directory;
+
+		int64_t last_timestamp = INT64_MIN;
+
+		std::thread encoder;
+
+		std::thread writer;
+
+		std::mutex mutex;
+
+		std::condition_variable condition;
+
+		std::condition_variable clip_condition;
+
+		/**
+		 * @brief Frames waiting to be encoded.
+		 */
+		std::deque<std::pair<int64_t, cv::Mat>> incoming;
+
+		/**
+		 * @brief Ring buffer of encoded frames, only accessed by the encoder thread.
+		 */
+		std::deque<EncodedFrame> ring;
+
+		size_t ring_bytes = 0;
+
+		/**
+		 * @brief Events waiting for the post-event frames.
+		 */
+		std::vector<Event> events;
+
+		/**
+		 * @brief Clips waiting to be written.
+		 */
+		std::deque<Clip> pending_clips;
+
+		/**
+		 * @brief Time of the trigger of each track, each track triggers only once.
+		 */
+		std::map<int, int64_t> triggered;
+
+		bool stop = false;
+
+		/**
+		 * @brief Encoder thread finished, no more clips will be queued.
+		 */
+		bool encoded = false;
+
+		/**
+		 * @brief Encoder thread, encodes frames into the ring buffer and creates clips of the events that are complete.
+		 */
+		void encode() {
+			cv::Mat small;
+			std::vector<int> params = {cv::IMWRITE_JPEG_QUALITY, this->jpeg_quality};
+
+			while (true) {
+				std::pair<int64_t, cv::Mat> item;
+				{
+					std::unique_lock<std::mutex> lock(this->mutex);
+					this->condition.wait(lock, [this] {
+						return this->stop || !this->incoming.empty();
+					});
+
+					if (this->incoming.empty()) {
+						break;
+					}
+
+					item = this->incoming.front();
+					this->incoming.pop_front();
+				}
+
+				cv::resize(item.second, small, cv::Size(), this->scale, this->scale, cv::INTER_AREA);
+				item.second.release();
+
+				std::shared_ptr<std::vector<uchar>> data = std::make_shared<std::vector<uchar>>();
+				cv::imencode(".jpg", small, *data, params);
+
+				EncodedFrame encoded;
+				encoded.timestamp = item.first;
+				encoded.data = data;
+				this->ring.push_back(encoded);
+				this->ring_bytes += data->size();
+
+				// Evict frames outside of the window or above the memory limit
+				int64_t window = this->pre_event + this->post_event;
+				while (!this->ring.empty() && (this->ring_bytes > this->max_bytes || this->ring.front().timestamp < item.first - window)) {
+					this->ring_bytes -= this->ring.front().data->size();
+					this->ring.pop_front();
+				}
+
+				this->collect(item.first);
+			}
+
+			// Events that did not complete are written with the frames available
+			this->collect(INT64_MAX);
+
+			std::unique_lock<std::mutex> lock(this->mutex);
+			this->encoded = true;
+			this->clip_condition.notify_one();
+		}
+
+		/**
+		 * @brief Create clips for the events whose post-event window has passed.
+		 *
+		 * @param timestamp Timestamp of the newest frame.
+		 */
+		void collect(int64_t timestamp) {
+			std::unique_lock<std::mutex> lock(this->mutex);
+
+			for (auto it = this->events.begin(); it != this->events.end();) {
+				if (timestamp < it->timestamp + this->post_event) {
+					it++;
+					continue;
+				}
+
+				Clip clip;
+				clip.event = *it;
+				for (const EncodedFrame &frame : this->ring) {
+					if (frame.timestamp >= it->timestamp - this->pre_event && frame.timestamp <= it->timestamp + this->post_event) {
+						clip.frames.push_back(frame);
+					}
+				}
+
+				if (!clip.frames.empty()) {
+					this->pending_clips.push_back(std::move(clip));
+					this->clip_condition.notify_one();
+				}
+
+				it = this->events.erase(it);
+			}
+		}
+
+		/**
+		 * @brief Writer thread, decodes the frames of each clip and writes them into a video file.
+		 */
+		void write() {
+			while (true) {
+				Clip clip;
+				{
+					std::unique_lock<std::mutex> lock(this->mutex);
+					this->clip_condition.wait(lock, [this] {
+						return this->encoded || !this->pending_clips.empty();
+					});
+
+					if (this->pending_clips.empty()) {
+						break;
+					}
+
+					clip = std::move(this->pending_clips.front());
+					this->pending_clips.pop_front();
+				}
+
+				std::string fname = this->directory + "/event_" + std::to_string(clip.event.timestamp) + "_" + std::to_string(clip.event.id) + "_" + std::to_string((int)clip.event.speed) + "kph.avi";
+
+				cv::VideoWriter video;
+				for (const EncodedFrame &frame : clip.frames) {
+					cv::Mat image = cv::imdecode(*frame.data, cv::IMREAD_COLOR);
+
+					if (!video.isOpened()) {
+						video.open(fname, cv::VideoWriter::fourcc('M', 'J', 'P', 'G'), this->fps, image.size());
+						if (!video.isOpened()) {
+							std::cout << "Error opening event clip " << fname << std::endl;
+							break;
+						}
+					}
+
+					video.write(image);
+				}
+
+				video.release();
+				this->clips++;
+			}
+		}
+};
@@ -15,16 +15,18 @@ class Features {
 		 */
 		bool debug = true;
 
+		/**
+		 * @brief SURF detector, created once and reused for every frame.
+		 */
+		cv::Ptr<cv::xfeatures2d::SURF> detector = cv::xfeatures2d::SURF::create(400);
+
         /**
 		 * @brief Calculate and display SURF features for the entire image.
 		 * 
 		 * @param frame Frame to extract features for.
 		 */
 		std::vector<cv::KeyPoint> surf(cv::Mat *frame) {
-            int minHessian = 400;
-
 			// Detect the keypoints using SURF Detector
-			cv::Ptr<cv::xfeatures2d::SURF> detector = cv::xfeatures2d::SURF::create(minHessian);
 			std::vector<cv::KeyPoint> keypoints;
 			detector->detect(*frame, keypoints);
             
@@ -0,0 +1,201 @@
+#include <iostream>
+#include <string>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include <opencv2/core.hpp>
+#include <opencv2/videoio.hpp>
+
+#pragma once
+
+/**
+ * @brief Frame captured from a live source alongside with the time when it was captured.
+ */
+struct TimedFrame {
+	cv::Mat frame;
+
+	/**
+	 * @brief Capture time in milliseconds since epoch.
+	 */
+	int64_t timestamp;
+};
+
+/**
+ * @brief Grabs frames from a live source (camera, stream) in a dedicated thread.
+ *
+ * Only the newest frames are kept, older frames are dropped when processing is slower than the camera. This prevents driver buffers from queuing up and the tracker from running behind real time.
+ */
+class FrameGrabber {
+	public:
+		/**
+		 * @brief Maximum number of frames waiting to be processed, 1 keeps only the latest frame.
+		 */
+		size_t capacity = 1;
+
+		/**
+		 * @brief Number of frames captured from the source.
+		 */
+		std::atomic<uint64_t> captured{0};
+
+		/**
+		 * @brief Number of frames dropped because processing did not keep up.
+		 */
+		std::atomic<uint64_t> dropped{0};
+
+		FrameGrabber() {}
+
+		~FrameGrabber() {
+			this->stop();
+		}
+
+		/**
+		 * @brief Open a camera device.
+		 *
+		 * @param device Index of the camera.
+		 */
+		bool open(int device) {
+			this->cap.open(device);
+			return this->configure();
+		}
+
+		/**
+		 * @brief Open a stream (e.g. RTSP url).
+		 *
+		 * @param url Address of the stream.
+		 */
+		bool open(std::string url) {
+			this->cap.open(url);
+			return this->configure();
+		}
+
+		/**
+		 * @brief Start the grabber thread.
+		 */
+		void start() {
+			if (this->running) {
+				return;
+			}
+
+			this->running = true;
+			this->finished = false;
+			this->worker = std::thread(&FrameGrabber::run, this);
+		}
+
+		/**
+		 * @brief Stop the grabber thread and release the source.
+		 */
+		void stop() {
+			this->running = false;
+			this->condition.notify_all();
+
+			if (this->worker.joinable()) {
+				this->worker.join();
+			}
+
+			this->cap.release();
+		}
+
+		/**
+		 * @brief Get the oldest frame waiting to be processed (newest frame if capacity is 1), blocks until a frame is available.
+		 *
+		 * @param frame Frame captured.
+		 * @return False if the source has ended and there are no frames left.
+		 */
+		bool read(TimedFrame &frame) {
+			std::unique_lock<std::mutex> lock(this->mutex);
+
+			this->condition.wait(lock, [this] {
+				return !this->frames.empty() || this->finished || !this->running;
+			});
+
+			if (this->frames.empty()) {
+				return false;
+			}
+
+			frame = this->frames.front();
+			this->frames.pop_front();
+
+			return true;
+		}
+
+		/**
+		 * @brief Number of frames waiting to be processed.
+		 */
+		size_t backlog() {
+			std::unique_lock<std::mutex> lock(this->mutex);
+			return this->frames.size();
+		}
+
+	private:
+		cv::VideoCapture cap;
+
+		std::thread worker;
+
+		std::mutex mutex;
+
+		std::condition_variable condition;
+
+		/**
+		 * @brief Frames waiting to be processed.
+		 */
+		std::deque<TimedFrame> frames;
+
+		std::atomic<bool> running{false};
+
+		bool finished = false;
+
+		/**
+		 * @brief Check that the source was opened and reduce the buffering in the capture backend.
+		 */
+		bool configure() {
+			if (!this->cap.isOpened()) {
+				std::cout << "Error opening video stream or file" << std::endl;
+				return false;
+			}
+
+			// Not supported by all backends, the grabber thread keeps the buffers empty anyway
+			this->cap.set(cv::CAP_PROP_BUFFERSIZE, 1);
+
+			return true;
+		}
+
+		/**
+		 * @brief Grabber thread, captures frames as fast as the source produces them.
+		 */
+		void run() {
+			while (this->running) {
+				// Timestamp is taken when the frame is grabbed, decoding happens after
+				if (!this->cap.grab()) {
+					break;
+				}
+
+				int64_t timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+				TimedFrame captured;
+				captured.timestamp = timestamp;
+				if (!this->cap.retrieve(captured.frame) || captured.frame.empty()) {
+					break;
+				}
+
+				this->captured++;
+
+				std::unique_lock<std::mutex> lock(this->mutex);
+				while (this->frames.size() >= this->capacity) {
+					this->frames.pop_front();
+					this->dropped++;
+				}
+
+				this->frames.push_back(captured);
+				this->condition.notify_one();
+			}
+
+			std::unique_lock<std::mutex> lock(this->mutex);
+			this->finished = true;
+			this->condition.notify_all();
+		}
+};
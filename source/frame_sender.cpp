@@ -0,0 +1,214 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <cstring>
+
+#include <unistd.h>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/videoio.hpp>
+
+#include "ingest_protocol.cpp"
+
+/**
+ * @brief Milliseconds since epoch.
+ */
+int64_t now() {
+	return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief Read the reply of the oldest frame sent and print its track updates.
+ *
+ * @return False if the connection was closed.
+ */
+bool receiveUpdates(int fd, bool quiet) {
+	IngestHeader header;
+	if (!readFully(fd, &header, sizeof(header)) || header.magic != INGEST_MAGIC) {
+		return false;
+	}
+
+	std::vector<IngestTrackUpdate> updates(header.size / sizeof(IngestTrackUpdate));
+	if (header.size > 0 && !readFully(fd, updates.data(), header.size)) {
+		return false;
+	}
+
+	if (!quiet) {
+		for (const IngestTrackUpdate &update : updates) {
+			std::cout << update.timestamp << " id=" << update.id << " category=" << (int)update.category << " x=" << update.x << " y=" << update.y << " speed=" << update.speed << (update.lost ? " lost" : "") << std::endl;
+		}
+	}
+
+	return true;
+}
+
+void usage() {
+	std::cout << "Usage: frame-sender [OPTIONS] <ADDRESS> <VIDEO_PATH|CAMERA_INDEX>" << std::endl;
+	std::cout << "  ADDRESS                   unix:<PATH> or <HOST>:<PORT> of the ingest server" << std::endl;
+	std::cout << "  --jpeg                    Send JPEG encoded frames" << std::endl;
+	std::cout << "  --quality <N>             JPEG quality (default 90)" << std::endl;
+	std::cout << "  --shm                     Send frames through shared memory (server on the same host)" << std::endl;
+	std::cout << "  --window <N>              Maximum frames sent without reply (default 4)" << std::endl;
+	std::cout << "  --realtime                Send video files at their frame rate" << std::endl;
+	std::cout << "  --quiet                   Do not print the track updates" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+	std::vector<std::string> positional;
+	bool jpeg = false;
+	bool shm = false;
+	bool realtime = false;
+	bool quiet = false;
+	int quality = 90;
+	int window = 4;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		bool value = i + 1 < argc;
+
+		if (arg == "--jpeg") {
+			jpeg = true;
+		} else if (arg == "--quality" && value) {
+			quality = std::stoi(argv[++i]);
+		} else if (arg == "--shm") {
+			shm = true;
+		} else if (arg == "--window" && value) {
+			window = std::max(1, std::stoi(argv[++i]));
+		} else if (arg == "--realtime") {
+			realtime = true;
+		} else if (arg == "--quiet") {
+			quiet = true;
+		} else if (arg.rfind("--", 0) == 0) {
+			usage();
+			return 1;
+		} else {
+			positional.push_back(arg);
+		}
+	}
+
+	if (positional.size() < 2 || (jpeg && shm)) {
+		usage();
+		return 1;
+	}
+
+	std::string source = positional[1];
+	bool camera = source.find_first_not_of("0123456789") == std::string::npos;
+
+	cv::VideoCapture cap;
+	if (camera) {
+		cap.open(std::stoi(source));
+	} else {
+		cap.open(source);
+	}
+
+	if (!cap.isOpened()) {
+		std::cout << "Error opening video stream or file" << std::endl;
+		return 1;
+	}
+
+	int fd = ingestConnect(positional[0]);
+	if (fd < 0) {
+		return 1;
+	}
+
+	double fps = cap.get(cv::CAP_PROP_FPS);
+	std::vector<int> params = {cv::IMWRITE_JPEG_QUALITY, quality};
+	std::vector<uchar> encoded;
+	SharedFrames shared;
+
+	int64_t start = now();
+	int64_t sent = 0;
+	int64_t received = 0;
+	cv::Mat frame;
+
+	while (cap.read(frame) && !frame.empty()) {
+		if (!frame.isContinuous()) {
+			frame = frame.clone();
+		}
+
+		int64_t timestamp = camera ? now() : (int64_t)cap.get(cv::CAP_PROP_POS_MSEC);
+		size_t size = frame.total() * frame.elemSize();
+
+		// Shared memory is created with the size of the first frame, one slot per frame in flight
+		if (shm && sent == 0) {
+			std::string name = "/streetmonitor-" + std::to_string(getpid());
+			if (!shared.create(name, window, size)) {
+				return 1;
+			}
+
+			IngestHeader attach;
+			memset(&attach, 0, sizeof(attach));
+			attach.type = shm_attach;
+			attach.size = name.size();
+			attach.slot = window;
+			attach.slot_size = size;
+			if (!sendMessage(fd, attach, name.data())) {
+				break;
+			}
+		}
+
+		// Wait for a reply when the window is full, the slot of the oldest frame is free after its reply
+		if (sent - received >= window) {
+			if (!receiveUpdates(fd, quiet)) {
+				break;
+			}
+			received++;
+		}
+
+		IngestHeader header;
+		memset(&header, 0, sizeof(header));
+		header.timestamp = timestamp;
+		header.width = frame.cols;
+		header.height = frame.rows;
+		header.pixel_type = frame.type();
+
+		bool ok;
+		if (jpeg) {
+			cv::imencode(".jpg", frame, encoded, params);
+			header.type = jpeg_frame;
+			header.size = encoded.size();
+			ok = sendMessage(fd, header, encoded.data());
+		} else if (shm) {
+			if (size > shared.slot_size) {
+				std::cout << "Frame size changed, shared memory can not be used" << std::endl;
+				break;
+			}
+
+			// Pixels are not sent through the socket
+			header.type = shm_frame;
+			header.slot = sent % window;
+			memcpy(shared.slot(header.slot), frame.data, size);
+			ok = sendMessage(fd, header, nullptr);
+		} else {
+			header.type = raw_frame;
+			header.size = size;
+			ok = sendMessage(fd, header, frame.data);
+		}
+
+		if (!ok) {
+			break;
+		}
+		sent++;
+
+		if (realtime && !camera && fps > 0) {
+			int64_t target = start + (int64_t)(sent * 1000.0 / fps);
+			std::this_thread::sleep_until(std::chrono::system_clock::time_point(std::chrono::milliseconds(target)));
+		}
+	}
+
+	// Replies of the frames still in flight
+	while (received < sent && receiveUpdates(fd, quiet)) {
+		received++;
+	}
+
+	double elapsed = (now() - start) / 1000.0;
+	std::cout << "Sent " << sent << " frames in " << elapsed << " s (" << (elapsed > 0 ? sent / elapsed : 0) << " fps)" << std::endl;
+
+	close(fd);
+
+	return 0;
+}
@@ -0,0 +1,393 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/videoio.hpp>
+
+#pragma once
+
+/**
+ * @brief Source of frames read in order (video file, image sequence, raw video dump).
+ *
+ * Frames are decoded into the Mat passed to read(), an empty Mat receives a new buffer so frames can be kept (e.g. by a video sink) after the next read. Memory mapped sources return views that are valid until the source is destroyed.
+ */
+class FrameSource {
+	public:
+		virtual ~FrameSource() {}
+
+		/**
+		 * @brief Read the next frame.
+		 *
+		 * @param frame Frame read.
+		 * @param timestamp Position of the frame in the source (ms).
+		 * @return False when there are no more frames.
+		 */
+		virtual bool read(cv::Mat &frame, int64_t &timestamp) = 0;
+
+		/**
+		 * @brief Frame rate of the source, 0 if unknown.
+		 */
+		virtual double fps() const = 0;
+
+		/**
+		 * @brief Number of frames of the source, -1 if unknown.
+		 */
+		virtual int64_t count() const = 0;
+
+		/**
+		 * @brief Open the source that matches a path.
+		 *
+		 * Directories are read as image sequences, files with the .yuv, .raw, .bgr or .gray extension as raw video (raw_size and raw_format are required), anything else with VideoCapture.
+		 *
+		 * @param path Path of the source.
+		 * @param raw_size Size of the frames of raw video.
+		 * @param raw_format Pixel format of raw video (bgr, gray, i420, nv12).
+		 * @param fps Frame rate of image sequences and raw video.
+		 * @return Source opened, null on error.
+		 */
+		static FrameSource *open(std::string path, cv::Size raw_size = cv::Size(), std::string raw_format = "", double fps = 30.0);
+};
+
+/**
+ * @brief Frames decoded by VideoCapture (video files, image patterns supported by the backend).
+ */
+class VideoCaptureSource : public FrameSource {
+	public:
+		cv::VideoCapture cap;
+
+		VideoCaptureSource(std::string fname) {
+			this->cap.open(fname);
+		}
+
+		bool isOpened() const {
+			return this->cap.isOpened();
+		}
+
+		bool read(cv::Mat &frame, int64_t &timestamp) override {
+			if (!this->cap.read(frame) || frame.empty()) {
+				return false;
+			}
+
+			timestamp = this->cap.get(cv::CAP_PROP_POS_MSEC);
+			return true;
+		}
+
+		double fps() const override {
+			return this->cap.get(cv::CAP_PROP_FPS);
+		}
+
+		int64_t count() const override {
+			return this->cap.get(cv::CAP_PROP_FRAME_COUNT);
+		}
+};
+
+/**
+ * @brief Frames stored as images in a directory, read in name order.
+ *
+ * The kernel is asked to read ahead the files of the next frames so decoding does not wait for the disk.
+ */
+class ImageSequenceSource : public FrameSource {
+	public:
+		/**
+		 * @brief Paths of the images.
+		 */
+		std::vector<std::string> files;
+
+		/**
+		 * @brief Number of files read ahead of the current frame.
+		 */
+		int prefetch = 4;
+
+		ImageSequenceSource(std::string directory, double fps = 30.0) {
+			this->rate = fps;
+
+			std::vector<std::string> found;
+			cv::glob(directory + "/*", found, false);
+
+			for (const std::string &path : found) {
+				std::string extension = path.substr(path.find_last_of('.') + 1);
+				std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+
+				if (extension == "jpg" || extension == "jpeg" || extension == "png" || extension == "bmp" || extension == "tif" || extension == "tiff" || extension == "pgm" || extension == "ppm") {
+					this->files.push_back(path);
+				}
+			}
+
+			std::sort(this->files.begin(), this->files.end());
+		}
+
+		bool read(cv::Mat &frame, int64_t &timestamp) override {
+			if (this->index >= (int64_t)this->files.size()) {
+				return false;
+			}
+
+			// Files already prefetched are skipped
+			for (int64_t next = std::max(this->index, this->prefetched); next < std::min<int64_t>(this->index + this->prefetch + 1, this->files.size()); next++) {
+				int fd = ::open(this->files[next].c_str(), O_RDONLY);
+				if (fd >= 0) {
+					posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+					::close(fd);
+				}
+				this->prefetched = next + 1;
+			}
+
+			frame = cv::imread(this->files[this->index], cv::IMREAD_COLOR);
+			if (frame.empty()) {
+				std::cout << "Error reading image " << this->files[this->index] << std::endl;
+				return false;
+			}
+
+			timestamp = std::round(this->index * 1000.0 / this->rate);
+			this->index++;
+
+			return true;
+		}
+
+		double fps() const override {
+			return this->rate;
+		}
+
+		int64_t count() const override {
+			return this->files.size();
+		}
+
+	private:
+		double rate;
+
+		int64_t index = 0;
+
+		int64_t prefetched = 0;
+};
+
+/**
+ * @brief Pixel format of raw video.
+ */
+enum RawFormat { raw_bgr, raw_gray, raw_i420, raw_nv12 };
+
+/**
+ * @brief Uncompressed frames stored back to back in a file, the file is memory mapped and frames are views of the mapping.
+ *
+ * BGR frames are returned without copying. Gray and YUV frames are converted to BGR, the original planes are available with view(). The mapping is private, writing into a frame copies only the pages written and never modifies the file. The kernel reads the file sequentially ahead of the current frame.
+ */
+class RawVideoSource : public FrameSource {
+	public:
+		cv::Size size;
+
+		RawFormat format;
+
+		/**
+		 * @brief Number of frames read ahead of the current frame.
+		 */
+		int prefetch = 4;
+
+		RawVideoSource(std::string fname, cv::Size size, RawFormat format, double fps = 30.0) {
+			this->size = size;
+			this->format = format;
+			this->rate = fps;
+
+			int fd = ::open(fname.c_str(), O_RDONLY);
+			if (fd < 0) {
+				std::cout << "Error opening raw video " << fname << std::endl;
+				return;
+			}
+
+			struct stat st;
+			if (fstat(fd, &st) != 0 || st.st_size < (off_t)this->frameSize()) {
+				std::cout << "Raw video " << fname << " is smaller than a frame" << std::endl;
+				::close(fd);
+				return;
+			}
+
+			void *data = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+			::close(fd);
+
+			if (data == MAP_FAILED) {
+				std::cout << "Error mapping raw video " << fname << std::endl;
+				return;
+			}
+
+			this->data = (uint8_t *)data;
+			this->length = st.st_size;
+			this->frames = st.st_size / this->frameSize();
+
+			madvise(this->data, this->length, MADV_SEQUENTIAL);
+		}
+
+		~RawVideoSource() {
+			if (this->data != nullptr) {
+				munmap(this->data, this->length);
+			}
+		}
+
+		bool isOpened() const {
+			return this->data != nullptr;
+		}
+
+		/**
+		 * @brief Parse the name of a raw format (bgr, gray, i420/yuv420p, nv12).
+		 *
+		 * @return False if the format is unknown.
+		 */
+		static bool parseFormat(std::string name, RawFormat &format) {
+			if (name == "bgr" || name == "bgr24") {
+				format = raw_bgr;
+			} else if (name == "gray" || name == "gray8") {
+				format = raw_gray;
+			} else if (name == "i420" || name == "yuv420p") {
+				format = raw_i420;
+			} else if (name == "nv12") {
+				format = raw_nv12;
+			} else {
+				return false;
+			}
+
+			return true;
+		}
+
+		/**
+		 * @brief Size of each frame in bytes.
+		 */
+		size_t frameSize() const {
+			size_t pixels = this->size.area();
+
+			if (this->format == raw_bgr) {
+				return pixels * 3;
+			} else if (this->format == raw_gray) {
+				return pixels;
+			}
+
+			return pixels * 3 / 2;
+		}
+
+		/**
+		 * @brief View of a frame in its original format (YUV frames are a single channel image with the chroma planes below the luma plane).
+		 *
+		 * @param index Index of the frame.
+		 * @return View of the frame, empty if the frame does not exist. Valid while the source is open.
+		 */
+		cv::Mat view(int64_t index) {
+			if (index < 0 || index >= this->frames) {
+				return cv::Mat();
+			}
+
+			uint8_t *frame = this->data + index * this->frameSize();
+
+			if (this->format == raw_bgr) {
+				return cv::Mat(this->size, CV_8UC3, frame);
+			} else if (this->format == raw_gray) {
+				return cv::Mat(this->size, CV_8UC1, frame);
+			}
+
+			return cv::Mat(this->size.height * 3 / 2, this->size.width, CV_8UC1, frame);
+		}
+
+		bool read(cv::Mat &frame, int64_t &timestamp) override {
+			if (this->index >= this->frames) {
+				return false;
+			}
+
+			// Ask the kernel to load the next frames while this one is processed
+			if (this->prefetch > 0 && this->index + 1 < this->frames) {
+				size_t page = sysconf(_SC_PAGESIZE);
+				size_t start = ((this->index + 1) * this->frameSize()) / page * page;
+				size_t end = std::min<size_t>((this->index + 1 + this->prefetch) * this->frameSize(), this->length);
+				madvise(this->data + start, end - start, MADV_WILLNEED);
+			}
+
+			cv::Mat view = this->view(this->index);
+
+			if (this->format == raw_bgr) {
+				frame = view;
+			} else if (this->format == raw_gray) {
+				cv::cvtColor(view, frame, cv::COLOR_GRAY2BGR);
+			} else if (this->format == raw_i420) {
+				cv::cvtColor(view, frame, cv::COLOR_YUV2BGR_I420);
+			} else {
+				cv::cvtColor(view, frame, cv::COLOR_YUV2BGR_NV12);
+			}
+
+			timestamp = std::round(this->index * 1000.0 / this->rate);
+			this->index++;
+
+			return true;
+		}
+
+		double fps() const override {
+			return this->rate;
+		}
+
+		int64_t count() const override {
+			return this->frames;
+		}
+
+	private:
+		double rate;
+
+		uint8_t *data = nullptr;
+
+		size_t length = 0;
+
+		int64_t frames = 0;
+
+		int64_t index = 0;
+};
+
+inline FrameSource *FrameSource::open(std::string path, cv::Size raw_size, std::string raw_format, double fps) {
+	struct stat st;
+	if (stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+		ImageSequenceSource *sequence = new ImageSequenceSource(path, fps);
+		if (sequence->files.empty()) {
+			std::cout << "No images found in " << path << std::endl;
+			delete sequence;
+			return nullptr;
+		}
+
+		return sequence;
+	}
+
+	std::string extension = path.substr(path.find_last_of('.') + 1);
+	if (!raw_format.empty() || extension == "yuv" || extension == "raw" || extension == "bgr" || extension == "gray") {
+		RawFormat format;
+		if (raw_format.empty()) {
+			raw_format = extension == "yuv" ? "i420" : extension == "raw" ? "bgr" : extension;
+		}
+
+		if (!RawVideoSource::parseFormat(raw_format, format)) {
+			std::cout << "Unknown raw format " << raw_format << std::endl;
+			return nullptr;
+		}
+
+		if (raw_size.area() <= 0) {
+			std::cout << "Raw video requires the size of the frames" << std::endl;
+			return nullptr;
+		}
+
+		RawVideoSource *raw = new RawVideoSource(path, raw_size, format, fps);
+		if (!raw->isOpened()) {
+			delete raw;
+			return nullptr;
+		}
+
+		return raw;
+	}
+
+	VideoCaptureSource *video = new VideoCaptureSource(path);
+	if (!video->isOpened()) {
+		std::cout << "Error opening video stream or file" << std::endl;
+		delete video;
+		return nullptr;
+	}
+
+	return video;
+}
@@ -20,7 +20,16 @@ class HaarDetector {
 		cv::CascadeClassifier classifier;
 
 		HaarDetector(std::string model) {
-			classifier = cv::CascadeClassifier(model);
+			if (!model.empty()) {
+				classifier = cv::CascadeClassifier(model);
+			}
+		}
+
+		/**
+		 * @brief Check if the classifier has a model loaded.
+		 */
+		bool empty() {
+			return classifier.empty();
 		}
 
         /**
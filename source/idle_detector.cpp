@@ -0,0 +1,121 @@
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#pragma once
+
+/**
+ * @brief Cheap frame level change test used to skip the processing of static scenes.
+ *
+ * Each frame is reduced to a grayscale image whose size follows the frame resolution (each pixel is the mean of pixel_size x pixel_size frame pixels) and compared with a reference image. Pixels that changed more than the threshold are counted per block, the scene is idle while no block has min_changed_pixels changed pixels, so small objects are still seen in high resolution frames.
+ */
+class IdleDetector {
+	public:
+		/**
+		 * @brief Side of the square of frame pixels averaged into each compared pixel.
+		 */
+		int pixel_size = 4;
+
+		/**
+		 * @brief Side of the blocks (compared pixels) in which changed pixels are counted.
+		 */
+		int block_size = 16;
+
+		/**
+		 * @brief Minimum change of a compared pixel (gray levels) to count it as changed.
+		 */
+		double threshold = 10.0;
+
+		/**
+		 * @brief Number of changed pixels of a block for the frame to be considered changed.
+		 */
+		int min_changed_pixels = 8;
+
+		/**
+		 * @brief Number of consecutive unchanged frames before the scene is considered idle.
+		 */
+		int min_idle_frames = 5;
+
+		/**
+		 * @brief Every n idle frames one frame is reported as changed so that it is fully processed, zero disables it.
+		 */
+		int full_frame_interval = 30;
+
+		/**
+		 * @brief Check if the frame changed compared with the reference.
+		 *
+		 * The reference is replaced by the frame when it changed, so slow lighting changes are followed by calling reset() periodically.
+		 *
+		 * @param frame Frame (or region of interest) to test.
+		 * @return True if the scene has been static for at least min_idle_frames, false for the periodic full frames.
+		 */
+		bool idle(const cv::Mat &frame) {
+			cv::Size size((frame.cols + this->pixel_size - 1) / this->pixel_size, (frame.rows + this->pixel_size - 1) / this->pixel_size);
+			cv::resize(frame, this->small, size, 0, 0, cv::INTER_AREA);
+			if (this->small.channels() == 3) {
+				cv::cvtColor(this->small, this->thumbnail, cv::COLOR_BGR2GRAY);
+			} else {
+				this->small.copyTo(this->thumbnail);
+			}
+
+			if (this->reference.empty() || this->reference.size() != this->thumbnail.size()) {
+				this->thumbnail.copyTo(this->reference);
+				this->unchanged = 0;
+				return false;
+			}
+
+			cv::absdiff(this->thumbnail, this->reference, this->difference);
+			cv::threshold(this->difference, this->difference, this->threshold, 255, cv::THRESH_BINARY);
+
+			// Mean of each block is the fraction of its pixels that changed (scaled to 255)
+			cv::Size blocks((size.width + this->block_size - 1) / this->block_size, (size.height + this->block_size - 1) / this->block_size);
+			cv::resize(this->difference, this->changed, blocks, 0, 0, cv::INTER_AREA);
+
+			double max_changed;
+			cv::minMaxLoc(this->changed, nullptr, &max_changed);
+
+			if (max_changed * this->block_size * this->block_size / 255.0 >= this->min_changed_pixels) {
+				this->thumbnail.copyTo(this->reference);
+				this->unchanged = 0;
+				return false;
+			}
+
+			this->unchanged++;
+			if (this->unchanged < this->min_idle_frames) {
+				return false;
+			}
+
+			// Changes below the thresholds are still caught by the full frames
+			int idle_frames = this->unchanged - this->min_idle_frames + 1;
+			if (this->full_frame_interval > 0 && idle_frames % this->full_frame_interval == 0) {
+				return false;
+			}
+
+			return true;
+		}
+
+		/**
+		 * @brief Use the last thumbnail tested as reference.
+		 */
+		void reset() {
+			this->thumbnail.copyTo(this->reference);
+		}
+
+	private:
+		cv::Mat small;
+
+		cv::Mat thumbnail;
+
+		cv::Mat reference;
+
+		cv::Mat difference;
+
+		/**
+		 * @brief Fraction of changed pixels of each block.
+		 */
+		cv::Mat changed;
+
+		/**
+		 * @brief Number of consecutive frames without change.
+		 */
+		int unchanged = 0;
+};
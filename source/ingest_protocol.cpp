@@ -0,0 +1,452 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#pragma once
+
+/**
+ * @brief Magic value at the start of each ingest message.
+ */
+const uint32_t INGEST_MAGIC = 0x47494d53;
+
+/**
+ * @brief Type of an ingest message.
+ */
+enum IngestMessageType : uint32_t {
+	/**
+	 * @brief Frame with uncompressed pixels in the payload.
+	 */
+	raw_frame = 1,
+
+	/**
+	 * @brief Frame encoded as JPEG in the payload.
+	 */
+	jpeg_frame = 2,
+
+	/**
+	 * @brief Frame stored in a slot of the shared memory, the slot is free again when the track updates of the frame are received.
+	 */
+	shm_frame = 3,
+
+	/**
+	 * @brief Shared memory created by the sender, the payload is the name of the shared memory object.
+	 */
+	shm_attach = 4,
+
+	/**
+	 * @brief Track updates of a frame (sent by the server), the payload is a list of IngestTrackUpdate.
+	 */
+	track_updates = 5
+};
+
+/**
+ * @brief Header of each message, followed by size bytes of payload.
+ */
+struct IngestHeader {
+	uint32_t magic;
+
+	/**
+	 * @brief Type of the message (IngestMessageType).
+	 */
+	uint32_t type;
+
+	/**
+	 * @brief Size of the payload in bytes.
+	 */
+	uint64_t size;
+
+	/**
+	 * @brief Capture time of the frame (ms).
+	 */
+	int64_t timestamp;
+
+	/**
+	 * @brief Size and OpenCV type of raw and shared memory frames.
+	 */
+	int32_t width;
+	int32_t height;
+	int32_t pixel_type;
+
+	/**
+	 * @brief Slot of shared memory frames, number of slots of shm_attach, number of updates of track_updates.
+	 */
+	uint32_t slot;
+
+	/**
+	 * @brief Size of each slot of shm_attach.
+	 */
+	uint64_t slot_size;
+};
+
+/**
+ * @brief State of a track sent back to the sender.
+ */
+struct IngestTrackUpdate {
+	int64_t timestamp;
+	int32_t frame;
+	int32_t id;
+	uint8_t category;
+	uint8_t lost;
+	uint8_t reserved[2];
+	float x;
+	float y;
+	int32_t box_x;
+	int32_t box_y;
+	int32_t box_width;
+	int32_t box_height;
+	float speed;
+};
+
+static_assert(sizeof(IngestHeader) == 48, "Ingest header must be 48 bytes.");
+static_assert(sizeof(IngestTrackUpdate) == 48, "Ingest track update must be 48 bytes.");
+
+/**
+ * @brief Read exactly size bytes from a socket.
+ *
+ * @return False if the connection was closed or failed.
+ */
+bool readFully(int fd, void *data, size_t size) {
+	char *buffer = (char *)data;
+
+	while (size > 0) {
+		ssize_t count = read(fd, buffer, size);
+		if (count <= 0) {
+			return false;
+		}
+
+		buffer += count;
+		size -= count;
+	}
+
+	return true;
+}
+
+/**
+ * @brief Write exactly size bytes to a socket.
+ *
+ * @return False if the connection was closed or failed.
+ */
+bool writeFully(int fd, const void *data, size_t size) {
+	const char *buffer = (const char *)data;
+
+	while (size > 0) {
+		ssize_t count = send(fd, buffer, size, MSG_NOSIGNAL);
+		if (count <= 0) {
+			return false;
+		}
+
+		buffer += count;
+		size -= count;
+	}
+
+	return true;
+}
+
+/**
+ * @brief Send a message with its payload.
+ */
+bool sendMessage(int fd, IngestHeader header, const void *payload) {
+	header.magic = INGEST_MAGIC;
+
+	if (!writeFully(fd, &header, sizeof(header))) {
+		return false;
+	}
+
+	return header.size == 0 || writeFully(fd, payload, header.size);
+}
+
+/**
+ * @brief Address of an ingest endpoint, "unix:<path>" for a Unix domain socket or "<host>:<port>" for TCP.
+ */
+struct IngestAddress {
+	bool unix_socket = false;
+
+	/**
+	 * @brief Path of the Unix socket or host name.
+	 */
+	std::string path;
+
+	std::string port;
+
+	IngestAddress(std::string address) {
+		if (address.rfind("unix:", 0) == 0) {
+			this->unix_socket = true;
+			this->path = address.substr(5);
+			return;
+		}
+
+		size_t colon = address.rfind(':');
+		if (colon == std::string::npos) {
+			this->path = "0.0.0.0";
+			this->port = address;
+		} else {
+			this->path = address.substr(0, colon);
+			this->port = address.substr(colon + 1);
+		}
+	}
+};
+
+/**
+ * @brief Create a socket bound to an address.
+ *
+ * @return File descriptor of the listening socket, -1 on error.
+ */
+int ingestListen(std::string address) {
+	IngestAddress parsed(address);
+	int fd = -1;
+
+	if (parsed.unix_socket) {
+		sockaddr_un addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		strncpy(addr.sun_path, parsed.path.c_str(), sizeof(addr.sun_path) - 1);
+
+		unlink(parsed.path.c_str());
+
+		fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (fd < 0 || bind(fd, (sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 16) < 0) {
+			std::cout << "Error listening on " << address << std::endl;
+			if (fd >= 0) {
+				close(fd);
+			}
+			return -1;
+		}
+
+		return fd;
+	}
+
+	addrinfo hints, *result;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE;
+
+	if (getaddrinfo(parsed.path.c_str(), parsed.port.c_str(), &hints, &result) != 0) {
+		std::cout << "Error resolving " << address << std::endl;
+		return -1;
+	}
+
+	for (addrinfo *info = result; info != nullptr; info = info->ai_next) {
+		fd = socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+		if (fd < 0) {
+			continue;
+		}
+
+		int enable = 1;
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+		if (bind(fd, info->ai_addr, info->ai_addrlen) == 0 && listen(fd, 16) == 0) {
+			break;
+		}
+
+		close(fd);
+		fd = -1;
+	}
+
+	freeaddrinfo(result);
+
+	if (fd < 0) {
+		std::cout << "Error listening on " << address << std::endl;
+	}
+
+	return fd;
+}
+
+/**
+ * @brief Connect to an ingest server.
+ *
+ * @return File descriptor of the connection, -1 on error.
+ */
+int ingestConnect(std::string address) {
+	IngestAddress parsed(address);
+	int fd = -1;
+
+	if (parsed.unix_socket) {
+		sockaddr_un addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		strncpy(addr.sun_path, parsed.path.c_str(), sizeof(addr.sun_path) - 1);
+
+		fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (fd < 0 || connect(fd, (sockaddr *)&addr, sizeof(addr)) < 0) {
+			std::cout << "Error connecting to " << address << std::endl;
+			if (fd >= 0) {
+				close(fd);
+			}
+			return -1;
+		}
+
+		return fd;
+	}
+
+	addrinfo hints, *result;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+
+	if (getaddrinfo(parsed.path.c_str(), parsed.port.c_str(), &hints, &result) != 0) {
+		std::cout << "Error resolving " << address << std::endl;
+		return -1;
+	}
+
+	for (addrinfo *info = result; info != nullptr; info = info->ai_next) {
+		fd = socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+		if (fd < 0) {
+			continue;
+		}
+
+		if (connect(fd, info->ai_addr, info->ai_addrlen) == 0) {
+			// Small messages (track updates) should not wait for more data
+			int enable = 1;
+			setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+			break;
+		}
+
+		close(fd);
+		fd = -1;
+	}
+
+	freeaddrinfo(result);
+
+	if (fd < 0) {
+		std::cout << "Error connecting to " << address << std::endl;
+	}
+
+	return fd;
+}
+
+/**
+ * @brief Shared memory divided in slots used to pass frames between processes of the same host without copying them through the socket.
+ */
+class SharedFrames {
+	public:
+		/**
+		 * @brief Name of the shared memory object.
+		 */
+		std::string name;
+
+		/**
+		 * @brief Number of slots.
+		 */
+		uint32_t slots = 0;
+
+		/**
+		 * @brief Size of each slot in bytes.
+		 */
+		uint64_t slot_size = 0;
+
+		~SharedFrames() {
+			this->close();
+		}
+
+		/**
+		 * @brief Create the shared memory (sender side).
+		 */
+		bool create(std::string name, uint32_t slots, uint64_t slot_size) {
+			this->close();
+
+			int fd = shm_open(name.c_str(), O_CREAT | O_RDWR, 0600);
+			if (fd < 0) {
+				std::cout << "Error creating shared memory " << name << std::endl;
+				return false;
+			}
+
+			this->owner = true;
+			return this->map(fd, name, slots, slot_size, true);
+		}
+
+		/**
+		 * @brief Open shared memory created by another process (server side).
+		 */
+		bool open(std::string name, uint32_t slots, uint64_t slot_size) {
+			// Memory attached before is released, a sender can attach again
+			this->close();
+
+			int fd = shm_open(name.c_str(), O_RDWR, 0600);
+			if (fd < 0) {
+				std::cout << "Error opening shared memory " << name << std::endl;
+				return false;
+			}
+
+			return this->map(fd, name, slots, slot_size, false);
+		}
+
+		/**
+		 * @brief Get the address of a slot.
+		 *
+		 * @return Pointer to the slot, null if the slot does not exist.
+		 */
+		uint8_t *slot(uint32_t index) {
+			if (this->data == nullptr || index >= this->slots) {
+				return nullptr;
+			}
+
+			return this->data + index * this->slot_size;
+		}
+
+		/**
+		 * @brief Unmap the memory, the object is removed by the process that created it.
+		 */
+		void close() {
+			if (this->data != nullptr) {
+				munmap(this->data, this->slots * this->slot_size);
+				this->data = nullptr;
+			}
+
+			if (this->owner) {
+				shm_unlink(this->name.c_str());
+				this->owner = false;
+			}
+		}
+
+	private:
+		uint8_t *data = nullptr;
+
+		bool owner = false;
+
+		bool map(int fd, std::string name, uint32_t slots, uint64_t slot_size, bool resize) {
+			size_t size = slots * slot_size;
+
+			if (resize && ftruncate(fd, size) != 0) {
+				std::cout << "Error resizing shared memory " << name << std::endl;
+				::close(fd);
+				return false;
+			}
+
+			// Mapping beyond the end of the object would fail when accessed
+			struct stat st;
+			if (fstat(fd, &st) != 0 || (size_t)st.st_size < size) {
+				std::cout << "Shared memory " << name << " is smaller than expected" << std::endl;
+				::close(fd);
+				return false;
+			}
+
+			void *data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+			::close(fd);
+
+			if (data == MAP_FAILED) {
+				std::cout << "Error mapping shared memory " << name << std::endl;
+				return false;
+			}
+
+			this->name = name;
+			this->slots = slots;
+			this->slot_size = slot_size;
+			this->data = (uint8_t *)data;
+
+			return true;
+		}
+};
@@ -0,0 +1,324 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <exception>
+#include <cstring>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+
+#include "monitor.cpp"
+#include "ingest_protocol.cpp"
+
+#pragma once
+
+/**
+ * @brief Receives frames from other processes or hosts and returns the track updates on the same connection.
+ *
+ * Each connection is one camera, processed by its own monitor in its own thread. Frames can be sent raw, JPEG encoded or through shared memory when the sender runs on the same host.
+ */
+class IngestServer {
+	public:
+		/**
+		 * @brief Configuration of the monitor created for each connection, debug windows are always disabled.
+		 */
+		MonitorConfig config;
+
+		/**
+		 * @brief Assigns CPUs to each connection, optional.
+		 */
+		ResourceManager *resources = nullptr;
+
+		/**
+		 * @brief Number of CPUs reserved for each connection.
+		 */
+		int cores_per_stream = 1;
+
+		/**
+		 * @brief Number of connections being served.
+		 */
+		std::atomic<int> connections{0};
+
+		/**
+		 * @brief Largest frame or message accepted from a sender (bytes), larger messages close the connection.
+		 */
+		uint64_t max_frame_size = 128 << 20;
+
+		/**
+		 * @brief Largest number of shared memory slots accepted from a sender.
+		 */
+		uint32_t max_slots = 64;
+
+		IngestServer(const MonitorConfig &config = MonitorConfig()) {
+			this->config = config;
+			this->config.debug = false;
+
+			// Connections are different cameras, a single checkpoint can not be shared
+			this->config.background_checkpoint = "";
+		}
+
+		~IngestServer() {
+			this->stop();
+		}
+
+		/**
+		 * @brief Start listening on an address, "unix:<path>" or "<host>:<port>".
+		 *
+		 * @return True if the socket was created.
+		 */
+		bool listen(std::string address) {
+			this->fd = ingestListen(address);
+			return this->fd >= 0;
+		}
+
+		/**
+		 * @brief Accept connections until stop() is called, blocks the calling thread.
+		 */
+		void run() {
+			while (this->fd >= 0) {
+				int client = accept(this->fd, nullptr, nullptr);
+				if (client < 0) {
+					break;
+				}
+
+				int enable = 1;
+				setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+				std::unique_lock<std::mutex> lock(this->mutex);
+
+				// Threads of closed connections are joined so cameras that reconnect do not accumulate threads
+				for (auto worker = this->workers.begin(); worker != this->workers.end();) {
+					if (std::find(this->finished.begin(), this->finished.end(), worker->get_id()) != this->finished.end()) {
+						worker->join();
+						worker = this->workers.erase(worker);
+						continue;
+					}
+
+					worker++;
+				}
+				this->finished.clear();
+
+				this->workers.push_back(std::thread(&IngestServer::serve, this, client));
+			}
+
+			// Joined without the lock, connections still open take it when they end
+			std::vector<std::thread> workers;
+			{
+				std::unique_lock<std::mutex> lock(this->mutex);
+				workers.swap(this->workers);
+			}
+
+			for (std::thread &worker : workers) {
+				worker.join();
+			}
+
+			std::unique_lock<std::mutex> lock(this->mutex);
+			this->finished.clear();
+		}
+
+		/**
+		 * @brief Stop accepting connections, connections being served end when the sender disconnects.
+		 */
+		void stop() {
+			int fd = this->fd.exchange(-1);
+			if (fd >= 0) {
+				shutdown(fd, SHUT_RDWR);
+				close(fd);
+			}
+		}
+
+	private:
+		/**
+		 * @brief Listening socket, written by stop() from another thread.
+		 */
+		std::atomic<int> fd{-1};
+
+		std::mutex mutex;
+
+		std::vector<std::thread> workers;
+
+		/**
+		 * @brief Connection threads that finished and can be joined.
+		 */
+		std::vector<std::thread::id> finished;
+
+		/**
+		 * @brief Serve a connection, an error in the connection closes only that connection.
+		 *
+		 * @param client Socket of the connection.
+		 */
+		void serve(int client) {
+			this->connections++;
+
+			// Connection thread runs on its own cores
+			CpuSet cpus;
+			if (this->resources != nullptr) {
+				cpus = this->resources->acquire(this->cores_per_stream);
+				this->resources->bind(cpus);
+			}
+
+			try {
+				this->process(client);
+			} catch (const std::exception &e) {
+				std::cout << "Error in ingest connection: " << e.what() << std::endl;
+			}
+
+			close(client);
+
+			if (this->resources != nullptr) {
+				this->resources->release(cpus);
+			}
+
+			this->connections--;
+
+			std::unique_lock<std::mutex> lock(this->mutex);
+			this->finished.push_back(std::this_thread::get_id());
+		}
+
+		/**
+		 * @brief Check the size and type of a raw or shared memory frame before it is used.
+		 */
+		bool validFrame(const IngestHeader &header) {
+			if (header.width <= 0 || header.height <= 0 || (header.pixel_type != CV_8UC1 && header.pixel_type != CV_8UC3)) {
+				std::cout << "Invalid frame format " << header.width << "x" << header.height << " type " << header.pixel_type << std::endl;
+				return false;
+			}
+
+			uint64_t size = (uint64_t)header.width * header.height * CV_MAT_CN(header.pixel_type);
+			if (size > this->max_frame_size) {
+				std::cout << "Frame of " << size << " bytes is larger than the maximum frame size" << std::endl;
+				return false;
+			}
+
+			return true;
+		}
+
+		/**
+		 * @brief Process the frames of a connection.
+		 *
+		 * @param client Socket of the connection.
+		 */
+		void process(int client) {
+			Monitor monitor(this->config);
+			monitor.resources = this->resources;
+
+			std::vector<IngestTrackUpdate> updates;
+			monitor.track_callback = [&](StreetObject &obj, bool lost) {
+				cv::Point pos = obj.position();
+				cv::Rect box = obj.boudingBox();
+
+				IngestTrackUpdate update;
+				memset(&update, 0, sizeof(update));
+				update.timestamp = monitor.timestamp;
+				update.frame = monitor.frame_count;
+				update.id = obj.id;
+				update.category = obj.category;
+				update.lost = lost;
+				update.x = pos.x;
+				update.y = pos.y;
+				update.box_x = box.x;
+				update.box_y = box.y;
+				update.box_width = box.width;
+				update.box_height = box.height;
+				update.speed = obj.speed;
+				updates.push_back(update);
+			};
+
+			SharedFrames shared;
+			std::vector<uchar> payload;
+			cv::Mat raw;
+			cv::Mat frame;
+
+			IngestHeader header;
+			while (readFully(client, &header, sizeof(header))) {
+				if (header.magic != INGEST_MAGIC) {
+					std::cout << "Invalid ingest message" << std::endl;
+					break;
+				}
+
+				// Payloads are allocated from the header, limit them before allocating
+				if (header.type != shm_frame && header.size > this->max_frame_size) {
+					std::cout << "Ingest message of " << header.size << " bytes is larger than the maximum frame size" << std::endl;
+					break;
+				}
+
+				if (header.type == raw_frame) {
+					if (!this->validFrame(header)) {
+						break;
+					}
+
+					raw.create(header.height, header.width, header.pixel_type);
+					if (header.size != raw.total() * raw.elemSize()) {
+						std::cout << "Raw frame size does not match its header" << std::endl;
+						break;
+					}
+
+					if (!readFully(client, raw.data, header.size)) {
+						break;
+					}
+
+					frame = raw;
+				} else if (header.type == jpeg_frame) {
+					payload.resize(header.size);
+					if (!readFully(client, payload.data(), header.size)) {
+						break;
+					}
+
+					frame = cv::imdecode(payload, cv::IMREAD_COLOR);
+				} else if (header.type == shm_frame) {
+					// Frame stays in the shared memory, the sender does not reuse the slot until it receives the updates
+					uint8_t *data = shared.slot(header.slot);
+					if (data == nullptr || !this->validFrame(header)) {
+						std::cout << "Invalid shared memory frame" << std::endl;
+						break;
+					}
+
+					frame = cv::Mat(header.height, header.width, header.pixel_type, data);
+					if (frame.total() * frame.elemSize() > shared.slot_size) {
+						std::cout << "Shared memory frame does not fit in the slot" << std::endl;
+						break;
+					}
+				} else if (header.type == shm_attach) {
+					if (header.size == 0 || header.size > 255 || header.slot == 0 || header.slot > this->max_slots || header.slot_size == 0 || header.slot_size > this->max_frame_size) {
+						std::cout << "Invalid shared memory attach" << std::endl;
+						break;
+					}
+
+					std::string name(header.size, '\0');
+					if (!readFully(client, &name[0], header.size) || !shared.open(name, header.slot, header.slot_size)) {
+						break;
+					}
+					continue;
+				} else {
+					// Skip unknown messages
+					payload.resize(header.size);
+					if (!readFully(client, payload.data(), header.size)) {
+						break;
+					}
+					continue;
+				}
+
+				// Frames that can not be decoded are skipped but still get a reply
+				updates.clear();
+				if (!frame.empty()) {
+					monitor.processFrame(&frame, header.timestamp);
+				}
+
+				// One reply per frame, also acknowledges the shared memory slot
+				IngestHeader reply;
+				memset(&reply, 0, sizeof(reply));
+				reply.type = track_updates;
+				reply.timestamp = header.timestamp;
+				reply.slot = updates.size();
+				reply.size = updates.size() * sizeof(IngestTrackUpdate);
+
+				if (!sendMessage(client, reply, updates.data())) {
+					break;
+				}
+			}
+		}
+};
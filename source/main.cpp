@@ -1,12 +1,304 @@
 #include "monitor.cpp"
+#include "model_benchmark.cpp"
+#include "segment_processor.cpp"
+#include "ingest_server.cpp"
+#include "allocation_hooks.cpp"
+
+void usage() {
+	std::cout << "Usage: speed_camera [OPTIONS] <VIDEO_PATH|IMAGE_DIRECTORY|RAW_VIDEO_PATH|CAMERA_INDEX|STREAM_URL> [TRACK_LOG_PATH]" << std::endl;
+	std::cout << "       speed_camera --benchmark-models <MODEL_REGISTRY> <VIDEO_PATH>" << std::endl;
+	std::cout << "       speed_camera --listen <unix:PATH|HOST:PORT> [--config <PATH>]" << std::endl;
+	std::cout << "  --config <PATH>           Configuration file (YAML)" << std::endl;
+	std::cout << "  --log <PATH>              Track log file" << std::endl;
+	std::cout << "  --compact-log             Only write the compressed trajectory of each track into the log" << std::endl;
+	std::cout << "  --video-start <MS>        Time when a video file started (ms since epoch), stored as the time base of the log" << std::endl;
+	std::cout << "  --record <PATH>           Record annotated video (reduced frame rate and resolution)" << std::endl;
+	std::cout << "  --events <DIR>            Record clips of speeding vehicles into a directory" << std::endl;
+	std::cout << "  --speed-limit <KPH>       Speed that triggers an event clip (default 60)" << std::endl;
+	std::cout << "  --counts <PATH>           Write the counts of the counting lines every minute (CSV)" << std::endl;
+	std::cout << "  --listen <ADDRESS>        Receive frames from frame-sender processes and reply with track updates" << std::endl;
+	std::cout << "  --raw-size <WxH>          Size of the frames of raw video files (.yuv, .raw, .bgr, .gray)" << std::endl;
+	std::cout << "  --raw-format <FORMAT>     Pixel format of raw video (bgr, gray, i420, nv12)" << std::endl;
+	std::cout << "  --fps <N>                 Frame rate of raw video and image sequence directories (default 30)" << std::endl;
+	std::cout << "  --pin                     Pin each stream (ingest connection or offline segment) to its own cores" << std::endl;
+	std::cout << "  --cores-per-stream <N>    Cores reserved for each ingest connection (default 1)" << std::endl;
+	std::cout << "  --max-frame-size <MB>     Largest frame accepted from an ingest connection (default 128)" << std::endl;
+	std::cout << "  --opencv-threads <N>      Threads of the OpenCV pool shared by all streams (default 1 with --pin)" << std::endl;
+	std::cout << "  --dnn-slots <N>           Maximum DNN passes running at the same time" << std::endl;
+	std::cout << "  --offline                 Process a video file in parallel segments (no debug windows)" << std::endl;
+	std::cout << "  --threads <N>             Number of segments processed in parallel (offline)" << std::endl;
+	std::cout << "  --detection-interval <N>  Frames between detections of video files, sequential and offline (default 30)" << std::endl;
+}
 
 int main(int argc, char *argv[])
 {
 	if (argc < 2) {
-		std::cout << "Usage: speed_camera <VIDEO_PATH>" << std::endl;
+		usage();
+		return 1;
+	}
+
+	std::string registry_file;
+	std::string config_file;
+	std::string log_file;
+	std::vector<std::string> positional;
+	std::string record_file;
+	std::string events_dir;
+	std::string counts_file;
+	std::string listen_address;
+	float speed_limit = 0;
+	cv::Size raw_size;
+	std::string raw_format;
+	double fps = 30.0;
+	bool offline = false;
+	bool compact_log = false;
+	bool pin = false;
+	int cores_per_stream = 1;
+	uint64_t max_frame_size = 0;
+	int opencv_threads = -1;
+	int dnn_slots = 0;
+	int threads = 0;
+	int detection_interval = -1;
+	int64_t video_start = -1;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		bool value = i + 1 < argc;
+
+		if (arg == "--benchmark-models" && value) {
+			registry_file = argv[++i];
+		} else if (arg == "--config" && value) {
+			config_file = argv[++i];
+		} else if (arg == "--log" && value) {
+			log_file = argv[++i];
+		} else if (arg == "--record" && value) {
+			record_file = argv[++i];
+		} else if (arg == "--events" && value) {
+			events_dir = argv[++i];
+		} else if (arg == "--speed-limit" && value) {
+			speed_limit = std::stof(argv[++i]);
+		} else if (arg == "--counts" && value) {
+			counts_file = argv[++i];
+		} else if (arg == "--listen" && value) {
+			listen_address = argv[++i];
+		} else if (arg == "--raw-size" && value) {
+			std::string size = argv[++i];
+			size_t x = size.find('x');
+			if (x == std::string::npos) {
+				usage();
+				return 1;
+			}
+			raw_size = cv::Size(std::stoi(size.substr(0, x)), std::stoi(size.substr(x + 1)));
+		} else if (arg == "--raw-format" && value) {
+			raw_format = argv[++i];
+		} else if (arg == "--fps" && value) {
+			fps = std::stod(argv[++i]);
+		} else if (arg == "--pin") {
+			pin = true;
+		} else if (arg == "--cores-per-stream" && value) {
+			cores_per_stream = std::stoi(argv[++i]);
+		} else if (arg == "--max-frame-size" && value) {
+			max_frame_size = std::stoull(argv[++i]) << 20;
+		} else if (arg == "--opencv-threads" && value) {
+			opencv_threads = std::stoi(argv[++i]);
+		} else if (arg == "--dnn-slots" && value) {
+			dnn_slots = std::stoi(argv[++i]);
+		} else if (arg == "--video-start" && value) {
+			video_start = std::stoll(argv[++i]);
+		} else if (arg == "--compact-log") {
+			compact_log = true;
+		} else if (arg == "--offline") {
+			offline = true;
+		} else if (arg == "--threads" && value) {
+			threads = std::stoi(argv[++i]);
+		} else if (arg == "--detection-interval" && value) {
+			detection_interval = std::stoi(argv[++i]);
+		} else if (arg.rfind("--", 0) == 0) {
+			usage();
+			return 1;
+		} else {
+			positional.push_back(arg);
+		}
+	}
+
+	// Thread budget of the streams and of the OpenCV pool
+	ResourceManager resources;
+	resources.pin = pin;
+	resources.dnn_slots = dnn_slots;
+	resources.opencv_threads = opencv_threads >= 0 ? opencv_threads : (pin ? 1 : 0);
+	resources.configure();
+
+	// Count the buffers of cv::Mat in the allocation metrics
+	AllocationTracker::install();
+
+	// Ingest mode, frames are received from other processes or hosts
+	if (!listen_address.empty()) {
+		IngestServer server(config_file.empty() ? MonitorConfig() : MonitorConfig::load(config_file));
+		server.resources = &resources;
+		server.cores_per_stream = cores_per_stream;
+		if (max_frame_size > 0) {
+			server.max_frame_size = max_frame_size;
+		}
+		if (!server.listen(listen_address)) {
+			return 1;
+		}
+
+		std::cout << resources.toString() << std::endl;
+
+		std::cout << "Listening on " << listen_address << std::endl;
+		server.run();
+		return 0;
+	}
+
+	if (positional.empty()) {
+		usage();
+		return 1;
+	}
+
+	std::string source = positional[0];
+	if (log_file.empty() && positional.size() > 1) {
+		log_file = positional[1];
+	}
+
+	// Benchmark the models of a registry on a local clip
+	if (!registry_file.empty()) {
+		ModelRegistry registry;
+		if (!registry.load(registry_file)) {
+			return 1;
+		}
+
+		printBenchmark(benchmarkModels(registry, source));
+		return 0;
+	}
+
+	// Live sources log times since epoch, files log positions in the video from the time base of the log
+	bool live = source.find_first_not_of("0123456789") == std::string::npos || source.find("://") != std::string::npos;
+	int64_t time_origin = 0;
+	if (!live) {
+		if (video_start >= 0) {
+			time_origin = video_start;
+		} else {
+			// Modification time of the file, stays the same when the file is processed again
+			struct stat st;
+			time_origin = stat(source.c_str(), &st) == 0 ? (int64_t)st.st_mtime * 1000 : std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+		}
+	}
+
+	// Debug windows are shown by the application unless the configuration disables them
+	MonitorConfig defaults;
+	defaults.debug = true;
+	MonitorConfig config = config_file.empty() ? defaults : MonitorConfig::load(config_file, defaults);
+	if (detection_interval >= 0) {
+		config.detection_interval = detection_interval;
+	}
+
+	// Offline processing of a video file in parallel segments
+	if (offline) {
+		SegmentProcessor processor;
+		processor.config = config;
+		processor.resources = &resources;
+		if (threads > 0) {
+			processor.threads = threads;
+		}
+
+		// Segments detect in the same frames as a sequential run with the same interval
+		if (config.detection_interval > 0) {
+			processor.detection_interval = config.detection_interval;
+		}
+
+		double start = StageScheduler::now();
+		std::vector<SegmentTrack> tracks = processor.process(source);
+		std::cout << "Processed " << tracks.size() << " tracks in " << (StageScheduler::now() - start) / 1000.0 << " s" << std::endl;
+
+		if (!log_file.empty()) {
+			TrackLogWriter track_log(log_file, 0, time_origin);
+
+			// All records are available at once, nothing should be dropped
+			track_log.max_pending = SIZE_MAX;
+			SegmentProcessor::write(tracks, &track_log);
+			track_log.close();
+		}
+
+		return 0;
 	}
 
-	Monitor().startVideo(argv[1]);
+	Monitor monitor(config);
+
+	// Optional track log
+	TrackLogWriter *track_log = nullptr;
+	if (!log_file.empty()) {
+		track_log = new TrackLogWriter(log_file, 0, time_origin);
+		monitor.track_log = track_log;
+		monitor.log_records = !compact_log;
+	}
+
+	// Optional annotated video output
+	VideoSink *video_sink = nullptr;
+	if (!record_file.empty()) {
+		video_sink = new VideoSink(record_file);
+		monitor.video_sink = video_sink;
+	}
+
+	// Optional clips of speeding events
+	EventRecorder *event_recorder = nullptr;
+	if (!events_dir.empty()) {
+		event_recorder = new EventRecorder(events_dir);
+		if (speed_limit > 0) {
+			event_recorder->speed_threshold = speed_limit;
+		}
+		monitor.event_recorder = event_recorder;
+	}
+
+	// Optional output of the counting lines
+	if (!counts_file.empty()) {
+		if (monitor.tripwires.empty()) {
+			std::cout << "No counting lines in the configuration" << std::endl;
+		} else {
+			monitor.tripwires.open(counts_file);
+		}
+	}
+
+	// Live sources (camera index or stream url) drop frames to stay in real time
+	if (source.find_first_not_of("0123456789") == std::string::npos) {
+		monitor.startCamera(std::stoi(source));
+	} else if (source.find("://") != std::string::npos) {
+		monitor.startStream(source);
+	} else {
+		// Video files, image sequence directories and raw video
+		FrameSource *frames = FrameSource::open(source, raw_size, raw_format, fps);
+		if (frames != nullptr) {
+			monitor.startSource(frames);
+			delete frames;
+		}
+	}
+
+	monitor.tripwires.close();
+	monitor.saveBackground();
+
+	std::cout << monitor.metrics.toString() << std::endl;
+
+	if (track_log != nullptr) {
+		// Tracks still visible when the source ended
+		for (StreetObject &obj : monitor.objects) {
+			track_log->appendTrajectory(obj.id, obj.category, obj.trajectory, obj.max_speed);
+		}
+
+		for (LostTrackCache::Entry &entry : monitor.lost_tracks.entries) {
+			track_log->appendTrajectory(entry.object.id, entry.object.category, entry.object.trajectory, entry.object.max_speed);
+		}
+
+		track_log->close();
+		delete track_log;
+	}
+
+	if (video_sink != nullptr) {
+		video_sink->close();
+		delete video_sink;
+	}
+
+	if (event_recorder != nullptr) {
+		event_recorder->close();
+		delete event_recorder;
+	}
 
 	return 0;
 }
@@ -1,5 +1,6 @@
 #include <opencv2/core.hpp>
 #include <math.h>
+#include <cstdint>
 
 #pragma once
 
@@ -71,4 +72,43 @@ bool intersectCircleRect(cv::Point center, float radius, cv::Rect rect)
 bool intersectRect(cv::Rect a, cv::Rect b)
 {
     return (a & b).area() > 0;
-}
\ No newline at end of file
+}
+
+
+/**
+ * @brief Side of a point relative to a line (sign of the cross product).
+ * 
+ * @param a First point of the line.
+ * @param b Second point of the line.
+ * @param point Point to test.
+ * @return Positive if the point is to the right of the line looking from a to b in the image (y axis pointing down), negative if it is to the left, zero if it is on the line.
+ */
+int64_t lineSide(cv::Point a, cv::Point b, cv::Point point)
+{
+    return (int64_t)(b.x - a.x) * (point.y - a.y) - (int64_t)(b.y - a.y) * (point.x - a.x);
+}
+
+
+/**
+ * @brief Check the intersection between two line segments.
+ * 
+ * A point of segment a exactly on segment b counts as being on its right side, so a path that stops on the line crosses it only once.
+ * 
+ * @param a0 First point of segment a.
+ * @param a1 Second point of segment a.
+ * @param b0 First point of segment b.
+ * @param b1 Second point of segment b.
+ * @return True if there is intersection, false otherwise.
+ */
+bool intersectSegments(cv::Point a0, cv::Point a1, cv::Point b0, cv::Point b1)
+{
+    bool side0 = lineSide(b0, b1, a0) > 0;
+    bool side1 = lineSide(b0, b1, a1) > 0;
+
+    if (side0 == side1) { return false; }
+
+    int64_t d0 = lineSide(a0, a1, b0);
+    int64_t d1 = lineSide(a0, a1, b1);
+
+    return (d0 >= 0 && d1 <= 0) || (d0 <= 0 && d1 >= 0);
+}
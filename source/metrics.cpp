@@ -0,0 +1,68 @@
+#include <sstream>
+#include <string>
+#include <cstdint>
+
+#include "allocation_tracker.cpp"
+#include "stage_scheduler.cpp"
+
+#pragma once
+
+/**
+ * @brief Runtime metrics of a monitor, updated every frame.
+ */
+class Metrics {
+	public:
+		/**
+		 * @brief Number of frames processed.
+		 */
+		uint64_t frames_processed = 0;
+
+		/**
+		 * @brief Number of frames dropped by the capture before being processed.
+		 */
+		uint64_t frames_dropped = 0;
+
+		/**
+		 * @brief Number of frames processed by the idle fast path (static scene without tracks).
+		 */
+		uint64_t frames_idle = 0;
+
+		/**
+		 * @brief Number of lost tracks resumed when their object reappeared.
+		 */
+		uint64_t tracks_relinked = 0;
+
+		/**
+		 * @brief Time between the capture of the last frame and the end of its processing (ms).
+		 */
+		double latency = 0.0;
+
+		/**
+		 * @brief Time elapsed between the last two processed frames (ms).
+		 */
+		double frame_interval = 0.0;
+
+		/**
+		 * @brief Allocations (heap and cv::Mat buffers) of the mandatory work of the frames processed (background subtraction, tracking).
+		 */
+		AllocationStats core_allocations;
+
+		/**
+		 * @brief Allocations of each optional stage over the frames processed.
+		 */
+		AllocationStats stage_allocations[stage_count];
+
+		/**
+		 * @brief Allocations of the last frame processed, zero in steady state once buffers are reused.
+		 */
+		AllocationStats frame_allocations;
+
+		/**
+		 * @brief Get a readable summary of the metrics.
+		 */
+		std::string toString() {
+			std::stringstream ss;
+			ss << "processed=" << frames_processed << " dropped=" << frames_dropped << " idle=" << frames_idle << " relinked=" << tracks_relinked << " latency=" << latency << "ms interval=" << frame_interval << "ms allocations=" << frame_allocations.count << " (" << frame_allocations.bytes << "B)";
+			return ss.str();
+		}
+};
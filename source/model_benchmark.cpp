@@ -0,0 +1,134 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+#include <opencv2/videoio.hpp>
+
+#include "yolo_detector.cpp"
+#include "model_registry.cpp"
+#include "stage_scheduler.cpp"
+
+#pragma once
+
+/**
+ * @brief Result of the benchmark of a model.
+ */
+struct ModelBenchmark {
+	ModelEntry model;
+
+	/**
+	 * @brief Model could be loaded and executed.
+	 */
+	bool loaded = false;
+
+	/**
+	 * @brief Average time of detection per frame (ms), including pre and post processing.
+	 */
+	double latency = 0.0;
+
+	/**
+	 * @brief Average number of vehicles and pedestrians detected per frame (after non maximum suppression).
+	 */
+	double detections = 0.0;
+};
+
+/**
+ * @brief Benchmark the models of a registry on frames of a local clip.
+ *
+ * Used to select the cheapest model that detects enough objects for a specific camera.
+ *
+ * @param registry Models to be tested.
+ * @param clip Path of the video clip.
+ * @param samples Number of frames sampled evenly from the clip.
+ * @return std::vector<ModelBenchmark> Result of each model.
+ */
+std::vector<ModelBenchmark> benchmarkModels(const ModelRegistry &registry, std::string clip, int samples = 50) {
+	std::vector<ModelBenchmark> results;
+
+	// Sample frames from the clip
+	cv::VideoCapture cap(clip);
+	if (!cap.isOpened()) {
+		std::cout << "Error opening video stream or file" << std::endl;
+		return results;
+	}
+
+	int total = cap.get(cv::CAP_PROP_FRAME_COUNT);
+	int stride = std::max(1, total / samples);
+
+	std::vector<cv::Mat> frames;
+	cv::Mat frame;
+	for (int i = 0; cap.read(frame) && (int)frames.size() < samples; i++) {
+		if (i % stride == 0) {
+			frames.push_back(frame.clone());
+		}
+	}
+	cap.release();
+
+	if (frames.empty()) {
+		std::cout << "No frames read from " << clip << std::endl;
+		return results;
+	}
+
+	for (const ModelEntry &model : registry.models) {
+		ModelBenchmark result;
+		result.model = model;
+
+		try {
+			YOLODetector detector(model.path, registry.classes, model.input_size, model.input_size);
+			detector.debug = false;
+
+			// Warm up (first inference allocates memory and initializes the backend)
+			detector.detect(&frames[0]);
+
+			size_t count = 0;
+			double start = StageScheduler::now();
+
+			for (cv::Mat &sample : frames) {
+				std::vector<YOLOObject> objects = detector.suppress(detector.detect(&sample));
+				for (YOLOObject &obj : objects) {
+					// Pedestrians and vehicles (COCO classes 0 to 7)
+					if (obj.class_id <= 7) {
+						count++;
+					}
+				}
+			}
+
+			result.latency = (StageScheduler::now() - start) / frames.size();
+			result.detections = (double)count / frames.size();
+			result.loaded = true;
+		} catch (cv::Exception &e) {
+			std::cout << "Error running model " << model.name << ": " << e.what() << std::endl;
+		}
+
+		results.push_back(result);
+	}
+
+	return results;
+}
+
+/**
+ * @brief Print the results of the benchmark as a table, detections are also shown relative to the model that detected more objects.
+ */
+void printBenchmark(const std::vector<ModelBenchmark> &results) {
+	double best = 0.0;
+	for (const ModelBenchmark &result : results) {
+		best = std::max(best, result.detections);
+	}
+
+	std::cout << std::left << std::setw(24) << "Model" << std::setw(8) << "Input" << std::setw(10) << "Precision" << std::setw(14) << "Latency (ms)" << std::setw(14) << "Detections" << "Relative" << std::endl;
+
+	for (const ModelBenchmark &result : results) {
+		std::cout << std::left << std::setw(24) << result.model.name << std::setw(8) << result.model.input_size << std::setw(10) << result.model.precision;
+
+		if (!result.loaded) {
+			std::cout << "failed to load" << std::endl;
+			continue;
+		}
+
+		double relative = best > 0.0 ? result.detections / best : 0.0;
+		std::cout << std::fixed << std::setprecision(2) << std::setw(14) << result.latency << std::setw(14) << result.detections << relative << std::endl;
+		std::cout.unsetf(std::ios::fixed);
+	}
+}
@@ -0,0 +1,113 @@
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#pragma once
+
+/**
+ * @brief Description of a detection model available to the monitor.
+ */
+struct ModelEntry {
+	/**
+	 * @brief Name used to select the model.
+	 */
+	std::string name;
+
+	/**
+	 * @brief Path of the ONNX file.
+	 */
+	std::string path;
+
+	/**
+	 * @brief Size of the (square) input of the network (e.g. 320, 416, 640).
+	 */
+	int input_size = 640;
+
+	/**
+	 * @brief Precision of the model weights ("fp32", "fp16" or "int8").
+	 */
+	std::string precision = "fp32";
+};
+
+/**
+ * @brief List of detection models loaded from a configuration file.
+ *
+ * Allows the model, input size and precision to be selected by configuration.
+ */
+class ModelRegistry {
+	public:
+		/**
+		 * @brief Path of the file with the class names shared by the models.
+		 */
+		std::string classes = "./models/yolo/yolo.names";
+
+		/**
+		 * @brief Name of the model used when none is selected.
+		 */
+		std::string default_model;
+
+		/**
+		 * @brief Models available.
+		 */
+		std::vector<ModelEntry> models;
+
+		/**
+		 * @brief Load the registry from a YAML/XML file (cv::FileStorage).
+		 *
+		 * @param fname Path of the registry file.
+		 * @return True if the file was loaded.
+		 */
+		bool load(std::string fname) {
+			cv::FileStorage fs(fname, cv::FileStorage::READ);
+			if (!fs.isOpened()) {
+				std::cout << "Error opening model registry " << fname << std::endl;
+				return false;
+			}
+
+			if (!fs["classes"].empty()) {
+				this->classes = (std::string)fs["classes"];
+			}
+			if (!fs["default"].empty()) {
+				this->default_model = (std::string)fs["default"];
+			}
+
+			cv::FileNode list = fs["models"];
+			for (cv::FileNode node : list) {
+				ModelEntry model;
+				model.name = (std::string)node["name"];
+				model.path = (std::string)node["path"];
+				if (!node["input_size"].empty()) {
+					model.input_size = (int)node["input_size"];
+				}
+				if (!node["precision"].empty()) {
+					model.precision = (std::string)node["precision"];
+				}
+
+				this->models.push_back(model);
+			}
+
+			return true;
+		}
+
+		/**
+		 * @brief Get a model by name, the default model is returned if the name is empty.
+		 *
+		 * @param name Name of the model.
+		 * @return Pointer to the model, null if it does not exist.
+		 */
+		const ModelEntry *find(std::string name) const {
+			if (name.empty()) {
+				name = this->default_model;
+			}
+
+			for (const ModelEntry &model : this->models) {
+				if (model.name == name) {
+					return &model;
+				}
+			}
+
+			return nullptr;
+		}
+};
@@ -4,6 +4,7 @@
 #include <thread>
 #include <functional>
 #include <exception>
+#include <chrono>
 
 #include <opencv2/core.hpp>
 #include <opencv2/imgcodecs.hpp>
@@ -18,8 +19,24 @@
 #include "haar_detector.cpp"
 #include "background_subtractor.cpp"
 #include "features.cpp"
+#include "stabilizer.cpp"
+#include "roi_mask.cpp"
+#include "idle_detector.cpp"
+#include "speed_estimator.cpp"
+#include "track_log.cpp"
+#include "frame_grabber.cpp"
+#include "frame_source.cpp"
+#include "resource_manager.cpp"
+#include "metrics.cpp"
+#include "stage_scheduler.cpp"
+#include "model_registry.cpp"
+#include "video_sink.cpp"
+#include "event_recorder.cpp"
+#include "tripwire.cpp"
+#include "appearance.cpp"
 #include "street_object.cpp"
 #include "math_utils.cpp"
+#include "street_monitor.h"
 
 #pragma once
 
@@ -27,21 +44,237 @@ class Monitor {
 	public:
 		OpticalFlow optical_flow;
 
-		HaarDetector car_haar = HaarDetector("./models/haar/car.xml");
+		HaarDetector car_haar;
 
-		YOLODetector yolo = YOLODetector("./models/yolo/yolov5x.onnx", "./models/yolo/yolo.names");
+		YOLODetector yolo;
 
 		BackgroundSubtractor background_detector;
 
+		/**
+		 * @brief Camera shake compensation applied before background subtraction.
+		 */
+		Stabilizer stabilizer;
+
+		/**
+		 * @brief Enable camera shake compensation, when enabled all stages process the stabilized frame.
+		 */
+		bool stabilize = true;
+
+		/**
+		 * @brief Show debug windows and render the objects into the frame.
+		 */
+		bool debug = true;
+
 		/**
 		 * @brief Objects visible in the scene.
 		 */
         std::vector<StreetObject> objects;
 
+		/**
+		 * @brief Region of interest of the camera, pixels outside of it are ignored by all the stages.
+		 */
+		RoiMask roi;
+
+		/**
+		 * @brief Detects static scenes, frames without change and without tracks skip segmentation and tracking.
+		 */
+		IdleDetector idle_detector;
+
+		/**
+		 * @brief The background model is updated every n frames while the scene is idle, zero disables the idle fast path.
+		 */
+		int idle_background_interval = 10;
+
+		/**
+		 * @brief Path of the background model checkpoint, written periodically and loaded at startup to skip the warm up, empty to disable.
+		 */
+		std::string background_checkpoint;
+
+		/**
+		 * @brief Time between background checkpoints (ms).
+		 */
+		int64_t checkpoint_interval = 300000;
+
+		/**
+		 * @brief Moving blobs that do not match any object create new objects (of unknown category), used when no detector is available.
+		 */
+		bool blob_tracks = false;
+
+		/**
+		 * @brief Tracks lost recently, re-linked to new blobs or detections with a similar appearance near their predicted position.
+		 */
+		LostTrackCache lost_tracks;
+
+		/**
+		 * @brief The appearance signature of each track is refreshed every n frames.
+		 */
+		int appearance_interval = 5;
+
+		/**
+		 * @brief Computes the appearance signatures, with buffers reused between frames.
+		 */
+		AppearanceSignature appearance;
+
+		/**
+		 * @brief Signature of the last object measured, reused between frames.
+		 */
+		cv::Mat signature;
+
+		/**
+		 * @brief Run YOLO in tiles of the network input size instead of scaling the whole frame, for high resolution cameras.
+		 */
+		bool yolo_tiled = false;
+
+		/**
+		 * @brief Foreground mask of the last frame processed, used to skip static tiles.
+		 */
+		cv::Mat foreground;
+
+		/**
+		 * @brief Estimates the speed of the objects every frame, metric when the camera is calibrated.
+		 */
+		SpeedEstimator speed_estimator;
+
+		/**
+		 * @brief Counts the objects crossing the counting lines of the camera.
+		 */
+		TripwireCounter tripwires;
+
+		/**
+		 * @brief Log where the state of the tracks is written every frame and the compressed trajectory of each finished track, optional.
+		 */
+		TrackLogWriter *track_log = nullptr;
+
+		/**
+		 * @brief Write a record per track and frame into the track log, when false only the compressed trajectories are written.
+		 */
+		bool log_records = true;
+
+		/**
+		 * @brief Function called for each object updated in a frame and for each object removed (lost is true), optional.
+		 */
+		std::function<void(StreetObject &obj, bool lost)> track_callback;
+
+		/**
+		 * @brief Sink where the annotated video is recorded, optional.
+		 */
+		VideoSink *video_sink = nullptr;
+
+		/**
+		 * @brief Recorder of clips around speeding events, optional.
+		 */
+		EventRecorder *event_recorder = nullptr;
+
+		/**
+		 * @brief Limits the DNN passes running at the same time across monitors, optional.
+		 */
+		ResourceManager *resources = nullptr;
+
+		/**
+		 * @brief Buffer where debug information is drawn.
+		 */
+		cv::Mat debug_frame;
+
+		/**
+		 * @brief Runtime metrics of the monitor.
+		 */
+		Metrics metrics;
+
+		/**
+		 * @brief Decides which optional stages run in each frame.
+		 */
+		StageScheduler scheduler;
+
+		/**
+		 * @brief Number of frames waiting (or dropped) in the source when the current frame was received.
+		 */
+		int backlog = 0;
+
 		int skip_frames = 500;
 
+		/**
+		 * @brief Detection interval of sources that are not live (MonitorConfig::detection_interval).
+		 */
+		int detection_interval = 30;
+
+		/**
+		 * @brief Timestamp of the last background checkpoint (ms).
+		 */
+		int64_t last_checkpoint = 0;
+
 		int frame_count = 0;
 
+		/**
+		 * @brief Timestamp of the frame being processed (milliseconds).
+		 */
+		int64_t timestamp = 0;
+
+		/**
+		 * @brief Create a monitor from a configuration, models are loaded from the paths in the configuration (or injected directly).
+		 * 
+		 * @param config Configuration of the monitor.
+		 */
+		Monitor(const MonitorConfig &config = MonitorConfig()) : car_haar(config.haar_model), yolo(config.yolo_model, config.yolo_classes, config.yolo_input_size, config.yolo_input_size) {
+			if (!config.yolo_net.empty()) {
+				yolo.net = config.yolo_net;
+			}
+
+			this->skip_frames = config.skip_frames;
+			this->yolo_tiled = config.yolo_tiled;
+			this->blob_tracks = config.blob_tracks;
+			this->lost_tracks.max_frames = config.relink_frames;
+			this->lost_tracks.max_distance = config.relink_distance;
+			this->checkpoint_interval = config.checkpoint_interval;
+
+			// Background of the last run of the camera
+			this->background_checkpoint = config.background_checkpoint;
+			if (!this->background_checkpoint.empty() && this->background_detector.load(this->background_checkpoint)) {
+				std::cout << "Background checkpoint loaded from " << this->background_checkpoint << std::endl;
+			}
+			this->yolo.tile_batch = config.yolo_tile_batch;
+			this->yolo.max_tiles = config.yolo_max_tiles;
+			this->stabilize = config.stabilize;
+			this->scheduler.budget = config.frame_budget;
+			this->detection_interval = config.detection_interval;
+
+			// Region of interest of the camera
+			if (!config.roi_mask.empty()) {
+				this->roi.load(config.roi_mask);
+			}
+			this->background_detector.roi = &this->roi;
+
+			// Calibration of the camera to measure speeds in road coordinates
+			if (!config.calibration.empty()) {
+				this->speed_estimator.calibration.load(config.calibration);
+			}
+
+			// Counting lines of the camera
+			if (!config.counting_lines.empty()) {
+				this->tripwires.load(config.counting_lines);
+			}
+
+			// Stages without a model are never scheduled
+			this->scheduler.enabled[yolo_stage] = !yolo.empty();
+			this->scheduler.enabled[haar_stage] = !car_haar.empty();
+
+			// Debug windows and rendering
+			this->setDebug(config.debug);
+		}
+
+		/**
+		 * @brief Enable or disable debug windows of all the stages.
+		 * 
+		 * @param debug Show debug information.
+		 */
+		void setDebug(bool debug) {
+			this->debug = debug;
+			this->optical_flow.debug = debug;
+			this->car_haar.debug = debug;
+			this->yolo.debug = debug;
+			this->background_detector.debug = debug;
+			this->scheduler.enabled[render_stage] = debug;
+		}
+
 		/**
 		 * @brief Initialize the monitor detector using information from the first frame.
 		 * 
@@ -49,14 +282,54 @@ class Monitor {
 		 */
 		void initialize(cv::Mat *frame) {
 			optical_flow.initialize(frame);
+			this->compileRoi(frame->size());
+
+			if (this->stabilize) {
+				stabilizer.initialize(frame);
+			}
 		}
 		
+		/**
+		 * @brief Compile the region of interest for a frame size if it was compiled for another size.
+		 *
+		 * A mask that does not cover any pixel of the frame is a configuration error, it is disabled and the whole frame is processed.
+		 */
+		void compileRoi(cv::Size size) {
+			if (this->roi.empty() || this->roi.compiled(size)) {
+				return;
+			}
+
+			if (!this->roi.compile(size)) {
+				std::cout << "ROI mask disabled, the whole frame is processed" << std::endl;
+				this->roi = RoiMask();
+				return;
+			}
+
+			std::cout << "ROI covers " << std::round(this->roi.coverage() * 100) << "% of the " << size.width << "x" << size.height << " frame" << std::endl;
+		}
+
 		/**
 		 * @brief Process a frame of the video feed, can be obtained from camera, video file, dataset etc.
 		 * 
-		 * @param fname 
+		 * @param frame Frame to be processed.
+		 * @param timestamp Timestamp of the frame in milliseconds.
 		 */
-		void processFrame(cv::Mat *frame) {
+		void processFrame(cv::Mat *frame, int64_t timestamp = 0) {
+			if (frame_count > 0) {
+				metrics.frame_interval = timestamp - this->timestamp;
+			}
+			this->timestamp = timestamp;
+
+			// Warm restart, the background of the checkpoint replaces the warm up frames
+			if (frame_count == 0 && background_detector.hasCheckpoint()) {
+				this->initialize(frame);
+				if (background_detector.restore(frame)) {
+					this->last_checkpoint = timestamp;
+					frame_count = skip_frames + 1;
+					return;
+				}
+			}
+
 			if(frame_count < skip_frames) {
 				frame_count++;
 				return;
@@ -64,163 +337,533 @@ class Monitor {
 
 			if (frame_count == skip_frames) {
 				this->initialize(frame);
+				this->last_checkpoint = timestamp;
 				frame_count++;
 				return;
 			}
 
-			// optical_flow.sparse(frame);
+			double start = StageScheduler::now();
+			AllocationStats allocations = AllocationTracker::thread();
+
+			// Frame size can change (e.g. stream reconnected with another resolution)
+			this->compileRoi(frame->size());
+
+			// Static scene without tracks, only keep the background model up to date
+			if (this->idle_background_interval > 0 && this->objects.empty() && idle_detector.idle(this->roi.crop(*frame))) {
+				this->processIdleFrame(frame, timestamp);
+				scheduler.recordCore(StageScheduler::now() - start);
+				metrics.frame_allocations = AllocationTracker::thread() - allocations;
+				metrics.core_allocations += metrics.frame_allocations;
+				return;
+			}
+
+			// Compensate camera shake, remaining stages use the stabilized frame
+			cv::Mat stable;
+			if (this->stabilize) {
+				stable = stabilizer.update(frame);
+				frame = &stable;
+			}
 
 			cv::Mat mov = background_detector.update(frame);
-			std::vector<cv::KeyPoint> moving = background_detector.segmentBlobs(frame, &mov);
+			const std::vector<cv::KeyPoint> &moving = background_detector.segmentBlobs(frame, &mov);
+			this->foreground = mov;
 			
 			static const float tracking_speed = 40.0; 
 
+			// Moving blobs that do not belong to any object
+			int unmatched = 0;
+
 			// Iterate list of moving objects
 			for (int i = 0; i < moving.size(); i++) {
+				bool matched = false;
+
 				// Check if the moving box intersects one of the objects 
 				for (int j = 0; j < this->objects.size(); j++) {
 					// Object still has not been updated in this frame.
 					if (this->objects[j].frame < frame_count) {
 						if (intersectPointCircle(moving[i].pt, tracking_speed, this->objects[j].position())) {
 							cv::Point pos = cv::Point(moving[i].pt.x, moving[i].pt.y);
-							this->objects[j].updatePosition(pos, frame_count);
+							this->objects[j].updatePosition(pos, frame_count, timestamp);
+							matched = true;
 						}
 					}
 				}
+
+				// Object hidden for a while (e.g. behind a larger vehicle) that reappears
+				if (!matched && !this->lost_tracks.entries.empty()) {
+					cv::Rect box(moving[i].pt.x - moving[i].size / 2, moving[i].pt.y - moving[i].size / 2, moving[i].size, moving[i].size);
+					matched = this->relink(frame, box, cv::Point(moving[i].pt.x, moving[i].pt.y), unknown);
+				}
+
+				if (!matched) {
+					unmatched++;
+
+					if (this->blob_tracks) {
+						StreetObject obj;
+						obj.size = cv::Size(moving[i].size, moving[i].size);
+						obj.updatePosition(cv::Point(moving[i].pt.x, moving[i].pt.y), frame_count, timestamp);
+						this->objects.push_back(obj);
+					}
+				}
 			}
 
 
 			// If an object has not been seen for more than n frames remove it
 			static const int max_age = 10;
-			for (auto obj_ptr = this->objects.begin(); obj_ptr < this->objects.end(); obj_ptr++) {
+			for (auto obj_ptr = this->objects.begin(); obj_ptr < this->objects.end();) {
 				int age = frame_count - (*obj_ptr).frame;
 				if (age > max_age) {
+					// Kept for a while in case the object reappears
+					if (this->lost_tracks.max_frames > 0 && !obj_ptr->appearance.empty()) {
+						this->lost_tracks.add(*obj_ptr, frame_count, [this](StreetObject &obj) { this->finishTrack(obj); });
+					} else {
+						this->finishTrack(*obj_ptr);
+					}
+
 					obj_ptr = this->objects.erase(obj_ptr);
 					continue;
 				}
+
+				// Signatures are refreshed at a reduced rate, staggered by identifier
+				if (obj_ptr->frame == frame_count && this->lost_tracks.max_frames > 0 && (obj_ptr->appearance.empty() || (frame_count + obj_ptr->id) % this->appearance_interval == 0)) {
+					this->appearance.compute(*frame, obj_ptr->boudingBox(), this->signature);
+					AppearanceSignature::update(obj_ptr->appearance, this->signature);
+				}
+
+				obj_ptr++;
 			}
 
-			if (frame_count % 30 == 0){
-				// Detect objects using the YOLO DNN
-				std::vector<YOLOObject> yolo_objs = yolo.detect(frame);
-				auto yolo_obj = yolo_objs.begin();
+			this->lost_tracks.expire(frame_count, [this](StreetObject &obj) { this->finishTrack(obj); });
 
-				// Check if the boxes detected match one of the objects.
-				while (yolo_obj < yolo_objs.end()) {
-					
-					bool exists = false;
+			// Objects that still need to be classified
+			int unclassified = unmatched;
+			for (StreetObject &obj : this->objects) {
+				if (obj.category == unknown) {
+					unclassified++;
+				}
+			}
 
-					for(auto obj_ptr = this->objects.begin(); obj_ptr < this->objects.end(); obj_ptr++) {	
-						// Scale the box to prevent false detections
-						float scale = 0.9;
-						cv::Rect box = yolo_obj->box;
-						box.width *= scale;
-						box.height *= scale;
+			scheduler.recordCore(StageScheduler::now() - start);
+			metrics.core_allocations += AllocationTracker::thread() - allocations;
 
-						// Center of the bouding box 
-						cv::Point center = cv::Point(box.x + box.width / 2.0, box.y + box.height / 2.0);
+			// Decide the optional stages to run in this frame
+			unsigned int stages = scheduler.plan(unclassified, this->backlog, frame_count);
 
-						if (obj_ptr->insideRect(box)) {
-							obj_ptr->size = cv::Size(box.width / scale, box.height / scale);
-							exists = true;
-							break;
-						}
-					}
+			if (stages & (1 << yolo_stage)) {
+				double stage_start = StageScheduler::now();
+				AllocationStats stage_allocations = AllocationTracker::thread();
+				this->detectYOLO(frame);
+				this->recordStage(yolo_stage, stage_start, stage_allocations);
+			}
 
-					// Create new object in the list
-					if (!exists) {
-						StreetObject obj;
+			if (stages & (1 << haar_stage)) {
+				double stage_start = StageScheduler::now();
+				AllocationStats stage_allocations = AllocationTracker::thread();
+				this->detectHaar(frame);
+				this->recordStage(haar_stage, stage_start, stage_allocations);
+			}
 
-						// Vehicles
-						if (yolo_obj->class_id >= 2 && yolo_obj->class_id <= 7) {
-							obj.category = vehicle;
-						// Pedestrians
-						} else if (yolo_obj->class_id < 2) {
-							obj.category = pedestrian;
-						} else {
-							obj.category = unknown;
-						}
+			if (stages & (1 << flow_stage)) {
+				double stage_start = StageScheduler::now();
+				AllocationStats stage_allocations = AllocationTracker::thread();
+				optical_flow.sparse(frame);
+				this->recordStage(flow_stage, stage_start, stage_allocations);
+			}
 
-						cv::Rect box = yolo_obj->box;
-						obj.size = cv::Size(box.width, box.height);
-						obj.updatePosition(cv::Point(box.x + box.width / 2.0, box.y + box.height / 2.0), frame_count);
-						this->objects.push_back(obj);
-					}
+			this->speed_estimator.update(this->objects, frame_count);
+
+			this->tripwires.update(this->objects, frame_count, timestamp);
+
+			this->publishTracks();
+
+			if (this->video_sink != nullptr) {
+				this->video_sink->push(*frame, this->overlays(), timestamp);
+			}
+
+			if (this->event_recorder != nullptr) {
+				this->event_recorder->push(*frame, timestamp);
+			}
+
+			if (stages & (1 << render_stage)) {
+				double stage_start = StageScheduler::now();
+				AllocationStats stage_allocations = AllocationTracker::thread();
+				this->drawDebug(frame);
+				this->recordStage(render_stage, stage_start, stage_allocations);
+			}
+
+			if (timestamp - this->last_checkpoint >= this->checkpoint_interval) {
+				this->saveBackground();
+				this->last_checkpoint = timestamp;
+			}
+
+			metrics.frame_allocations = AllocationTracker::thread() - allocations;
+			metrics.frames_processed++;
+
+			frame_count++;
+		}
 
+		/**
+		 * @brief Time and allocations of an optional stage that just ran.
+		 * 
+		 * @param stage Stage that ran.
+		 * @param start Time when the stage started (ms).
+		 * @param allocations Allocations of the thread when the stage started.
+		 */
+		void recordStage(Stage stage, double start, const AllocationStats &allocations) {
+			scheduler.record(stage, StageScheduler::now() - start);
+			metrics.stage_allocations[stage] += AllocationTracker::thread() - allocations;
+		}
 
-					yolo_obj++;
+		/**
+		 * @brief Fast path for frames of a static scene without tracks, segmentation, tracking and detection are skipped.
+		 * 
+		 * @param frame Frame to be processed.
+		 * @param timestamp Timestamp of the frame in milliseconds.
+		 */
+		void processIdleFrame(cv::Mat *frame, int64_t timestamp) {
+			metrics.frames_idle++;
+
+			// Update the background model at a reduced rate
+			if (metrics.frames_idle % this->idle_background_interval == 0) {
+				cv::Mat stable;
+				if (this->stabilize) {
+					stable = stabilizer.update(frame);
+					frame = &stable;
 				}
+
+				background_detector.update(frame);
+
+				// Follow slow lighting changes
+				idle_detector.reset();
+			}
+
+			// Close the counting intervals on time
+			this->tripwires.update(this->objects, frame_count, timestamp);
+
+			this->lost_tracks.expire(frame_count, [this](StreetObject &obj) { this->finishTrack(obj); });
+
+			if (this->video_sink != nullptr) {
+				this->video_sink->push(*frame, this->overlays(), timestamp);
 			}
 
+			if (this->event_recorder != nullptr) {
+				this->event_recorder->push(*frame, timestamp);
+			}
+
+			if (scheduler.enabled[render_stage]) {
+				this->drawDebug(frame);
+			}
+
+			if (timestamp - this->last_checkpoint >= this->checkpoint_interval) {
+				this->saveBackground();
+				this->last_checkpoint = timestamp;
+			}
 
-			this->drawDebug(frame);
+			metrics.frames_processed++;
 
 			frame_count++;
 		}
 
 		/**
-		 * Draw debug information into screen.
+		 * @brief Write the background model into the checkpoint, called periodically and when the monitor stops.
+		 * 
+		 * @return True if the checkpoint was written.
 		 */
-		void drawDebug(cv::Mat *frame) {
-			// Draw objects into the frame
-			auto obj_ptr = this->objects.begin();
-			while (obj_ptr < this->objects.end()) {
-				if (obj_ptr->length() > 0) {
-					cv::Point pos = obj_ptr->position();
-					
-					cv::Scalar color = obj_ptr->category == vehicle ? cv::Scalar(0,255,0) : obj_ptr->category == pedestrian ? cv::Scalar(255,0,0) : cv::Scalar(0,0,255);
-					cv::circle(*frame, pos, 5, color, cv::FILLED, cv::LINE_8);
-					
+		bool saveBackground() {
+			if (this->background_checkpoint.empty() || frame_count <= skip_frames) {
+				return false;
+			}
 
-					cv::Point direction = obj_ptr->direction();
-					cv::line(*frame, pos, pos + direction * 2, color, 1, cv::LINE_8);
+			return this->background_detector.save(this->background_checkpoint);
+		}
 
-					cv::putText(*frame, std::to_string(obj_ptr->id), cv::Point(pos.x + 10, pos.y), cv::FONT_HERSHEY_PLAIN, 1.0, color, 1, cv::LINE_AA);
-					
-					const static float factor = 3.0;
-					const static float y_factor = 900;
+		/**
+		 * @brief Detect objects using the YOLO DNN, boxes that do not match an existing object create new objects.
+		 * 
+		 * @param frame Frame to detect objects in.
+		 */
+		void detectYOLO(cv::Mat *frame) {
+			// Detect only inside the bounds of the region of interest
+			cv::Mat region = this->roi.crop(*frame);
+			cv::Point offset = this->roi.offset();
+
+			// Detections are kept by the detector until its next call
+			const std::vector<YOLOObject> *yolo_objs;
+			{
+				DNNSlot slot(this->resources);
+
+				if (this->yolo_tiled) {
+					cv::Mat region_foreground = this->foreground.empty() ? cv::Mat() : this->roi.crop(this->foreground);
+					yolo_objs = &yolo.detectTiled(&region, &region_foreground);
+				} else {
+					yolo_objs = &yolo.detect(&region);
+				}
+			}
 
-					int speed = std::round(size(direction) * (factor + (pos.y / y_factor)));
-					cv::putText(*frame, std::to_string(speed) + " kph", cv::Point(pos.x + 10, pos.y + 20), cv::FONT_HERSHEY_PLAIN, 1.0, color, 1, cv::LINE_AA);
+			for (const YOLOObject &yolo_obj : *yolo_objs) {
+				cv::Rect box = yolo_obj.box + offset;
+				if (!this->roi.contains((box.tl() + box.br()) / 2)) {
+					continue;
+				}
 
+				Category category;
 
-					cv::Rect rect = obj_ptr->boudingBox();
-					cv::rectangle(*frame, cv::Point(rect.x, rect.y), cv::Point(rect.x + rect.width, rect.y + rect.height), color, 1);
+				// Vehicles
+				if (yolo_obj.class_id >= 2 && yolo_obj.class_id <= 7) {
+					category = vehicle;
+				// Pedestrians
+				} else if (yolo_obj.class_id < 2) {
+					category = pedestrian;
+				} else {
+					category = unknown;
 				}
-	
-				obj_ptr++;
+
+				this->addDetection(frame, box, category);
+			}
+		}
+
+		/**
+		 * @brief Detect vehicles using the haar cascade, cheaper than YOLO and used when YOLO does not fit in the frame budget.
+		 * 
+		 * @param frame Frame to detect objects in.
+		 */
+		void detectHaar(cv::Mat *frame) {
+			// Detect only inside the bounds of the region of interest
+			cv::Mat region = this->roi.crop(*frame);
+			cv::Point offset = this->roi.offset();
+			std::vector<cv::Rect> boxes = car_haar.detect(&region);
+
+			for (cv::Rect &box : boxes) {
+				box += offset;
+				if (!this->roi.contains((box.tl() + box.br()) / 2)) {
+					continue;
+				}
+
+				this->addDetection(frame, box, vehicle);
+			}
+		}
+
+		/**
+		 * @brief Check if the box detected matches one of the objects or a lost track, otherwise create a new object.
+		 * 
+		 * @param frame Frame where the object was detected.
+		 * @param box Bounding box of the detection.
+		 * @param category Category of the detection.
+		 */
+		void addDetection(cv::Mat *frame, cv::Rect box, Category category) {
+			// Scale the box to prevent false detections
+			float scale = 0.9;
+			cv::Rect scaled = box;
+			scaled.width *= scale;
+			scaled.height *= scale;
+
+			for (auto obj_ptr = this->objects.begin(); obj_ptr < this->objects.end(); obj_ptr++) {
+				if (obj_ptr->insideRect(scaled)) {
+					obj_ptr->size = cv::Size(box.width, box.height);
+
+					// Classify objects that were still unknown
+					if (obj_ptr->category == unknown) {
+						obj_ptr->category = category;
+					}
+					return;
+				}
+			}
+
+			cv::Point center(box.x + box.width / 2.0, box.y + box.height / 2.0);
+			if (!this->lost_tracks.entries.empty() && this->relink(frame, box, center, category)) {
+				return;
+			}
+
+			// Create new object in the list
+			StreetObject obj;
+			obj.category = category;
+			obj.size = cv::Size(box.width, box.height);
+			obj.updatePosition(center, frame_count, timestamp);
+			this->objects.push_back(obj);
+		}
+
+		/**
+		 * @brief Resume a lost track that matches the position and appearance of a new blob or detection.
+		 * 
+		 * @param frame Frame where the object was found.
+		 * @param box Bounding box of the object.
+		 * @param position Position of the object.
+		 * @param category Category of the detection, unknown keeps the category of the track.
+		 * @return True if a lost track was resumed.
+		 */
+		bool relink(cv::Mat *frame, cv::Rect box, cv::Point position, Category category) {
+			this->appearance.compute(*frame, box, this->signature);
+			if (this->signature.empty()) {
+				return false;
 			}
 
-			cv::imshow("Frame", *frame);
+			int index = this->lost_tracks.find(position, this->signature, frame_count);
+			if (index < 0) {
+				return false;
+			}
+
+			StreetObject obj = std::move(this->lost_tracks.entries[index].object);
+			this->lost_tracks.entries.erase(this->lost_tracks.entries.begin() + index);
+
+			if (obj.category == unknown) {
+				obj.category = category;
+			}
+			obj.size = cv::Size(box.width, box.height);
+			obj.updatePosition(position, frame_count, timestamp);
+			AppearanceSignature::update(obj.appearance, this->signature);
+			this->objects.push_back(std::move(obj));
+
+			metrics.tracks_relinked++;
+
+			return true;
+		}
+
+		/**
+		 * @brief Report a track that will not be updated anymore to the track callback and the track log.
+		 */
+		void finishTrack(StreetObject &obj) {
+			if (this->track_callback) {
+				this->track_callback(obj, true);
+			}
+
+			if (this->track_log != nullptr) {
+				this->track_log->appendTrajectory(obj.id, obj.category, obj.trajectory, obj.max_speed);
+			}
+		}
+
+		/**
+		 * @brief Write the objects updated in this frame into the track log, deliver them to the track callback and check them for speeding events.
+		 */
+		void publishTracks() {
+			for (StreetObject &obj : this->objects) {
+				if (obj.frame != frame_count || obj.length() == 0) {
+					continue;
+				}
+
+				if (this->track_callback) {
+					this->track_callback(obj, false);
+				}
+
+				if (this->event_recorder != nullptr) {
+					this->event_recorder->check(obj.id, obj.speed, this->timestamp);
+				}
+
+				if (this->track_log == nullptr || !this->log_records) {
+					continue;
+				}
+
+				cv::Point pos = obj.position();
+				cv::Rect box = obj.boudingBox();
+
+				TrackRecord record;
+				memset(&record, 0, sizeof(record));
+				record.timestamp = this->timestamp;
+				record.frame = frame_count;
+				record.id = obj.id;
+				record.category = obj.category;
+				record.x = pos.x;
+				record.y = pos.y;
+				record.box_x = box.x;
+				record.box_y = box.y;
+				record.box_width = box.width;
+				record.box_height = box.height;
+				record.speed = obj.speed;
+
+				this->track_log->append(record);
+			}
+		}
+
+		/**
+		 * @brief Get the overlays of the objects visible in the scene.
+		 */
+		std::vector<TrackOverlay> overlays() {
+			std::vector<TrackOverlay> overlays;
+
+			for (StreetObject &obj : this->objects) {
+				if (obj.length() == 0) {
+					continue;
+				}
+
+				TrackOverlay overlay;
+				overlay.id = obj.id;
+				overlay.category = obj.category;
+				overlay.position = obj.position();
+				overlay.direction = obj.direction();
+				overlay.box = obj.boudingBox();
+				overlay.speed = obj.speed;
+				overlays.push_back(overlay);
+			}
+
+			return overlays;
+		}
+
+		/**
+		 * Draw debug information into screen.
+		 * 
+		 * Objects are drawn into a copy of the frame, the frame being processed is not modified.
+		 */
+		void drawDebug(cv::Mat *frame) {
+			frame->copyTo(this->debug_frame);
+
+			// Draw objects into the frame
+			drawOverlays(this->debug_frame, this->overlays());
+
+			cv::imshow("Frame", this->debug_frame);
 			cv::waitKey(1);
 		}
 
 		/**
 		 * @brief Start processing from computer camera.
+		 * 
+		 * @param device Index of the camera.
 		 */
-		void startCamera() {
-			cv::VideoCapture cap(0); 
+		void startCamera(int device = 0) {
+			FrameGrabber grabber;
+			if (!grabber.open(device)) {
+				return;
+			}
 
-			if(!cap.isOpened()) {
-				std::cout << "Error opening video stream or file" << std::endl;
+			this->startLive(&grabber);
+		}
+
+		/**
+		 * @brief Start processing from a live stream (e.g. RTSP url).
+		 * 
+		 * @param url Address of the stream.
+		 */
+		void startStream(const std::string url) {
+			FrameGrabber grabber;
+			if (!grabber.open(url)) {
 				return;
 			}
 
-			// Processing loop
-			while(1) {
-				cv::Mat frame;
-				cap >> frame;
+			this->startLive(&grabber);
+		}
 
-				// If the frame is empty, break immediately
-				if (frame.empty()) {
-					break;
-				}
+		/**
+		 * @brief Process frames from a live source, frames are grabbed in a separate thread and the most recent frame is always processed.
+		 * 
+		 * @param grabber Grabber already opened.
+		 */
+		void startLive(FrameGrabber *grabber) {
+			grabber->start();
 
-				this->processFrame(&frame);           
+			// Processing loop
+			TimedFrame captured;
+			uint64_t dropped = 0;
+			while (grabber->read(captured)) {
+				// Frames dropped since the last frame also count as backlog
+				this->backlog = grabber->backlog() + (grabber->dropped - dropped);
+				dropped = grabber->dropped;
+
+				this->processFrame(&captured.frame, captured.timestamp);
+
+				int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+				metrics.latency = now - captured.timestamp;
+				metrics.frames_dropped = grabber->dropped;
 			}
 
-			// When everything done, release the video capture object
-			cap.release();
+			grabber->stop();
 
 			// Closes all the frames
 			cv::destroyAllWindows();
@@ -230,30 +873,137 @@ class Monitor {
 		 * @brief Start the speed camera detector with a specific file
 		 */
 		void startVideo(const std::string fname) {
-			cv::VideoCapture cap(fname); 
+			VideoCaptureSource source(fname);
 
-			if(!cap.isOpened()) {
+			if(!source.isOpened()) {
 				std::cout << "Error opening video stream or file" << std::endl;
 				return;
 			}
 
-			// Processing loop
-			while(1) {
-				cv::Mat frame;
-				cap >> frame;
+			this->startSource(&source);
+		}
 
-				// If the frame is empty, break immediately
-				if (frame.empty()) {
+		/**
+		 * @brief Process all the frames of a source (video file, image sequence, raw video), frames are never dropped.
+		 * 
+		 * @param source Source already opened.
+		 */
+		void startSource(FrameSource *source) {
+			// Nothing is dropped, detection runs every n frames like an offline run (or within the budget of the source frame rate)
+			double fps = source->fps();
+			if (this->detection_interval > 0) {
+				scheduler.fixed_interval = this->detection_interval;
+			} else if (fps > 0) {
+				scheduler.budget = 1000.0 / fps;
+			}
+
+			// Processing loop, each frame gets its own buffer (sinks keep the frames pushed)
+			while (1) {
+				cv::Mat frame;
+				int64_t timestamp;
+				if (!source->read(frame, timestamp)) {
 					break;
 				}
 
-				this->processFrame(&frame);           
+				this->processFrame(&frame, timestamp);
 			}
 
-			// When everything done, release the video capture object
-			cap.release();
-
 			// Closes all the frames
 			cv::destroyAllWindows();
 		}
 };
+
+// Not inline, the library exports them for the applications that only include street_monitor.h
+MonitorConfig MonitorConfig::load(std::string fname) {
+	return MonitorConfig::load(fname, MonitorConfig());
+}
+
+MonitorConfig MonitorConfig::load(std::string fname, const MonitorConfig &defaults) {
+	MonitorConfig config = defaults;
+
+	cv::FileStorage fs(fname, cv::FileStorage::READ);
+	if (!fs.isOpened()) {
+		std::cout << "Error opening configuration " << fname << std::endl;
+		return config;
+	}
+
+	if (!fs["yolo_model"].empty()) {
+		config.yolo_model = (std::string)fs["yolo_model"];
+	}
+	if (!fs["yolo_classes"].empty()) {
+		config.yolo_classes = (std::string)fs["yolo_classes"];
+	}
+	if (!fs["yolo_input_size"].empty()) {
+		config.yolo_input_size = (int)fs["yolo_input_size"];
+	}
+
+	// Select the model from a registry
+	if (!fs["model_registry"].empty()) {
+		ModelRegistry registry;
+		std::string name = fs["model"].empty() ? "" : (std::string)fs["model"];
+
+		if (registry.load((std::string)fs["model_registry"])) {
+			const ModelEntry *model = registry.find(name);
+			if (model != nullptr) {
+				config.yolo_model = model->path;
+				config.yolo_input_size = model->input_size;
+				config.yolo_classes = registry.classes;
+			} else {
+				std::cout << "Model " << name << " not found in registry" << std::endl;
+			}
+		}
+	}
+	if (!fs["haar_model"].empty()) {
+		config.haar_model = (std::string)fs["haar_model"];
+	}
+	if (!fs["skip_frames"].empty()) {
+		config.skip_frames = (int)fs["skip_frames"];
+	}
+	if (!fs["stabilize"].empty()) {
+		config.stabilize = (int)fs["stabilize"] != 0;
+	}
+	if (!fs["debug"].empty()) {
+		config.debug = (int)fs["debug"] != 0;
+	}
+	if (!fs["frame_budget"].empty()) {
+		config.frame_budget = (double)fs["frame_budget"];
+	}
+	if (!fs["detection_interval"].empty()) {
+		config.detection_interval = (int)fs["detection_interval"];
+	}
+	if (!fs["roi_mask"].empty()) {
+		config.roi_mask = (std::string)fs["roi_mask"];
+	}
+	if (!fs["calibration"].empty()) {
+		config.calibration = (std::string)fs["calibration"];
+	}
+	if (!fs["counting_lines"].empty()) {
+		config.counting_lines = (std::string)fs["counting_lines"];
+	}
+	if (!fs["background_checkpoint"].empty()) {
+		config.background_checkpoint = (std::string)fs["background_checkpoint"];
+	}
+	if (!fs["checkpoint_interval"].empty()) {
+		config.checkpoint_interval = (int)fs["checkpoint_interval"];
+	}
+	if (!fs["blob_tracks"].empty()) {
+		config.blob_tracks = (int)fs["blob_tracks"] != 0;
+	}
+	if (!fs["relink_frames"].empty()) {
+		config.relink_frames = (int)fs["relink_frames"];
+	}
+	if (!fs["relink_distance"].empty()) {
+		config.relink_distance = (double)fs["relink_distance"];
+	}
+	if (!fs["yolo_tiled"].empty()) {
+		config.yolo_tiled = (int)fs["yolo_tiled"] != 0;
+	}
+	if (!fs["yolo_tile_batch"].empty()) {
+		config.yolo_tile_batch = std::max(1, (int)fs["yolo_tile_batch"]);
+	}
+	if (!fs["yolo_max_tiles"].empty()) {
+		config.yolo_max_tiles = (int)fs["yolo_max_tiles"];
+	}
+
+	return config;
+}
@@ -0,0 +1,160 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <ctime>
+
+#include "track_query.cpp"
+
+/**
+ * @brief Parse a polygon from a string with the format "x,y;x,y;x,y".
+ */
+QueryPolygon parsePolygon(std::string value) {
+	std::vector<QueryPoint> points;
+	std::stringstream ss(value);
+	std::string point;
+
+	while (getline(ss, point, ';')) {
+		QueryPoint p;
+		if (sscanf(point.c_str(), "%f,%f", &p.x, &p.y) == 2) {
+			points.push_back(p);
+		}
+	}
+
+	return QueryPolygon(points);
+}
+
+/**
+ * @brief Parse a time of day with the format "HH:MM" into milliseconds since midnight.
+ */
+int64_t parseTimeOfDay(std::string value) {
+	int hours = 0, minutes = 0;
+	sscanf(value.c_str(), "%d:%d", &hours, &minutes);
+	return ((int64_t)hours * 60 + minutes) * 60000;
+}
+
+/**
+ * @brief Parse the name of a category.
+ */
+int parseCategory(std::string value) {
+	if (value == "vehicle") {
+		return 1;
+	} else if (value == "pedestrian") {
+		return 2;
+	} else if (value == "unknown") {
+		return 0;
+	}
+
+	return std::stoi(value);
+}
+
+void usage() {
+	std::cout << "Usage: track-query <count|histogram|od> [OPTIONS] <TRACK_LOG>..." << std::endl;
+	std::cout << "  --start <MS>              Minimum timestamp (milliseconds)" << std::endl;
+	std::cout << "  --end <MS>                Maximum timestamp (milliseconds)" << std::endl;
+	std::cout << "  --from <HH:MM>            Start of the time of day window (local time)" << std::endl;
+	std::cout << "  --to <HH:MM>              End of the time of day window (local time)" << std::endl;
+	std::cout << "  --polygon <x,y;x,y;...>   Region of the image" << std::endl;
+	std::cout << "  --min-speed <KPH>         Minimum speed" << std::endl;
+	std::cout << "  --max-speed <KPH>         Maximum speed" << std::endl;
+	std::cout << "  --category <NAME>         vehicle, pedestrian or unknown" << std::endl;
+	std::cout << "  --camera <ID>             Camera identifier" << std::endl;
+	std::cout << "  --bin <KPH>               Histogram bin size" << std::endl;
+	std::cout << "  --zone <x,y;x,y;...>      Zone used for origin/destination (repeat for each zone)" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 3) {
+		usage();
+		return 1;
+	}
+
+	std::string command = argv[1];
+	TrackQuery query;
+	std::vector<QueryPolygon> zones;
+	std::vector<std::string> files;
+	float bin_size = 10.0;
+
+	// Offset of the local timezone
+	time_t now = time(nullptr);
+	struct tm local;
+	localtime_r(&now, &local);
+	query.timezone_offset = (int64_t)local.tm_gmtoff * 1000;
+
+	for (int i = 2; i < argc; i++) {
+		std::string arg = argv[i];
+		bool value = i + 1 < argc;
+
+		if (arg == "--start" && value) {
+			query.start = std::stoll(argv[++i]);
+		} else if (arg == "--end" && value) {
+			query.end = std::stoll(argv[++i]);
+		} else if (arg == "--from" && value) {
+			query.day_start = parseTimeOfDay(argv[++i]);
+		} else if (arg == "--to" && value) {
+			query.day_end = parseTimeOfDay(argv[++i]);
+		} else if (arg == "--polygon" && value) {
+			query.polygon = parsePolygon(argv[++i]);
+		} else if (arg == "--min-speed" && value) {
+			query.min_speed = std::stof(argv[++i]);
+		} else if (arg == "--max-speed" && value) {
+			query.max_speed = std::stof(argv[++i]);
+		} else if (arg == "--category" && value) {
+			query.category = parseCategory(argv[++i]);
+		} else if (arg == "--camera" && value) {
+			query.camera = std::stoll(argv[++i]);
+		} else if (arg == "--bin" && value) {
+			bin_size = std::stof(argv[++i]);
+		} else if (arg == "--zone" && value) {
+			zones.push_back(parsePolygon(argv[++i]));
+		} else if (arg.rfind("--", 0) == 0) {
+			usage();
+			return 1;
+		} else {
+			files.push_back(arg);
+		}
+	}
+
+	// Build index
+	auto start = std::chrono::steady_clock::now();
+
+	TrackIndex index;
+	for (std::string &fname : files) {
+		index.load(fname);
+	}
+
+	auto loaded = std::chrono::steady_clock::now();
+	std::cout << "Indexed " << index.size() << " records in " << index.chunks.size() << " chunks (" << std::chrono::duration_cast<std::chrono::milliseconds>(loaded - start).count() << " ms)" << std::endl;
+
+	// Run query
+	if (command == "count") {
+		CountResult result = index.count(query);
+		std::cout << "Tracks: " << result.tracks << std::endl;
+		std::cout << "Records: " << result.records << std::endl;
+		for (auto &category : result.categories) {
+			std::cout << "Category " << category.first << ": " << category.second << std::endl;
+		}
+	} else if (command == "histogram") {
+		HistogramResult result = index.speedHistogram(query, bin_size);
+		for (size_t i = 0; i < result.bins.size(); i++) {
+			std::cout << i * result.bin_size << " kph: " << result.bins[i] << std::endl;
+		}
+	} else if (command == "od") {
+		ODResult result = index.originDestination(query, zones);
+		for (size_t o = 0; o < result.zones; o++) {
+			for (size_t d = 0; d < result.zones; d++) {
+				std::cout << result.at(o, d) << (d + 1 < result.zones ? "\t" : "\n");
+			}
+		}
+	} else {
+		usage();
+		return 1;
+	}
+
+	auto finished = std::chrono::steady_clock::now();
+	std::cout << "Query time: " << std::chrono::duration_cast<std::chrono::microseconds>(finished - loaded).count() / 1000.0 << " ms" << std::endl;
+
+	return 0;
+}
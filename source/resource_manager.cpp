@@ -0,0 +1,347 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+
+#include <sched.h>
+#include <pthread.h>
+#include <dirent.h>
+
+#include <opencv2/core.hpp>
+
+#pragma once
+
+/**
+ * @brief CPUs assigned to a stream, all in the same NUMA node when possible.
+ */
+struct CpuSet {
+	std::vector<int> cpus;
+
+	/**
+	 * @brief NUMA node of the first CPU.
+	 */
+	int node = 0;
+
+	bool empty() const {
+		return this->cpus.empty();
+	}
+};
+
+/**
+ * @brief Divides the CPUs of the machine between streams and limits the concurrency of expensive stages.
+ *
+ * Each stream thread is pinned to its own cores, filling a NUMA node before using the next one, so memory allocated by the stream (first touch) stays local to its cores. The thread pool of OpenCV is shared by the whole process, it is sized once with setNumThreads() and defaults to a single thread so parallelism comes from the streams instead of every call competing for all the cores.
+ */
+class ResourceManager {
+	public:
+		/**
+		 * @brief CPUs of each NUMA node available to the process.
+		 */
+		std::vector<std::vector<int>> nodes;
+
+		/**
+		 * @brief Pin stream threads to their CPUs.
+		 */
+		bool pin = true;
+
+		/**
+		 * @brief Threads of the OpenCV pool (parallel_for used by the DNN, optical flow and background subtraction), 0 keeps the OpenCV default.
+		 */
+		int opencv_threads = 1;
+
+		/**
+		 * @brief Maximum number of DNN forward passes running at the same time, 0 for no limit.
+		 */
+		int dnn_slots = 0;
+
+		ResourceManager() {
+			this->detect();
+		}
+
+		/**
+		 * @brief Number of CPUs available to the process.
+		 */
+		int cores() const {
+			int count = 0;
+			for (const std::vector<int> &node : this->nodes) {
+				count += node.size();
+			}
+
+			return count;
+		}
+
+		/**
+		 * @brief Apply the process wide settings (OpenCV thread pool).
+		 */
+		void configure() {
+			if (this->opencv_threads > 0) {
+				cv::setNumThreads(this->opencv_threads);
+			}
+		}
+
+		/**
+		 * @brief Reserve CPUs for a stream, the least used CPUs of the least used node are selected.
+		 *
+		 * @param count Number of CPUs, spills into other nodes when larger than a node.
+		 * @return CpuSet CPUs reserved, must be returned with release().
+		 */
+		CpuSet acquire(int count) {
+			std::unique_lock<std::mutex> lock(this->mutex);
+
+			CpuSet set;
+			count = std::max(1, std::min(count, this->cores()));
+
+			// Nodes ordered by load, a stream stays in one node while it fits
+			std::vector<int> order(this->nodes.size());
+			for (size_t n = 0; n < order.size(); n++) {
+				order[n] = n;
+			}
+
+			std::stable_sort(order.begin(), order.end(), [this](int a, int b) {
+				return this->load(a) < this->load(b);
+			});
+
+			for (int n : order) {
+				std::vector<int> cpus = this->nodes[n];
+				std::stable_sort(cpus.begin(), cpus.end(), [this](int a, int b) {
+					return this->usage[a] < this->usage[b];
+				});
+
+				for (int cpu : cpus) {
+					if ((int)set.cpus.size() >= count) {
+						break;
+					}
+
+					if (set.cpus.empty()) {
+						set.node = n;
+					}
+
+					set.cpus.push_back(cpu);
+					this->usage[cpu]++;
+				}
+			}
+
+			return set;
+		}
+
+		/**
+		 * @brief Return the CPUs of a stream.
+		 */
+		void release(const CpuSet &set) {
+			std::unique_lock<std::mutex> lock(this->mutex);
+
+			for (int cpu : set.cpus) {
+				this->usage[cpu] = std::max(0, this->usage[cpu] - 1);
+			}
+		}
+
+		/**
+		 * @brief Pin the calling thread to a set of CPUs.
+		 *
+		 * @return True if the affinity was changed.
+		 */
+		bool bind(const CpuSet &set) {
+			if (!this->pin || set.empty()) {
+				return false;
+			}
+
+			cpu_set_t mask;
+			CPU_ZERO(&mask);
+			for (int cpu : set.cpus) {
+				CPU_SET(cpu, &mask);
+			}
+
+			if (pthread_setaffinity_np(pthread_self(), sizeof(mask), &mask) != 0) {
+				std::cout << "Error setting the CPU affinity" << std::endl;
+				return false;
+			}
+
+			return true;
+		}
+
+		/**
+		 * @brief Wait for a DNN slot, must be followed by endDNN(). DNNSlot pairs both calls.
+		 */
+		void beginDNN() {
+			if (this->dnn_slots <= 0) {
+				return;
+			}
+
+			std::unique_lock<std::mutex> lock(this->mutex);
+			this->condition.wait(lock, [this] {
+				return this->dnn_running < this->dnn_slots;
+			});
+			this->dnn_running++;
+		}
+
+		/**
+		 * @brief Free the DNN slot taken by beginDNN().
+		 */
+		void endDNN() {
+			if (this->dnn_slots <= 0) {
+				return;
+			}
+
+			std::unique_lock<std::mutex> lock(this->mutex);
+			this->dnn_running--;
+			this->condition.notify_one();
+		}
+
+		/**
+		 * @brief Describe the topology and settings.
+		 */
+		std::string toString() const {
+			std::stringstream ss;
+			ss << this->cores() << " CPUs in " << this->nodes.size() << " NUMA nodes, OpenCV threads " << this->opencv_threads;
+			if (this->dnn_slots > 0) {
+				ss << ", DNN slots " << this->dnn_slots;
+			}
+
+			return ss.str();
+		}
+
+		/**
+		 * @brief Parse a Linux CPU list (e.g. "0-3,8-11").
+		 */
+		static std::vector<int> parseCpuList(std::string list) {
+			std::vector<int> cpus;
+			std::stringstream ss(list);
+			std::string range;
+
+			while (std::getline(ss, range, ',')) {
+				if (range.empty() || range == "\n") {
+					continue;
+				}
+
+				size_t dash = range.find('-');
+				int first = std::stoi(range.substr(0, dash));
+				int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+
+				for (int cpu = first; cpu <= last; cpu++) {
+					cpus.push_back(cpu);
+				}
+			}
+
+			return cpus;
+		}
+
+	private:
+		std::mutex mutex;
+
+		std::condition_variable condition;
+
+		/**
+		 * @brief Number of streams using each CPU.
+		 */
+		std::vector<int> usage;
+
+		int dnn_running = 0;
+
+		/**
+		 * @brief Streams per CPU of a node.
+		 */
+		double load(int node) const {
+			int total = 0;
+			for (int cpu : this->nodes[node]) {
+				total += this->usage[cpu];
+			}
+
+			return (double)total / std::max<size_t>(1, this->nodes[node].size());
+		}
+
+		/**
+		 * @brief Read the NUMA nodes from sysfs, restricted to the CPUs the process is allowed to use.
+		 */
+		void detect() {
+			cpu_set_t allowed;
+			CPU_ZERO(&allowed);
+			if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+				for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+					CPU_SET(cpu, &allowed);
+				}
+			}
+
+			DIR *dir = opendir("/sys/devices/system/node");
+			if (dir != nullptr) {
+				std::vector<int> ids;
+				for (dirent *entry = readdir(dir); entry != nullptr; entry = readdir(dir)) {
+					std::string name = entry->d_name;
+					if (name.rfind("node", 0) == 0 && name.size() > 4 && name.find_first_not_of("0123456789", 4) == std::string::npos) {
+						ids.push_back(std::stoi(name.substr(4)));
+					}
+				}
+				closedir(dir);
+
+				std::sort(ids.begin(), ids.end());
+				for (int id : ids) {
+					std::ifstream file("/sys/devices/system/node/node" + std::to_string(id) + "/cpulist");
+					std::string list;
+					std::getline(file, list);
+
+					std::vector<int> cpus;
+					for (int cpu : parseCpuList(list)) {
+						if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed)) {
+							cpus.push_back(cpu);
+						}
+					}
+
+					if (!cpus.empty()) {
+						this->nodes.push_back(cpus);
+					}
+				}
+			}
+
+			// No NUMA information, a single node with the allowed CPUs
+			if (this->nodes.empty()) {
+				std::vector<int> cpus;
+				for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+					if (CPU_ISSET(cpu, &allowed)) {
+						cpus.push_back(cpu);
+					}
+				}
+				this->nodes.push_back(cpus);
+			}
+
+			int highest = 0;
+			for (const std::vector<int> &node : this->nodes) {
+				for (int cpu : node) {
+					highest = std::max(highest, cpu);
+				}
+			}
+			this->usage.assign(highest + 1, 0);
+		}
+};
+
+/**
+ * @brief DNN slot of a resource manager held for the lifetime of the object, freed even when the inference throws.
+ */
+class DNNSlot {
+	public:
+		/**
+		 * @brief Wait for a DNN slot.
+		 *
+		 * @param resources Resource manager, null when the passes are not limited.
+		 */
+		DNNSlot(ResourceManager *resources) {
+			this->resources = resources;
+			if (this->resources != nullptr) {
+				this->resources->beginDNN();
+			}
+		}
+
+		~DNNSlot() {
+			if (this->resources != nullptr) {
+				this->resources->endDNN();
+			}
+		}
+
+		DNNSlot(const DNNSlot &) = delete;
+		DNNSlot &operator=(const DNNSlot &) = delete;
+
+	private:
+		ResourceManager *resources;
+};
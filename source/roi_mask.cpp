@@ -0,0 +1,276 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstring>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#pragma once
+
+/**
+ * @brief Horizontal run of pixels inside the region of interest.
+ */
+struct RowSpan {
+	int row;
+
+	/**
+	 * @brief First column inside the span.
+	 */
+	int start;
+
+	/**
+	 * @brief Column after the last column inside the span.
+	 */
+	int end;
+};
+
+/**
+ * @brief Static region of interest of a camera (road and lanes), pixels outside of it are ignored by all the stages.
+ *
+ * The polygons are compiled into row spans for the frame size, so checking or clearing pixels does not need to test the polygons.
+ */
+class RoiMask {
+	public:
+		/**
+		 * @brief Polygons of the road (in frame coordinates).
+		 */
+		std::vector<std::vector<cv::Point>> regions;
+
+		/**
+		 * @brief Polygons of each lane (in frame coordinates), lanes are also part of the region of interest.
+		 */
+		std::vector<std::vector<cv::Point>> lanes;
+
+		/**
+		 * @brief Spans inside the region of interest sorted by row and column.
+		 */
+		std::vector<RowSpan> spans;
+
+		/**
+		 * @brief Bounding box of the region of interest, stages that can not skip individual pixels process this rectangle.
+		 */
+		cv::Rect bounds;
+
+		/**
+		 * @brief Size of the frame the spans were compiled for.
+		 */
+		cv::Size size;
+
+		/**
+		 * @brief Load the polygons from a YAML/XML file (cv::FileStorage).
+		 *
+		 * Each polygon is a flat list of coordinates, e.g. "roi: [ [ 0, 400, 1920, 400, 1920, 1080, 0, 1080 ] ]", lanes use the "lanes" key.
+		 *
+		 * @param fname Path of the mask file.
+		 * @return True if the file was loaded.
+		 */
+		bool load(std::string fname) {
+			cv::FileStorage fs(fname, cv::FileStorage::READ);
+			if (!fs.isOpened()) {
+				std::cout << "Error opening ROI mask " << fname << std::endl;
+				return false;
+			}
+
+			this->regions = readPolygons(fs["roi"]);
+			this->lanes = readPolygons(fs["lanes"]);
+			this->size = cv::Size();
+
+			return true;
+		}
+
+		/**
+		 * @brief Check if there are no polygons, the whole frame is processed.
+		 */
+		bool empty() const {
+			return this->regions.empty() && this->lanes.empty();
+		}
+
+		/**
+		 * @brief Check if the spans were compiled for a frame size.
+		 */
+		bool compiled(cv::Size size) const {
+			return this->size == size;
+		}
+
+		/**
+		 * @brief Rasterize the polygons into row spans for a frame size.
+		 *
+		 * @param size Size of the frames processed.
+		 * @return False if the polygons do not cover any pixel of the frame (configuration error).
+		 */
+		bool compile(cv::Size size) {
+			this->size = size;
+			this->spans.clear();
+			this->row_offsets.assign(size.height + 1, 0);
+
+			cv::Mat mask = cv::Mat::zeros(size, CV_8UC1);
+
+			// Fill each polygon separately so that overlapping polygons are joined
+			for (const std::vector<cv::Point> &polygon : this->regions) {
+				cv::fillPoly(mask, std::vector<std::vector<cv::Point>>{polygon}, cv::Scalar(255));
+			}
+			for (const std::vector<cv::Point> &polygon : this->lanes) {
+				cv::fillPoly(mask, std::vector<std::vector<cv::Point>>{polygon}, cv::Scalar(255));
+			}
+
+			for (int y = 0; y < size.height; y++) {
+				const uchar *row = mask.ptr<uchar>(y);
+				this->row_offsets[y] = this->spans.size();
+
+				int x = 0;
+				while (x < size.width) {
+					if (row[x] == 0) {
+						x++;
+						continue;
+					}
+
+					RowSpan span;
+					span.row = y;
+					span.start = x;
+					while (x < size.width && row[x] != 0) {
+						x++;
+					}
+					span.end = x;
+					this->spans.push_back(span);
+				}
+			}
+			this->row_offsets[size.height] = this->spans.size();
+
+			this->bounds = this->spans.empty() ? cv::Rect() : cv::boundingRect(mask);
+
+			if (this->spans.empty()) {
+				std::cout << "Error ROI mask does not cover any pixel of the " << size.width << "x" << size.height << " frame" << std::endl;
+				return false;
+			}
+
+			return true;
+		}
+
+		/**
+		 * @brief Fraction of the pixels of the frame inside the region of interest.
+		 */
+		double coverage() const {
+			if (this->size.area() == 0) {
+				return 1.0;
+			}
+
+			size_t pixels = 0;
+			for (const RowSpan &span : this->spans) {
+				pixels += span.end - span.start;
+			}
+
+			return (double)pixels / this->size.area();
+		}
+
+		/**
+		 * @brief Check if a point is inside the region of interest.
+		 */
+		bool contains(cv::Point point) const {
+			if (this->empty() || this->row_offsets.empty()) {
+				return true;
+			}
+
+			if (point.y < 0 || point.y >= this->size.height) {
+				return false;
+			}
+
+			for (size_t i = this->row_offsets[point.y]; i < this->row_offsets[point.y + 1]; i++) {
+				if (point.x >= this->spans[i].start && point.x < this->spans[i].end) {
+					return true;
+				}
+			}
+
+			return false;
+		}
+
+		/**
+		 * @brief Get the lane of a point.
+		 *
+		 * @return Index of the lane, -1 if the point is not inside any lane.
+		 */
+		int lane(cv::Point point) const {
+			for (size_t i = 0; i < this->lanes.size(); i++) {
+				if (cv::pointPolygonTest(this->lanes[i], point, false) >= 0) {
+					return i;
+				}
+			}
+
+			return -1;
+		}
+
+		/**
+		 * @brief Clear the pixels outside of the region of interest.
+		 *
+		 * @param image Single channel image of the frame size.
+		 */
+		void apply(cv::Mat &image) const {
+			if (this->empty() || !this->compiled(image.size())) {
+				return;
+			}
+
+			for (int y = 0; y < image.rows; y++) {
+				uchar *row = image.ptr<uchar>(y);
+
+				int x = 0;
+				for (size_t i = this->row_offsets[y]; i < this->row_offsets[y + 1]; i++) {
+					memset(row + x, 0, this->spans[i].start - x);
+					x = this->spans[i].end;
+				}
+				memset(row + x, 0, image.cols - x);
+			}
+		}
+
+		/**
+		 * @brief Get the part of the frame inside the bounds (without copying).
+		 *
+		 * @param frame Frame to crop, the whole frame is returned if there is no region of interest.
+		 */
+		cv::Mat crop(const cv::Mat &frame) const {
+			if (this->bounds.area() == 0) {
+				return frame;
+			}
+
+			return frame(this->bounds);
+		}
+
+		/**
+		 * @brief Offset of the crop in the frame.
+		 */
+		cv::Point offset() const {
+			if (this->bounds.area() == 0) {
+				return cv::Point(0, 0);
+			}
+
+			return this->bounds.tl();
+		}
+
+	private:
+		/**
+		 * @brief Index of the first span of each row (and the end of the spans).
+		 */
+		std::vector<size_t> row_offsets;
+
+		/**
+		 * @brief Read a list of polygons stored as flat coordinate lists.
+		 */
+		static std::vector<std::vector<cv::Point>> readPolygons(cv::FileNode list) {
+			std::vector<std::vector<cv::Point>> polygons;
+
+			for (cv::FileNode node : list) {
+				std::vector<int> coords;
+				node >> coords;
+
+				std::vector<cv::Point> polygon;
+				for (size_t i = 0; i + 1 < coords.size(); i += 2) {
+					polygon.push_back(cv::Point(coords[i], coords[i + 1]));
+				}
+
+				if (polygon.size() >= 3) {
+					polygons.push_back(polygon);
+				}
+			}
+
+			return polygons;
+		}
+};
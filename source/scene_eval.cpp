@@ -0,0 +1,324 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <algorithm>
+
+#include <opencv2/core.hpp>
+
+#include "monitor.cpp"
+#include "synthetic_scene.cpp"
+#include "segment_processor.cpp"
+
+/**
+ * @brief Position of a track reported by the monitor in a frame.
+ */
+struct TrackHypothesis {
+	int id;
+
+	cv::Point position;
+};
+
+/**
+ * @brief CLEAR MOT style accuracy of the tracks against the ground truth.
+ *
+ * A track matches an object when its position is inside the box of the object. Matches of the previous frame are kept while still valid, the remaining objects are matched to the closest free track. An identity switch is counted when an object is matched to a different track than the last time it was matched.
+ */
+class TrackingEvaluation {
+	public:
+		/**
+		 * @brief Number of ground truth objects over all frames.
+		 */
+		uint64_t objects = 0;
+
+		uint64_t matches = 0;
+
+		uint64_t misses = 0;
+
+		uint64_t false_positives = 0;
+
+		uint64_t id_switches = 0;
+
+		/**
+		 * @brief Sum of the distance between the matched tracks and the center of their objects (pixels).
+		 */
+		double distance = 0.0;
+
+		/**
+		 * @brief Evaluate the tracks of a frame.
+		 */
+		void add(const std::vector<GroundTruth> &truth, const std::vector<TrackHypothesis> &tracks) {
+			std::set<int> used;
+			std::vector<bool> matched(truth.size(), false);
+
+			// Keep the correspondences of the previous frame
+			for (size_t i = 0; i < truth.size(); i++) {
+				auto last = this->current.find(truth[i].id);
+				if (last == this->current.end()) {
+					continue;
+				}
+
+				for (const TrackHypothesis &track : tracks) {
+					if (track.id == last->second && used.count(track.id) == 0 && truth[i].box.contains(track.position)) {
+						this->match(truth[i], track);
+						used.insert(track.id);
+						matched[i] = true;
+						break;
+					}
+				}
+			}
+
+			// Closest free track for the remaining objects
+			for (size_t i = 0; i < truth.size(); i++) {
+				if (matched[i]) {
+					continue;
+				}
+
+				const TrackHypothesis *best = nullptr;
+				double best_distance = 0.0;
+				for (const TrackHypothesis &track : tracks) {
+					if (used.count(track.id) > 0 || !truth[i].box.contains(track.position)) {
+						continue;
+					}
+
+					double distance = cv::norm(track.position - center(truth[i].box));
+					if (best == nullptr || distance < best_distance) {
+						best = &track;
+						best_distance = distance;
+					}
+				}
+
+				if (best == nullptr) {
+					this->misses++;
+					continue;
+				}
+
+				auto last = this->current.find(truth[i].id);
+				if (last != this->current.end() && last->second != best->id) {
+					this->id_switches++;
+				}
+
+				this->match(truth[i], *best);
+				used.insert(best->id);
+			}
+
+			this->objects += truth.size();
+			this->false_positives += tracks.size() - used.size();
+		}
+
+		/**
+		 * @brief Multiple object tracking accuracy, 1 - (misses + false positives + identity switches) / objects.
+		 */
+		double mota() const {
+			if (this->objects == 0) {
+				return 0.0;
+			}
+
+			return 1.0 - (double)(this->misses + this->false_positives + this->id_switches) / this->objects;
+		}
+
+		/**
+		 * @brief Multiple object tracking precision, average distance of the matches (pixels).
+		 */
+		double motp() const {
+			return this->matches > 0 ? this->distance / this->matches : 0.0;
+		}
+
+	private:
+		/**
+		 * @brief Track last matched to each object.
+		 */
+		std::map<int, int> current;
+
+		static cv::Point center(const cv::Rect &box) {
+			return cv::Point(box.x + box.width / 2, box.y + box.height / 2);
+		}
+
+		void match(const GroundTruth &object, const TrackHypothesis &track) {
+			this->current[object.id] = track.id;
+			this->matches++;
+			this->distance += cv::norm(track.position - center(object.box));
+		}
+};
+
+void usage() {
+	std::cout << "Usage: scene-eval [OPTIONS]" << std::endl;
+	std::cout << "  --config <PATH>           Configuration of the monitor (YAML), detectors are disabled by default" << std::endl;
+	std::cout << "  --frames <N>              Number of frames evaluated (default 1800)" << std::endl;
+	std::cout << "  --seed <N>                Seed of the synthetic scene (default 1)" << std::endl;
+	std::cout << "  --export <VIDEO> <CSV>    Write the scene and its ground truth instead of evaluating" << std::endl;
+	std::cout << "  --min-mota <X>            Fail if the accuracy is lower" << std::endl;
+	std::cout << "  --max-id-switches <N>     Fail if there are more identity switches" << std::endl;
+	std::cout << "  --min-fps <X>             Fail if the throughput is lower" << std::endl;
+	std::cout << "  --offline-check <VIDEO>   Write the scene into a video and compare offline parallel processing with a sequential run" << std::endl;
+	std::cout << "  --threads <N>             Segments of the offline check (default 4)" << std::endl;
+	std::cout << "  --min-agreement <X>       Fail if less of the sequential track points are found in the stitched tracks (default 0.95)" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+	std::string config_file;
+	std::string export_video;
+	std::string export_truth;
+	int frames = 1800;
+	uint64_t seed = 1;
+	double min_mota = -INFINITY;
+	int64_t max_id_switches = -1;
+	double min_fps = 0.0;
+	std::string offline_check;
+	unsigned int threads = 4;
+	double min_agreement = 0.95;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		bool value = i + 1 < argc;
+
+		if (arg == "--config" && value) {
+			config_file = argv[++i];
+		} else if (arg == "--frames" && value) {
+			frames = std::stoi(argv[++i]);
+		} else if (arg == "--seed" && value) {
+			seed = std::stoull(argv[++i]);
+		} else if (arg == "--export" && i + 2 < argc) {
+			export_video = argv[++i];
+			export_truth = argv[++i];
+		} else if (arg == "--min-mota" && value) {
+			min_mota = std::stod(argv[++i]);
+		} else if (arg == "--max-id-switches" && value) {
+			max_id_switches = std::stoll(argv[++i]);
+		} else if (arg == "--min-fps" && value) {
+			min_fps = std::stod(argv[++i]);
+		} else if (arg == "--offline-check" && value) {
+			offline_check = argv[++i];
+		} else if (arg == "--threads" && value) {
+			threads = std::stoi(argv[++i]);
+		} else if (arg == "--min-agreement" && value) {
+			min_agreement = std::stod(argv[++i]);
+		} else {
+			usage();
+			return 1;
+		}
+	}
+
+	MonitorConfig config;
+	if (!config_file.empty()) {
+		config = MonitorConfig::load(config_file);
+	} else {
+		config.yolo_model = "";
+		config.haar_model = "";
+		config.skip_frames = 30;
+	}
+	config.debug = false;
+	config.blob_tracks = true;
+
+	// Background model learns the empty scene before objects appear
+	SyntheticScene scene(seed);
+	scene.quiet_frames = config.skip_frames + 90;
+
+	if (!export_video.empty()) {
+		return scene.write(export_video, export_truth, scene.quiet_frames + frames) ? 0 : 1;
+	}
+
+	// Stitched tracks of parallel segments must match a sequential run of the same video
+	if (!offline_check.empty()) {
+		if (!scene.write(offline_check, offline_check + ".csv", scene.quiet_frames + frames)) {
+			return 1;
+		}
+
+		SegmentProcessor processor;
+		processor.config = config;
+
+		processor.threads = 1;
+		std::vector<SegmentTrack> sequential = processor.process(offline_check);
+
+		processor.threads = std::max(1u, threads);
+		std::vector<SegmentTrack> parallel = processor.process(offline_check);
+
+		SegmentComparison comparison = SegmentProcessor::compare(sequential, parallel, processor.match_distance, processor.min_matches);
+
+		std::cout << std::fixed << std::setprecision(3);
+		std::cout << "Tracks:          " << comparison.sequential_tracks << " sequential, " << comparison.parallel_tracks << " parallel (" << processor.threads << " segments max)" << std::endl;
+		std::cout << "Points matched:  " << comparison.matched << " / " << comparison.points << std::endl;
+		std::cout << "Fragmented:      " << comparison.fragmented << std::endl;
+		std::cout << "Agreement:       " << comparison.agreement() << std::endl;
+
+		if (comparison.agreement() < min_agreement) {
+			std::cout << "Agreement below " << min_agreement << std::endl;
+			return 1;
+		}
+
+		return 0;
+	}
+
+	Monitor monitor(config);
+
+	std::vector<TrackHypothesis> tracks;
+	monitor.track_callback = [&](StreetObject &obj, bool lost) {
+		if (!lost) {
+			tracks.push_back({obj.id, obj.position()});
+		}
+	};
+
+	TrackingEvaluation evaluation;
+	std::vector<double> latencies;
+	std::vector<GroundTruth> truth;
+	cv::Mat frame;
+
+	for (int i = 0; i < scene.quiet_frames + frames; i++) {
+		int64_t timestamp = scene.timestamp();
+		scene.next(frame, truth);
+
+		tracks.clear();
+
+		double start = StageScheduler::now();
+		monitor.processFrame(&frame, timestamp);
+		double elapsed = StageScheduler::now() - start;
+
+		if (i < scene.quiet_frames) {
+			continue;
+		}
+
+		latencies.push_back(elapsed);
+		evaluation.add(truth, tracks);
+	}
+
+	double total = 0.0;
+	for (double latency : latencies) {
+		total += latency;
+	}
+
+	std::sort(latencies.begin(), latencies.end());
+	double mean = latencies.empty() ? 0.0 : total / latencies.size();
+	double p95 = latencies.empty() ? 0.0 : latencies[std::min(latencies.size() - 1, (size_t)(latencies.size() * 0.95))];
+	double fps = total > 0.0 ? latencies.size() * 1000.0 / total : 0.0;
+
+	std::cout << std::fixed << std::setprecision(3);
+	std::cout << "Frames:          " << latencies.size() << " (seed " << seed << ")" << std::endl;
+	std::cout << "Objects:         " << evaluation.objects << std::endl;
+	std::cout << "Matches:         " << evaluation.matches << std::endl;
+	std::cout << "Misses:          " << evaluation.misses << std::endl;
+	std::cout << "False positives: " << evaluation.false_positives << std::endl;
+	std::cout << "ID switches:     " << evaluation.id_switches << std::endl;
+	std::cout << "MOTA:            " << evaluation.mota() << std::endl;
+	std::cout << "MOTP (px):       " << evaluation.motp() << std::endl;
+	std::cout << "Latency (ms):    mean " << mean << ", p95 " << p95 << std::endl;
+	std::cout << "Throughput:      " << fps << " fps" << std::endl;
+
+	bool failed = false;
+	if (evaluation.mota() < min_mota) {
+		std::cout << "MOTA below " << min_mota << std::endl;
+		failed = true;
+	}
+	if (max_id_switches >= 0 && (int64_t)evaluation.id_switches > max_id_switches) {
+		std::cout << "More than " << max_id_switches << " identity switches" << std::endl;
+		failed = true;
+	}
+	if (fps < min_fps) {
+		std::cout << "Throughput below " << min_fps << " fps" << std::endl;
+		failed = true;
+	}
+
+	return failed ? 1 : 0;
+}
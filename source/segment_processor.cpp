@@ -0,0 +1,470 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <future>
+#include <thread>
+#include <algorithm>
+#include <cstring>
+
+#include <opencv2/core.hpp>
+#include <opencv2/videoio.hpp>
+
+#include "monitor.cpp"
+#include "track_log.cpp"
+
+#pragma once
+
+/**
+ * @brief State of a track in one frame.
+ */
+struct TrackPoint {
+	int frame;
+	int64_t timestamp;
+	cv::Point position;
+	cv::Rect box;
+	float speed;
+};
+
+/**
+ * @brief Track produced by offline processing.
+ */
+struct SegmentTrack {
+	int id;
+	Category category;
+	std::vector<TrackPoint> points;
+
+	/**
+	 * @brief Get the point of the track in a frame.
+	 *
+	 * @return Pointer to the point, null if the track was not seen in that frame.
+	 */
+	const TrackPoint *at(int frame) const {
+		auto it = std::lower_bound(this->points.begin(), this->points.end(), frame, [](const TrackPoint &p, int f) {
+			return p.frame < f;
+		});
+
+		if (it == this->points.end() || it->frame != frame) {
+			return nullptr;
+		}
+
+		return &(*it);
+	}
+};
+
+/**
+ * @brief Agreement between the tracks of a sequential run and the stitched tracks of a parallel run of the same video.
+ */
+struct SegmentComparison {
+	size_t sequential_tracks = 0;
+	size_t parallel_tracks = 0;
+
+	/**
+	 * @brief Points of the sequential tracks.
+	 */
+	size_t points = 0;
+
+	/**
+	 * @brief Points of the sequential tracks found in the same frame and position in the parallel track that matches each of them.
+	 */
+	size_t matched = 0;
+
+	/**
+	 * @brief Sequential tracks split across several parallel tracks (stitching failed).
+	 */
+	size_t fragmented = 0;
+
+	double agreement() const {
+		return this->points > 0 ? (double)this->matched / this->points : 1.0;
+	}
+};
+
+/**
+ * @brief Processes a video file offline by splitting it in segments processed concurrently.
+ *
+ * Each segment starts with a warm-up window before its first frame (to learn the background and pick up tracks already in the scene) and continues for an overlap window after its last frame. Tracks crossing the boundary are stitched by comparing their positions in the overlap window.
+ */
+class SegmentProcessor {
+	public:
+		/**
+		 * @brief Configuration of the monitors used for each segment, debug windows are always disabled.
+		 */
+		MonitorConfig config;
+
+		/**
+		 * @brief Number of segments processed at the same time.
+		 */
+		unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+
+		/**
+		 * @brief Assigns CPUs to each segment, optional.
+		 */
+		ResourceManager *resources = nullptr;
+
+		/**
+		 * @brief Number of frames processed before the start of a segment, should cover the background subtractor history.
+		 */
+		int warmup_frames = 300;
+
+		/**
+		 * @brief Number of frames processed after the end of a segment, used to stitch tracks with the next segment.
+		 */
+		int overlap_frames = 30;
+
+		/**
+		 * @brief Detection runs every n frames (aligned to the frame number) so that all segments detect in the same frames as a sequential run.
+		 */
+		int detection_interval = 30;
+
+		/**
+		 * @brief Maximum mean distance (pixels) between two tracks in the overlap window to be stitched.
+		 */
+		float match_distance = 10.0;
+
+		/**
+		 * @brief Minimum number of frames seen by both tracks in the overlap window to be stitched.
+		 */
+		int min_matches = 3;
+
+		/**
+		 * @brief Process a video file.
+		 *
+		 * @param fname Path of the video file.
+		 * @return std::vector<SegmentTrack> Tracks found in the video, numbered sequentially.
+		 */
+		std::vector<SegmentTrack> process(std::string fname) {
+			std::vector<SegmentTrack> tracks;
+
+			cv::VideoCapture cap(fname);
+			if (!cap.isOpened()) {
+				std::cout << "Error opening video stream or file" << std::endl;
+				return tracks;
+			}
+
+			int total = cap.get(cv::CAP_PROP_FRAME_COUNT);
+			cap.release();
+
+			// Split the video in one segment per thread
+			int count = std::max(1, std::min((int)this->threads, total / std::max(1, this->warmup_frames + this->overlap_frames)));
+			int length = (total + count - 1) / count;
+
+			std::vector<std::future<std::vector<SegmentTrack>>> futures;
+			for (int s = 0; s < count; s++) {
+				int begin = s * length;
+				int end = std::min(total, begin + length);
+				bool last = s == count - 1;
+
+				futures.push_back(std::async(std::launch::async, [this, fname, begin, end, last, count]() {
+					// Segment thread runs on its share of the cores
+					CpuSet cpus;
+					if (this->resources != nullptr) {
+						cpus = this->resources->acquire(this->resources->cores() / count);
+						this->resources->bind(cpus);
+					}
+
+					std::vector<SegmentTrack> tracks = this->processSegment(fname, begin, last ? INT32_MAX : end);
+
+					if (this->resources != nullptr) {
+						this->resources->release(cpus);
+					}
+
+					return tracks;
+				}));
+			}
+
+			std::vector<std::vector<SegmentTrack>> segments;
+			for (auto &future : futures) {
+				segments.push_back(future.get());
+			}
+
+			// Stitch tracks at the boundaries
+			std::vector<int> boundaries;
+			for (int s = 1; s < count; s++) {
+				boundaries.push_back(s * length);
+			}
+
+			tracks = this->stitch(segments, boundaries);
+
+			// Renumber tracks in order of appearance
+			std::sort(tracks.begin(), tracks.end(), [](const SegmentTrack &a, const SegmentTrack &b) {
+				return a.points.front().frame < b.points.front().frame;
+			});
+
+			for (size_t i = 0; i < tracks.size(); i++) {
+				tracks[i].id = i;
+			}
+
+			return tracks;
+		}
+
+		/**
+		 * @brief Compare the tracks of a parallel run with the tracks of a sequential run (threads = 1) of the same video.
+		 *
+		 * Each sequential track is matched to the parallel track that shares most of its points (same frame, within distance pixels).
+		 *
+		 * @param sequential Tracks of the sequential run.
+		 * @param parallel Tracks of the parallel run.
+		 * @param distance Maximum distance between two points considered the same (pixels).
+		 * @param min_matches Minimum number of common points for a parallel track to be counted as a fragment.
+		 */
+		static SegmentComparison compare(const std::vector<SegmentTrack> &sequential, const std::vector<SegmentTrack> &parallel, float distance = 10.0, int min_matches = 3) {
+			SegmentComparison comparison;
+			comparison.sequential_tracks = sequential.size();
+			comparison.parallel_tracks = parallel.size();
+
+			// Points of the parallel tracks in each frame
+			std::map<int, std::vector<std::pair<size_t, cv::Point>>> frames;
+			for (size_t t = 0; t < parallel.size(); t++) {
+				for (const TrackPoint &point : parallel[t].points) {
+					frames[point.frame].push_back(std::make_pair(t, point.position));
+				}
+			}
+
+			for (const SegmentTrack &track : sequential) {
+				std::map<size_t, int> votes;
+
+				for (const TrackPoint &point : track.points) {
+					comparison.points++;
+
+					auto frame = frames.find(point.frame);
+					if (frame == frames.end()) {
+						continue;
+					}
+
+					// Closest parallel point in the same frame
+					int best = -1;
+					float best_distance = distance;
+					for (auto &candidate : frame->second) {
+						float d = ::distance(point.position, candidate.second);
+						if (d <= best_distance) {
+							best = candidate.first;
+							best_distance = d;
+						}
+					}
+
+					if (best >= 0) {
+						votes[best]++;
+					}
+				}
+
+				int most = 0, fragments = 0;
+				for (auto &vote : votes) {
+					most = std::max(most, vote.second);
+					if (vote.second >= min_matches) {
+						fragments++;
+					}
+				}
+
+				comparison.matched += most;
+				if (fragments > 1) {
+					comparison.fragmented++;
+				}
+			}
+
+			return comparison;
+		}
+
+		/**
+		 * @brief Write tracks into a track log sorted by time.
+		 *
+		 * @param tracks Tracks to be written.
+		 * @param log Log where the records are appended.
+		 */
+		static void write(const std::vector<SegmentTrack> &tracks, TrackLogWriter *log) {
+			std::vector<TrackRecord> records;
+
+			for (const SegmentTrack &track : tracks) {
+				for (const TrackPoint &point : track.points) {
+					TrackRecord record;
+					memset(&record, 0, sizeof(record));
+					record.timestamp = point.timestamp;
+					record.frame = point.frame;
+					record.id = track.id;
+					record.category = track.category;
+					record.x = point.position.x;
+					record.y = point.position.y;
+					record.box_x = point.box.x;
+					record.box_y = point.box.y;
+					record.box_width = point.box.width;
+					record.box_height = point.box.height;
+					record.speed = point.speed;
+					records.push_back(record);
+				}
+			}
+
+			std::stable_sort(records.begin(), records.end(), [](const TrackRecord &a, const TrackRecord &b) {
+				return a.frame < b.frame;
+			});
+
+			for (const TrackRecord &record : records) {
+				log->append(record);
+			}
+		}
+
+	private:
+		/**
+		 * @brief Process a segment of the video.
+		 *
+		 * @param fname Path of the video file.
+		 * @param begin First frame of the segment.
+		 * @param end Frame after the last frame of the segment.
+		 * @return std::vector<SegmentTrack> Tracks with points from the start of the segment until the end of the overlap window.
+		 */
+		std::vector<SegmentTrack> processSegment(std::string fname, int begin, int end) {
+			std::map<int, SegmentTrack> tracks;
+
+			cv::VideoCapture cap(fname);
+			if (!cap.isOpened()) {
+				return {};
+			}
+
+			MonitorConfig config = this->config;
+			config.debug = false;
+
+			// Segments run in parallel and would overwrite each other's checkpoint
+			config.background_checkpoint = "";
+
+			Monitor monitor(config);
+			monitor.resources = this->resources;
+			monitor.scheduler.fixed_interval = this->detection_interval;
+
+			// First segment starts like a sequential run, others start the warm-up before the segment
+			int start = begin == 0 ? 0 : std::max(config.skip_frames, begin - this->warmup_frames);
+			if (start > 0) {
+				cap.set(cv::CAP_PROP_POS_FRAMES, start);
+				monitor.skip_frames = start;
+				monitor.frame_count = start;
+			}
+
+			int limit = end == INT32_MAX ? INT32_MAX : end + this->overlap_frames;
+
+			monitor.track_callback = [&](StreetObject &obj, bool lost) {
+				if (lost || monitor.frame_count < begin) {
+					return;
+				}
+
+				SegmentTrack &track = tracks[obj.id];
+				track.id = obj.id;
+				track.category = obj.category;
+
+				TrackPoint point;
+				point.frame = monitor.frame_count;
+				point.timestamp = monitor.timestamp;
+				point.position = obj.position();
+				point.box = obj.boudingBox();
+				point.speed = obj.speed;
+				track.points.push_back(point);
+			};
+
+			cv::Mat frame;
+			while (monitor.frame_count < limit && cap.read(frame) && !frame.empty()) {
+				monitor.processFrame(&frame, cap.get(cv::CAP_PROP_POS_MSEC));
+			}
+
+			cap.release();
+
+			std::vector<SegmentTrack> result;
+			for (auto &entry : tracks) {
+				result.push_back(entry.second);
+			}
+
+			return result;
+		}
+
+		/**
+		 * @brief Join tracks of consecutive segments.
+		 *
+		 * Tracks of a segment are cut at the boundary, a track is continued by the track of the next segment closest to it in the overlap window.
+		 *
+		 * @param segments Tracks of each segment.
+		 * @param boundaries First frame of each segment after the first.
+		 */
+		std::vector<SegmentTrack> stitch(std::vector<std::vector<SegmentTrack>> &segments, std::vector<int> &boundaries) {
+			std::vector<SegmentTrack> done;
+
+			// Tracks that are still open at the end of the segment being stitched
+			std::vector<SegmentTrack> open = segments[0];
+
+			for (size_t s = 0; s < boundaries.size(); s++) {
+				int boundary = boundaries[s];
+				std::vector<SegmentTrack> &next = segments[s + 1];
+				std::vector<bool> used(next.size(), false);
+
+				for (SegmentTrack &track : open) {
+					// Find the best match in the next segment
+					int best = -1;
+					float best_distance = this->match_distance;
+
+					if (track.points.back().frame >= boundary) {
+						for (size_t n = 0; n < next.size(); n++) {
+							if (used[n]) {
+								continue;
+							}
+
+							float distance = this->overlapDistance(track, next[n], boundary);
+							if (distance < best_distance) {
+								best_distance = distance;
+								best = n;
+							}
+						}
+					}
+
+					// Cut the track at the boundary (the next segment owns the frames after it)
+					SegmentTrack cut = track;
+					cut.points.erase(std::remove_if(cut.points.begin(), cut.points.end(), [boundary](const TrackPoint &p) {
+						return p.frame >= boundary;
+					}), cut.points.end());
+
+					if (best >= 0) {
+						used[best] = true;
+
+						// Continue with the points of the next segment
+						next[best].points.insert(next[best].points.begin(), cut.points.begin(), cut.points.end());
+						if (next[best].category == unknown) {
+							next[best].category = cut.category;
+						}
+					} else if (!cut.points.empty()) {
+						done.push_back(cut);
+					}
+				}
+
+				open = next;
+			}
+
+			for (SegmentTrack &track : open) {
+				if (!track.points.empty()) {
+					done.push_back(track);
+				}
+			}
+
+			return done;
+		}
+
+		/**
+		 * @brief Mean distance between two tracks in the frames after the boundary seen by both.
+		 *
+		 * @return Mean distance in pixels, infinity if there are not enough common frames.
+		 */
+		float overlapDistance(const SegmentTrack &a, const SegmentTrack &b, int boundary) {
+			float sum = 0.0;
+			int matches = 0;
+
+			for (const TrackPoint &point : a.points) {
+				if (point.frame < boundary || point.frame >= boundary + this->overlap_frames) {
+					continue;
+				}
+
+				const TrackPoint *other = b.at(point.frame);
+				if (other != nullptr) {
+					sum += distance(point.position, other->position);
+					matches++;
+				}
+			}
+
+			if (matches < this->min_matches) {
+				return INFINITY;
+			}
+
+			return sum / matches;
+		}
+};
@@ -0,0 +1,223 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "monitor.cpp"
+#include "synthetic_scene.cpp"
+#include "allocation_hooks.cpp"
+
+/**
+ * @brief Measurements of a number of consecutive frames.
+ */
+struct SoakWindow {
+	uint64_t frames = 0;
+
+	/**
+	 * @brief Allocations made by the monitor while processing the frames.
+	 */
+	AllocationStats allocations;
+
+	/**
+	 * @brief Resident memory of the process at the end of the window (bytes).
+	 */
+	size_t resident = 0;
+
+	/**
+	 * @brief Processing time of the frames (ms).
+	 */
+	double elapsed = 0.0;
+
+	double allocationsPerFrame() const {
+		return this->frames > 0 ? (double)this->allocations.count / this->frames : 0.0;
+	}
+};
+
+void usage() {
+	std::cout << "Usage: soak-test [OPTIONS] [VIDEO_PATH|IMAGE_DIRECTORY]" << std::endl;
+	std::cout << "  Replays a clip in a loop (a synthetic scene without clip) and fails if memory or allocations per frame grow." << std::endl;
+	std::cout << "  --config <PATH>           Configuration of the monitor (YAML)" << std::endl;
+	std::cout << "  --duration <MINUTES>      Time to run (default 60)" << std::endl;
+	std::cout << "  --frames <N>              Maximum number of frames, 0 for no limit (default 0)" << std::endl;
+	std::cout << "  --warmup <N>              Frames processed before measuring (default 900)" << std::endl;
+	std::cout << "  --window <N>              Frames of each measurement window (default 1800)" << std::endl;
+	std::cout << "  --max-rss-growth <MB>     Growth of resident memory allowed from the first window (default 16)" << std::endl;
+	std::cout << "  --tolerance <X>           Growth of allocations per frame allowed from the first window (default 0.1)" << std::endl;
+	std::cout << "  --max-allocations <N>     Fail if the last window allocates more per frame" << std::endl;
+	std::cout << "  --seed <N>                Seed of the synthetic scene (default 1)" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+	std::string config_file;
+	std::string clip;
+	double duration = 60.0;
+	uint64_t max_frames = 0;
+	uint64_t warmup = 900;
+	uint64_t window_size = 1800;
+	double max_rss_growth = 16.0;
+	double tolerance = 0.1;
+	double max_allocations = -1.0;
+	uint64_t seed = 1;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		bool value = i + 1 < argc;
+
+		if (arg == "--config" && value) {
+			config_file = argv[++i];
+		} else if (arg == "--duration" && value) {
+			duration = std::stod(argv[++i]);
+		} else if (arg == "--frames" && value) {
+			max_frames = std::stoull(argv[++i]);
+		} else if (arg == "--warmup" && value) {
+			warmup = std::stoull(argv[++i]);
+		} else if (arg == "--window" && value) {
+			window_size = std::max<uint64_t>(1, std::stoull(argv[++i]));
+		} else if (arg == "--max-rss-growth" && value) {
+			max_rss_growth = std::stod(argv[++i]);
+		} else if (arg == "--tolerance" && value) {
+			tolerance = std::stod(argv[++i]);
+		} else if (arg == "--max-allocations" && value) {
+			max_allocations = std::stod(argv[++i]);
+		} else if (arg == "--seed" && value) {
+			seed = std::stoull(argv[++i]);
+		} else if (arg.rfind("--", 0) == 0 || !clip.empty()) {
+			usage();
+			return 1;
+		} else {
+			clip = arg;
+		}
+	}
+
+	// Single OpenCV thread, all the work of the monitor is counted in this thread
+	ResourceManager resources;
+	resources.opencv_threads = 1;
+	resources.configure();
+
+	AllocationTracker::install();
+
+	MonitorConfig config;
+	if (!config_file.empty()) {
+		config = MonitorConfig::load(config_file);
+	} else if (clip.empty()) {
+		config.yolo_model = "";
+		config.haar_model = "";
+		config.skip_frames = 30;
+		config.blob_tracks = true;
+	}
+	config.debug = false;
+
+	Monitor monitor(config);
+
+	SyntheticScene scene(seed);
+	FrameSource *source = nullptr;
+	double fps = scene.fps;
+
+	if (!clip.empty()) {
+		source = FrameSource::open(clip);
+		if (source == nullptr) {
+			return 1;
+		}
+
+		if (source->fps() > 0) {
+			fps = source->fps();
+		}
+	}
+
+	std::vector<SoakWindow> windows;
+	SoakWindow window;
+	std::vector<GroundTruth> truth;
+	cv::Mat frame;
+	uint64_t index = 0;
+	int loops = 0;
+	double start = StageScheduler::now();
+
+	std::cout << std::fixed << std::setprecision(2);
+
+	while ((max_frames == 0 || index < max_frames) && StageScheduler::now() - start < duration * 60000.0) {
+		if (source != nullptr) {
+			int64_t position;
+			if (!source->read(frame, position)) {
+				// Start the clip again
+				delete source;
+				source = FrameSource::open(clip);
+				loops++;
+
+				if (source == nullptr || !source->read(frame, position)) {
+					std::cout << "Error replaying " << clip << std::endl;
+					return 1;
+				}
+			}
+		} else {
+			scene.next(frame, truth);
+		}
+
+		// Timestamps keep increasing when the clip starts again
+		int64_t timestamp = std::round(index * 1000.0 / fps);
+
+		double frame_start = StageScheduler::now();
+		AllocationStats allocations = AllocationTracker::thread();
+		monitor.processFrame(&frame, timestamp);
+		window.allocations += AllocationTracker::thread() - allocations;
+		window.elapsed += StageScheduler::now() - frame_start;
+		window.frames++;
+		index++;
+
+		if (index == warmup) {
+			window = SoakWindow();
+			continue;
+		}
+
+		if (index > warmup && window.frames == window_size) {
+			window.resident = AllocationTracker::residentMemory();
+			windows.push_back(window);
+
+			std::cout << "Window " << windows.size() << ": rss " << window.resident / 1048576.0 << " MB, allocations/frame " << window.allocationsPerFrame() << ", bytes/frame " << (double)window.allocations.bytes / window.frames << ", " << window.frames * 1000.0 / std::max(window.elapsed, 1.0) << " fps" << std::endl;
+
+			window = SoakWindow();
+		}
+	}
+
+	delete source;
+
+	std::cout << "Frames:          " << index << " (" << loops << " replays)" << std::endl;
+	std::cout << "Metrics:         " << monitor.metrics.toString() << std::endl;
+
+	static const char *stage_names[stage_count] = {"yolo", "haar", "flow", "render"};
+	std::cout << "Allocations:     core " << monitor.metrics.core_allocations.count << " (" << monitor.metrics.core_allocations.bytes << "B)";
+	for (int stage = 0; stage < stage_count; stage++) {
+		std::cout << ", " << stage_names[stage] << " " << monitor.metrics.stage_allocations[stage].count << " (" << monitor.metrics.stage_allocations[stage].bytes << "B)";
+	}
+	std::cout << std::endl;
+
+	if (windows.size() < 2) {
+		std::cout << "Not enough frames for two measurement windows" << std::endl;
+		return 1;
+	}
+
+	const SoakWindow &first = windows.front();
+	const SoakWindow &last = windows.back();
+	double growth = ((double)last.resident - (double)first.resident) / 1048576.0;
+
+	std::cout << "RSS growth:      " << growth << " MB" << std::endl;
+	std::cout << "Allocations:     " << first.allocationsPerFrame() << " -> " << last.allocationsPerFrame() << " per frame" << std::endl;
+
+	bool failed = false;
+	if (growth > max_rss_growth) {
+		std::cout << "Resident memory grew more than " << max_rss_growth << " MB" << std::endl;
+		failed = true;
+	}
+	if (last.allocationsPerFrame() > first.allocationsPerFrame() * (1.0 + tolerance) + 1.0) {
+		std::cout << "Allocations per frame went up" << std::endl;
+		failed = true;
+	}
+	if (max_allocations >= 0.0 && last.allocationsPerFrame() > max_allocations) {
+		std::cout << "More than " << max_allocations << " allocations per frame" << std::endl;
+		failed = true;
+	}
+
+	return failed ? 1 : 0;
+}
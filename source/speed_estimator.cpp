@@ -0,0 +1,125 @@
+#include <vector>
+#include <cstdint>
+#include <math.h>
+
+#include <opencv2/core.hpp>
+
+#include "calibration.cpp"
+#include "street_object.cpp"
+
+#pragma once
+
+/**
+ * @brief Estimates the speed of all the objects updated in a frame in a single pass.
+ *
+ * The displacement of each object is measured over a time window of its trajectory using the real timestamps of the frames. With a calibration the end points of all objects are projected to the road plane in one batched transform and the speed is metric, otherwise the uncalibrated image heuristic of StreetObject is used. The result is smoothed and stored in the object.
+ */
+class SpeedEstimator {
+	public:
+		/**
+		 * @brief Calibration of the camera, speeds are metric when it is not empty.
+		 */
+		Calibration calibration;
+
+		/**
+		 * @brief Time window of the trajectory used to measure the displacement (ms), the trajectories keep enough exact points to cover it.
+		 */
+		int64_t window = 500;
+
+		/**
+		 * @brief Minimum time covered by the trajectory to estimate the speed (ms).
+		 */
+		int64_t min_elapsed = 100;
+
+		/**
+		 * @brief Weight of the new measurement in the exponential smoothing of the speed (0 to 1).
+		 */
+		float smoothing = 0.3;
+
+		/**
+		 * @brief Update the speed of the objects updated in this frame.
+		 *
+		 * @param objects Objects visible in the scene.
+		 * @param frame Frame number, only objects updated in this frame are estimated.
+		 */
+		void update(std::vector<StreetObject> &objects, int frame) {
+			this->image_points.clear();
+			this->elapsed.clear();
+			this->indices.clear();
+
+			for (size_t i = 0; i < objects.size(); i++) {
+				StreetObject &obj = objects[i];
+				obj.trajectory.span = this->window;
+
+				size_t available = obj.trajectory.recent();
+				if (obj.frame != frame || available < 2) {
+					continue;
+				}
+
+				// Oldest exact point of the trajectory inside the time window
+				const TrajectoryPoint &last = obj.trajectory.point(0);
+				size_t age = 0;
+				while (age + 1 < available && last.timestamp - obj.trajectory.point(age + 1).timestamp <= this->window) {
+					age++;
+				}
+
+				const TrajectoryPoint &first = obj.trajectory.point(age);
+				int64_t elapsed = last.timestamp - first.timestamp;
+				if (elapsed < this->min_elapsed) {
+					continue;
+				}
+
+				if (this->calibration.empty()) {
+					this->smooth(obj, obj.estimateSpeed());
+					continue;
+				}
+
+				this->image_points.push_back(cv::Point2f(first.x, first.y));
+				this->image_points.push_back(cv::Point2f(last.x, last.y));
+				this->elapsed.push_back(elapsed);
+				this->indices.push_back(i);
+			}
+
+			if (this->indices.empty()) {
+				return;
+			}
+
+			// Project the end points of all the objects at once
+			this->calibration.project(this->image_points, this->road_points);
+
+			for (size_t j = 0; j < this->indices.size(); j++) {
+				cv::Point2f displacement = this->road_points[2 * j + 1] - this->road_points[2 * j];
+				float meters = sqrt(displacement.x * displacement.x + displacement.y * displacement.y);
+
+				// m/ms to kph
+				float speed = meters / this->elapsed[j] * 3600.0;
+
+				this->smooth(objects[this->indices[j]], speed);
+			}
+		}
+
+	private:
+		/**
+		 * @brief Buffers reused between frames.
+		 */
+		std::vector<cv::Point2f> image_points;
+
+		std::vector<cv::Point2f> road_points;
+
+		std::vector<int64_t> elapsed;
+
+		std::vector<size_t> indices;
+
+		/**
+		 * @brief Apply exponential smoothing to the speed of an object.
+		 */
+		void smooth(StreetObject &obj, float speed) {
+			if (obj.speed <= 0.0) {
+				obj.speed = speed;
+			} else {
+				obj.speed += this->smoothing * (speed - obj.speed);
+			}
+
+			obj.max_speed = std::max(obj.max_speed, obj.speed);
+		}
+};
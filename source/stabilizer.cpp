@@ -0,0 +1,242 @@
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <math.h>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/highgui.hpp>
+#include <opencv2/features2d.hpp>
+#include <opencv2/video.hpp>
+#include <opencv2/calib3d.hpp>
+
+#pragma once
+
+/**
+ * @brief Global motion compensation used to remove camera shake before background subtraction.
+ *
+ * A similarity transform is estimated between consecutive frames from a small set of features tracked on a downscaled grayscale copy of the frame.
+ *
+ * The transforms are accumulated and warped out of the frame, the accumulated correction decays towards identity so that slow pans are still followed.
+ */
+class Stabilizer {
+	public:
+		/**
+		 * @brief Flag to display debug information.
+		 */
+		bool debug = false;
+
+		/**
+		 * @brief Scale applied to the frame before estimating motion, features are only tracked in the downscaled image.
+		 */
+		double scale = 0.25;
+
+		/**
+		 * @brief Maximum number of features tracked between frames.
+		 */
+		int max_features = 150;
+
+		/**
+		 * @brief Minimum number of tracked features required to estimate a transform, features are detected again when below this value.
+		 */
+		int min_features = 30;
+
+		/**
+		 * @brief Number of frames between feature detection, in between features are only tracked.
+		 */
+		int refresh_frames = 15;
+
+		/**
+		 * @brief Factor applied to the accumulated correction every frame (1.0 never forgets, 0.0 only compensates frame to frame motion).
+		 */
+		double decay = 0.95;
+
+		/**
+		 * @brief Frame to frame motion (in pixels of the full resolution frame) above which the estimation is considered invalid (e.g. camera moved).
+		 */
+		double max_shift = 80.0;
+
+		/**
+		 * @brief Feature detector, created once and reused for every frame.
+		 */
+		cv::Ptr<cv::FeatureDetector> detector = cv::GFTTDetector::create(150, 0.01, 8, 3, false, 0.04);
+
+		/**
+		 * @brief Downscaled grayscale version of the previous frame.
+		 */
+		cv::Mat previous_gray;
+
+		/**
+		 * @brief Features of the previous frame.
+		 */
+		std::vector<cv::Point2f> previous_points;
+
+		/**
+		 * @brief Accumulated transform (3x3 in downscaled coordinates) from the reference to the current frame.
+		 */
+		cv::Mat accumulated = cv::Mat::eye(3, 3, CV_64F);
+
+		/**
+		 * @brief Frames processed since the last feature detection.
+		 */
+		int frames_since_detection = 0;
+
+		/**
+		 * @brief Initialize the stabilizer using the first frame as reference.
+		 *
+		 * @param frame First frame captured.
+		 */
+		void initialize(cv::Mat *frame) {
+			this->downscale(frame);
+			cv::swap(this->gray, this->previous_gray);
+			this->detect(this->previous_gray);
+			this->accumulated = cv::Mat::eye(3, 3, CV_64F);
+		}
+
+		/**
+		 * @brief Estimate the motion of the new frame and warp it back into the reference position.
+		 *
+		 * @param frame New frame captured.
+		 * @return cv::Mat Compensated frame, has the same size and type of the input frame. Two buffers are used in turns, the image stays valid until the second next call (stages can keep the previous frame).
+		 */
+		cv::Mat update(cv::Mat *frame) {
+			this->downscale(frame);
+
+			if (this->previous_gray.empty() || this->previous_gray.size() != this->gray.size()) {
+				this->initialize(frame);
+				return *frame;
+			}
+
+			this->estimate(this->gray);
+
+			// Accumulate motion and decay the correction towards identity (identity + (accumulated - identity) * decay)
+			cv::gemm(this->motion, this->accumulated, 1.0, cv::noArray(), 0.0, this->product);
+			cv::addWeighted(this->product, this->decay, this->identity, 1.0 - this->decay, 0.0, this->accumulated);
+
+			// Convert the transform to full resolution (only translation depends on scale)
+			this->accumulated.rowRange(0, 2).copyTo(this->warp);
+			this->warp.at<double>(0, 2) /= this->scale;
+			this->warp.at<double>(1, 2) /= this->scale;
+
+			// Destination pixels in the reference are sampled from the transformed position in the current frame
+			cv::Mat &stabilized = this->stabilized[this->current];
+			this->current = 1 - this->current;
+			cv::warpAffine(*frame, stabilized, this->warp, frame->size(), cv::INTER_LINEAR | cv::WARP_INVERSE_MAP, cv::BORDER_REPLICATE);
+
+			if (this->debug) {
+				cv::imshow("Stabilizer", stabilized);
+			}
+
+			cv::swap(this->gray, this->previous_gray);
+
+			return stabilized;
+		}
+
+	private:
+		/**
+		 * @brief Buffers reused every frame, the stabilized frames alternate between two buffers.
+		 */
+		cv::Mat small;
+
+		cv::Mat gray;
+
+		cv::Mat stabilized[2];
+
+		int current = 0;
+
+		cv::Mat motion = cv::Mat::eye(3, 3, CV_64F);
+
+		const cv::Mat identity = cv::Mat::eye(3, 3, CV_64F);
+
+		cv::Mat product;
+
+		cv::Mat warp;
+
+		std::vector<cv::KeyPoint> keypoints;
+
+		std::vector<cv::Point2f> points;
+
+		std::vector<uchar> status;
+
+		std::vector<float> err;
+
+		std::vector<cv::Point2f> from;
+
+		std::vector<cv::Point2f> to;
+
+		/**
+		 * @brief Create the downscaled grayscale image used to estimate motion in gray.
+		 */
+		void downscale(cv::Mat *frame) {
+			cv::resize(*frame, this->small, cv::Size(), this->scale, this->scale, cv::INTER_AREA);
+			cv::cvtColor(this->small, this->gray, cv::COLOR_BGR2GRAY);
+		}
+
+		/**
+		 * @brief Detect new features in a downscaled image.
+		 */
+		void detect(cv::Mat &gray) {
+			this->detector->detect(gray, this->keypoints);
+			cv::KeyPointsFilter::retainBest(this->keypoints, this->max_features);
+
+			this->previous_points.clear();
+			for (const cv::KeyPoint &kp : this->keypoints) {
+				this->previous_points.push_back(kp.pt);
+			}
+
+			this->frames_since_detection = 0;
+		}
+
+		/**
+		 * @brief Estimate the motion between the previous and the new frame into motion.
+		 *
+		 * The motion is a 3x3 transform from the previous to the new frame, identity if the estimation failed.
+		 */
+		void estimate(cv::Mat &gray) {
+			cv::setIdentity(this->motion);
+
+			if (this->frames_since_detection >= this->refresh_frames || (int)this->previous_points.size() < this->min_features) {
+				this->detect(this->previous_gray);
+			}
+			this->frames_since_detection++;
+
+			if ((int)this->previous_points.size() < this->min_features) {
+				return;
+			}
+
+			cv::TermCriteria criteria = cv::TermCriteria((cv::TermCriteria::COUNT) + (cv::TermCriteria::EPS), 10, 0.03);
+			cv::calcOpticalFlowPyrLK(this->previous_gray, gray, this->previous_points, this->points, this->status, this->err, cv::Size(15, 15), 2, criteria);
+
+			this->from.clear();
+			this->to.clear();
+			for (size_t i = 0; i < this->points.size(); i++) {
+				if (this->status[i]) {
+					this->from.push_back(this->previous_points[i]);
+					this->to.push_back(this->points[i]);
+				}
+			}
+
+			// Features tracked are used in the next frame
+			this->previous_points.swap(this->to);
+
+			if ((int)this->from.size() < this->min_features) {
+				return;
+			}
+
+			// Similarity transform, RANSAC discards features on moving objects (previous_points now holds the tracked positions)
+			cv::Mat affine = cv::estimateAffinePartial2D(this->from, this->previous_points, cv::noArray(), cv::RANSAC, 2.0);
+			if (affine.empty()) {
+				return;
+			}
+
+			double dx = affine.at<double>(0, 2) / this->scale;
+			double dy = affine.at<double>(1, 2) / this->scale;
+			if (sqrt(dx * dx + dy * dy) > this->max_shift) {
+				// Camera was moved, restart from the new position
+				cv::setIdentity(this->accumulated);
+				return;
+			}
+
+			affine.copyTo(this->motion.rowRange(0, 2));
+		}
+};
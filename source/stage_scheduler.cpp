@@ -0,0 +1,196 @@
+#include <chrono>
+#include <algorithm>
+#include <cstdint>
+
+#pragma once
+
+/**
+ * @brief Optional processing stages that can be skipped when the frame time budget is exceeded.
+ */
+enum Stage { yolo_stage, haar_stage, flow_stage, render_stage, stage_count };
+
+/**
+ * @brief Decides which optional stages run in each frame based on a frame time budget.
+ *
+ * The cost of each stage is measured as it runs (exponential moving average). Mandatory work (background subtraction, tracking) is measured separately and subtracted from the budget.
+ *
+ * Detection is prioritized when there are tracks or moving blobs without classification, optional work is shed when there are frames waiting to be processed.
+ */
+class StageScheduler {
+	public:
+		/**
+		 * @brief Time available to process each frame (ms), usually the frame interval of the source.
+		 */
+		double budget = 33.0;
+
+		/**
+		 * @brief Weight of new measurements in the cost estimation.
+		 */
+		double smoothing = 0.1;
+
+		/**
+		 * @brief Minimum number of frames between detections, used when there are unclassified objects or spare time.
+		 */
+		int min_detection_interval = 5;
+
+		/**
+		 * @brief Number of frames after which detection runs even without unclassified objects if it fits the budget.
+		 */
+		int max_detection_interval = 30;
+
+		/**
+		 * @brief Number of frames after which a stage runs even if it does not fit the budget, prevents starvation under constant load.
+		 */
+		int starvation_interval = 150;
+
+		/**
+		 * @brief Minimum number of frames between renders when the budget is exceeded.
+		 */
+		int render_interval = 10;
+
+		/**
+		 * @brief When above zero detection runs on every frame multiple of this value regardless of the budget. Used for offline processing where results must not depend on timing.
+		 */
+		int fixed_interval = 0;
+
+		/**
+		 * @brief Stages that can be scheduled.
+		 */
+		bool enabled[stage_count] = {true, true, false, true};
+
+		/**
+		 * @brief Estimated cost of each stage (ms), zero until the stage runs for the first time.
+		 */
+		double cost[stage_count] = {0.0, 0.0, 0.0, 0.0};
+
+		/**
+		 * @brief Estimated cost of the mandatory work of each frame (ms).
+		 */
+		double core_cost = 0.0;
+
+		/**
+		 * @brief Frames since each stage last ran.
+		 */
+		int since[stage_count] = {0, 0, 0, 0};
+
+		/**
+		 * @brief Number of frames where each enabled stage did not run.
+		 */
+		uint64_t skipped[stage_count] = {0, 0, 0, 0};
+
+		/**
+		 * @brief Decide the stages that run in this frame.
+		 *
+		 * @param unclassified Number of tracks or moving objects without a category.
+		 * @param backlog Number of frames waiting to be processed (or dropped) since the last frame.
+		 * @param frame Number of the frame, used with a fixed interval.
+		 * @return Bit mask of the stages to run.
+		 */
+		unsigned int plan(int unclassified, int backlog, int frame = 0) {
+			unsigned int mask = 0;
+
+			for (int s = 0; s < stage_count; s++) {
+				this->since[s]++;
+			}
+
+			// Deterministic schedule, all enabled stages except detection run every frame
+			if (this->fixed_interval > 0) {
+				for (int s = 0; s < stage_count; s++) {
+					if (this->enabled[s] && s != yolo_stage && s != haar_stage) {
+						mask |= 1 << s;
+					}
+				}
+
+				if (frame % this->fixed_interval == 0) {
+					if (this->enabled[yolo_stage]) {
+						mask |= 1 << yolo_stage;
+					} else if (this->enabled[haar_stage]) {
+						mask |= 1 << haar_stage;
+					}
+				}
+
+				return this->commit(mask);
+			}
+
+			// When behind, all optional work is shed except to prevent starvation
+			double available = this->budget - this->core_cost;
+			if (backlog > 0) {
+				available = 0.0;
+			}
+
+			// Detection, YOLO is preferred and Haar is used when YOLO does not fit
+			bool urgent = unclassified > 0 && this->since[yolo_stage] >= this->min_detection_interval;
+			bool due = urgent || this->since[yolo_stage] >= this->max_detection_interval;
+			bool idle = backlog == 0 && this->since[yolo_stage] >= this->min_detection_interval && available >= 2.0 * this->cost[yolo_stage];
+
+			if (this->enabled[yolo_stage] && (((due || idle) && this->cost[yolo_stage] <= available) || this->since[yolo_stage] >= this->starvation_interval)) {
+				mask |= 1 << yolo_stage;
+				available -= this->cost[yolo_stage];
+			} else if (this->enabled[haar_stage] && urgent && this->cost[haar_stage] <= available && this->since[haar_stage] >= this->min_detection_interval) {
+				mask |= 1 << haar_stage;
+				available -= this->cost[haar_stage];
+			}
+
+			// Rendering
+			if (this->enabled[render_stage] && (this->cost[render_stage] <= available || this->since[render_stage] >= this->render_interval)) {
+				mask |= 1 << render_stage;
+				available -= this->cost[render_stage];
+			}
+
+			// Flow refinement only with spare time
+			if (this->enabled[flow_stage] && this->cost[flow_stage] <= available) {
+				mask |= 1 << flow_stage;
+				available -= this->cost[flow_stage];
+			}
+
+			return this->commit(mask);
+		}
+
+		/**
+		 * @brief Register the time taken by a stage.
+		 */
+		void record(Stage stage, double time) {
+			this->cost[stage] = this->average(this->cost[stage], time);
+		}
+
+		/**
+		 * @brief Register the time taken by the mandatory work of a frame.
+		 */
+		void recordCore(double time) {
+			this->core_cost = this->average(this->core_cost, time);
+		}
+
+		/**
+		 * @brief Current time in milliseconds, used to measure the stages.
+		 */
+		static double now() {
+			return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+		}
+
+	private:
+		/**
+		 * @brief Update the counters of the stages with the plan of the frame.
+		 */
+		unsigned int commit(unsigned int mask) {
+			for (int s = 0; s < stage_count; s++) {
+				if (mask & (1 << s)) {
+					this->since[s] = 0;
+				} else if (this->enabled[s]) {
+					this->skipped[s]++;
+				}
+			}
+
+			return mask;
+		}
+
+		/**
+		 * @brief Update a moving average, first measurement is used directly.
+		 */
+		double average(double current, double value) {
+			if (current <= 0.0) {
+				return value;
+			}
+
+			return current + (value - current) * this->smoothing;
+		}
+};
@@ -0,0 +1,125 @@
+#include <vector>
+#include <atomic>
+#include <functional>
+
+#include "street_monitor.h"
+#include "monitor.cpp"
+
+/**
+ * @brief Single producer, single consumer ring buffer of track updates.
+ */
+class TrackRing {
+	public:
+		std::atomic<uint64_t> dropped{0};
+
+		TrackRing(size_t capacity) : buffer(capacity + 1) {}
+
+		/**
+		 * @brief Add an update, dropped if the ring is full.
+		 */
+		void push(const TrackUpdate &update) {
+			size_t head = this->head.load(std::memory_order_relaxed);
+			size_t next = (head + 1) % this->buffer.size();
+
+			if (next == this->tail.load(std::memory_order_acquire)) {
+				this->dropped++;
+				return;
+			}
+
+			this->buffer[head] = update;
+			this->head.store(next, std::memory_order_release);
+		}
+
+		/**
+		 * @brief Read an update.
+		 *
+		 * @return False if the ring is empty.
+		 */
+		bool pop(TrackUpdate &update) {
+			size_t tail = this->tail.load(std::memory_order_relaxed);
+
+			if (tail == this->head.load(std::memory_order_acquire)) {
+				return false;
+			}
+
+			update = this->buffer[tail];
+			this->tail.store((tail + 1) % this->buffer.size(), std::memory_order_release);
+
+			return true;
+		}
+
+	private:
+		std::vector<TrackUpdate> buffer;
+
+		std::atomic<size_t> head{0};
+
+		std::atomic<size_t> tail{0};
+};
+
+struct StreetMonitor::Impl {
+	Monitor monitor;
+
+	TrackRing ring;
+
+	/**
+	 * @brief Updates of the frame being processed.
+	 */
+	std::vector<TrackUpdate> updates;
+
+	std::function<void(const std::vector<TrackUpdate> &)> callback;
+
+	Impl(const MonitorConfig &config, size_t capacity) : monitor(config), ring(capacity) {}
+};
+
+StreetMonitor::StreetMonitor(const MonitorConfig &config, size_t capacity) : impl(new Impl(config, capacity)) {
+	Impl *impl = this->impl.get();
+
+	this->impl->monitor.track_callback = [impl](StreetObject &obj, bool lost) {
+		TrackUpdate update;
+		update.id = obj.id;
+		update.category = obj.category;
+		update.timestamp = impl->monitor.timestamp;
+		update.frame = impl->monitor.frame_count;
+		update.position = obj.position();
+		update.box = obj.boudingBox();
+		update.speed = obj.speed;
+		update.lost = lost;
+
+		impl->updates.push_back(update);
+		impl->ring.push(update);
+	};
+}
+
+StreetMonitor::~StreetMonitor() {}
+
+void StreetMonitor::push(const cv::Mat &frame, int64_t timestamp) {
+	// Header only copy, pixel data is shared with the caller
+	cv::Mat view = frame;
+
+	this->impl->updates.clear();
+	this->impl->monitor.processFrame(&view, timestamp);
+
+	if (this->impl->callback && !this->impl->updates.empty()) {
+		this->impl->callback(this->impl->updates);
+	}
+}
+
+void StreetMonitor::setCallback(std::function<void(const std::vector<TrackUpdate> &)> callback) {
+	this->impl->callback = callback;
+}
+
+size_t StreetMonitor::poll(std::vector<TrackUpdate> &updates, size_t max) {
+	size_t count = 0;
+	TrackUpdate update;
+
+	while (count < max && this->impl->ring.pop(update)) {
+		updates.push_back(update);
+		count++;
+	}
+
+	return count;
+}
+
+uint64_t StreetMonitor::dropped() const {
+	return this->impl->ring.dropped;
+}
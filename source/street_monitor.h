@@ -0,0 +1,236 @@
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <cstdint>
+
+#include <opencv2/core.hpp>
+#include <opencv2/dnn.hpp>
+
+#pragma once
+
+/**
+ * @brief Configuration of a monitor, allows models and parameters to be injected instead of using the default paths.
+ */
+struct MonitorConfig {
+	/**
+	 * @brief Path of the YOLO ONNX model, empty to disable YOLO (or when yolo_net is provided).
+	 */
+	std::string yolo_model = "./models/yolo/yolov5x.onnx";
+
+	/**
+	 * @brief Path of the file with the YOLO class names.
+	 */
+	std::string yolo_classes = "./models/yolo/yolo.names";
+
+	/**
+	 * @brief Size of the (square) input of the YOLO network (e.g. 320, 416, 640), must match the model.
+	 */
+	int yolo_input_size = 640;
+
+	/**
+	 * @brief Pre-loaded YOLO network, used instead of loading yolo_model when not empty.
+	 */
+	cv::dnn::Net yolo_net;
+
+	/**
+	 * @brief Run YOLO in overlapping tiles of yolo_input_size, keeps small objects of high resolution cameras detectable.
+	 */
+	bool yolo_tiled = false;
+
+	/**
+	 * @brief Number of tiles in each forward pass, above 1 only for models exported with a dynamic batch size.
+	 */
+	int yolo_tile_batch = 1;
+
+	/**
+	 * @brief Maximum number of tiles processed per frame, the tiles with more motion are kept (0 for no limit).
+	 */
+	int yolo_max_tiles = 16;
+
+	/**
+	 * @brief Path of the haar cascade used to detect vehicles, empty to disable.
+	 */
+	std::string haar_model = "./models/haar/car.xml";
+
+	/**
+	 * @brief Number of frames used to warm up before tracking starts.
+	 */
+	int skip_frames = 500;
+
+	/**
+	 * @brief Enable camera shake compensation.
+	 */
+	bool stabilize = true;
+
+	/**
+	 * @brief Show debug windows and render the tracks in the frame, disabled by default so an embedded monitor never opens windows.
+	 */
+	bool debug = false;
+
+	/**
+	 * @brief Time available to process each frame (ms).
+	 */
+	double frame_budget = 33.0;
+
+	/**
+	 * @brief Detection interval (frames) of sources that are not live (video files, image sequences, raw video), 0 to use the frame budget of the source frame rate.
+	 *
+	 * Frames of these sources are never dropped, a real-time budget would only run detection at the starvation interval.
+	 */
+	int detection_interval = 30;
+
+	/**
+	 * @brief Path of the background model checkpoint (PNG), restored at startup when it matches the first frame, empty to disable.
+	 */
+	std::string background_checkpoint;
+
+	/**
+	 * @brief Time between background checkpoints (ms).
+	 */
+	int64_t checkpoint_interval = 300000;
+
+	/**
+	 * @brief Create tracks from moving blobs that do not match any object, allows tracking without detector models.
+	 */
+	bool blob_tracks = false;
+
+	/**
+	 * @brief Frames a lost track is kept to be re-linked when the object reappears (e.g. after an occlusion), 0 to disable.
+	 */
+	int relink_frames = 60;
+
+	/**
+	 * @brief Maximum appearance distance (Bhattacharyya, 0 to 1) to re-link a lost track.
+	 */
+	double relink_distance = 0.35;
+
+	/**
+	 * @brief Path of the road/lane polygons of the camera (YAML), empty to process the whole frame.
+	 */
+	std::string roi_mask;
+
+	/**
+	 * @brief Path of the homography calibration of the camera (YAML), empty to estimate speeds without calibration.
+	 */
+	std::string calibration;
+
+	/**
+	 * @brief Path of the counting lines of the camera (YAML), empty to disable counting.
+	 */
+	std::string counting_lines;
+
+	/**
+	 * @brief Load the configuration from a YAML/XML file (cv::FileStorage), missing values keep their defaults.
+	 *
+	 * The YOLO model can be selected by name from a model registry using the "model_registry" and "model" keys.
+	 *
+	 * @param fname Path of the configuration file.
+	 */
+	static MonitorConfig load(std::string fname);
+
+	/**
+	 * @brief Load the configuration from a file, the keys missing in the file keep the values of another configuration.
+	 *
+	 * @param fname Path of the configuration file.
+	 * @param defaults Values used for the keys missing in the file.
+	 */
+	static MonitorConfig load(std::string fname, const MonitorConfig &defaults);
+};
+
+/**
+ * @brief State of a track after processing a frame.
+ */
+struct TrackUpdate {
+	/**
+	 * @brief Identifier of the track.
+	 */
+	int id;
+
+	/**
+	 * @brief Category of the object (0 unknown, 1 vehicle, 2 pedestrian).
+	 */
+	int category;
+
+	/**
+	 * @brief Timestamp of the frame (ms).
+	 */
+	int64_t timestamp;
+
+	/**
+	 * @brief Frame number.
+	 */
+	int frame;
+
+	/**
+	 * @brief Position of the object in the image.
+	 */
+	cv::Point position;
+
+	/**
+	 * @brief Bounding box of the object in the image.
+	 */
+	cv::Rect box;
+
+	/**
+	 * @brief Estimated speed (kph).
+	 */
+	float speed;
+
+	/**
+	 * @brief Track was removed in this frame, this is the last update for the id.
+	 */
+	bool lost;
+};
+
+/**
+ * @brief Embeddable street monitor, frames are pushed by the application and track updates are delivered by callback or ring buffer.
+ *
+ * Each instance processes one stream, different instances can be used from different threads.
+ */
+class StreetMonitor {
+	public:
+		/**
+		 * @brief Create a monitor.
+		 *
+		 * @param config Configuration and models.
+		 * @param capacity Number of updates kept in the ring buffer, new updates are dropped (and counted by dropped()) when it is full.
+		 */
+		StreetMonitor(const MonitorConfig &config = MonitorConfig(), size_t capacity = 4096);
+
+		~StreetMonitor();
+
+		StreetMonitor(const StreetMonitor &) = delete;
+		StreetMonitor &operator=(const StreetMonitor &) = delete;
+
+		/**
+		 * @brief Process a frame, the frame data is not copied and is not modified.
+		 *
+		 * @param frame BGR frame.
+		 * @param timestamp Capture time of the frame (ms).
+		 */
+		void push(const cv::Mat &frame, int64_t timestamp);
+
+		/**
+		 * @brief Set a function called after each frame with the tracks updated, called in the thread that pushed the frame.
+		 */
+		void setCallback(std::function<void(const std::vector<TrackUpdate> &)> callback);
+
+		/**
+		 * @brief Read updates from the ring buffer, can be called from a different thread than push().
+		 *
+		 * @param updates Vector where updates are appended.
+		 * @param max Maximum number of updates to read.
+		 * @return Number of updates read.
+		 */
+		size_t poll(std::vector<TrackUpdate> &updates, size_t max = SIZE_MAX);
+
+		/**
+		 * @brief Number of updates dropped because the ring buffer was full.
+		 */
+		uint64_t dropped() const;
+
+	private:
+		struct Impl;
+		std::unique_ptr<Impl> impl;
+};
@@ -1,9 +1,12 @@
 #include <sstream>
 #include <vector>
+#include <cstdint>
+#include <atomic>
 
 #include <opencv2/core.hpp>
 
 #include "math_utils.cpp"
+#include "trajectory.cpp"
 
 #pragma once
 
@@ -12,7 +15,7 @@
  */
 enum Category { unknown, vehicle, pedestrian };
 
-int _id = 0;
+std::atomic<int> _id{0};
 
 /**
  * @brief Represents an object that is moving trough the street.
@@ -42,9 +45,29 @@ class StreetObject {
         cv::Size size;
 
         /**
-         * @brief Position of this object in the last frames.
+         * @brief Positions of the object, the newest points are exact and older points are compressed.
          */
-        std::vector<cv::Point> frames;
+        Trajectory trajectory;
+
+        /**
+         * @brief Counting lines already crossed by the object (bit mask).
+         */
+        uint32_t crossed = 0;
+
+        /**
+         * @brief Speed of the object (kph), updated every frame by the monitor.
+         */
+        float speed = 0.0;
+
+        /**
+         * @brief Highest speed of the object since it was created (kph).
+         */
+        float max_speed = 0.0;
+
+        /**
+         * @brief Appearance signature (color histogram), used to re-link the track after an occlusion.
+         */
+        cv::Mat appearance;
 
         StreetObject() {
             this->id = _id++;
@@ -57,7 +80,7 @@ class StreetObject {
          * @return int Number of frames for the object.
          */
         int length() {
-            return this->frames.size();
+            return this->trajectory.size();
         }
 
         /**
@@ -70,16 +93,21 @@ class StreetObject {
                 throw "There are no frames for the object.";
             }
 
-            return this->frames.back();
+            const TrajectoryPoint &last = this->trajectory.point(0);
+            return cv::Point(last.x, last.y);
         }
 
         /**
          * @brief Update with keypoint position.
+         * 
+         * @param position Position of the object.
+         * @param frame Frame number.
+         * @param timestamp Capture time of the frame (ms).
          */
-        void updatePosition(cv::Point position, int frame)
+        void updatePosition(cv::Point position, int frame, int64_t timestamp = 0)
         {
             this->frame = frame;
-            this->frames.push_back(position);
+            this->trajectory.push(position.x, position.y, timestamp);
         }
 
         /**
@@ -125,13 +153,55 @@ class StreetObject {
         cv::Point direction() {
             const int points = 5;
 
-            if (this->frames.size() < points) {
+            if (this->trajectory.recent() < points) {
                 return cv::Point(0.0, 0.0);
             }
 
-            int length = this->frames.size() - 1;
+            const TrajectoryPoint &last = this->trajectory.point(0);
+            const TrajectoryPoint &first = this->trajectory.point(points - 1);
+
+            return cv::Point(last.x - first.x, last.y - first.y);
+        }
+
+        /**
+         * @brief Time elapsed (ms) over the points used by direction(), zero if unknown.
+         */
+        int64_t directionTime() {
+            const int points = 5;
+
+            if (this->trajectory.recent() < points) {
+                return 0;
+            }
+
+            return this->trajectory.point(0).timestamp - this->trajectory.point(points - 1).timestamp;
+        }
+
+        /**
+         * @brief Estimate the speed of the object in kph without calibration.
+         * 
+         * Uses the size of the direction vector corrected by the vertical position of the object in the image (objects further away move less pixels).
+         * 
+         * The factors were adjusted for 30 fps video, the displacement is scaled by the real time elapsed between the frames when timestamps are available.
+         * 
+         * @return float Estimated speed.
+         */
+        float estimateSpeed() {
+            const static float factor = 3.0;
+            const static float y_factor = 900;
+            const static float reference_time = 4 * 1000.0 / 30.0;
+
+            if (this->length() == 0) {
+                return 0.0;
+            }
+
+            float speed = ::size(this->direction()) * (factor + (this->position().y / y_factor));
+
+            int64_t elapsed = this->directionTime();
+            if (elapsed > 0) {
+                speed *= reference_time / elapsed;
+            }
 
-            return cv::Point(this->frames[length].x - this->frames[length - points + 1].x, this->frames[length].y - this->frames[length - points + 1].y);
+            return speed;
         }
 };
 
@@ -0,0 +1,377 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cmath>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/videoio.hpp>
+
+#include "street_object.cpp"
+
+#pragma once
+
+/**
+ * @brief Position of an object of the synthetic scene in a frame.
+ */
+struct GroundTruth {
+	int frame;
+
+	int id;
+
+	Category category;
+
+	/**
+	 * @brief Visible part of the object in the frame.
+	 */
+	cv::Rect box;
+};
+
+/**
+ * @brief Deterministic street scene used to test tracking without external video.
+ *
+ * Vehicles drive along two lanes in each direction and pedestrians walk on the sidewalks over a static background. Sensor noise and slow lighting changes are added to every frame. The same seed always produces the same frames and ground truth.
+ */
+class SyntheticScene {
+	public:
+		/**
+		 * @brief Size of the frames.
+		 */
+		cv::Size size = cv::Size(1280, 720);
+
+		/**
+		 * @brief Frame rate used for the timestamps.
+		 */
+		double fps = 30.0;
+
+		/**
+		 * @brief Probability of a vehicle entering each lane in a frame.
+		 */
+		double vehicle_rate = 0.015;
+
+		/**
+		 * @brief Probability of a pedestrian entering each sidewalk in a frame.
+		 */
+		double pedestrian_rate = 0.005;
+
+		/**
+		 * @brief Standard deviation of the gaussian noise added to the pixels.
+		 */
+		double noise = 3.0;
+
+		/**
+		 * @brief Amplitude of the global brightness change (fraction of the brightness).
+		 */
+		double lighting = 0.1;
+
+		/**
+		 * @brief Period of the brightness change in frames.
+		 */
+		int lighting_period = 900;
+
+		/**
+		 * @brief Number of frames at the start without objects, lets the background model learn the empty scene.
+		 */
+		int quiet_frames = 0;
+
+		/**
+		 * @brief Index of the next frame.
+		 */
+		int frame = 0;
+
+		SyntheticScene(uint64_t seed = 1) {
+			this->seed = seed;
+			this->reset();
+		}
+
+		/**
+		 * @brief Restart the scene from the first frame.
+		 */
+		void reset() {
+			this->rng = cv::RNG(this->seed);
+			this->frame = 0;
+			this->objects.clear();
+			this->next_id = 0;
+			this->drawBackground();
+		}
+
+		/**
+		 * @brief Timestamp of the next frame (ms).
+		 */
+		int64_t timestamp() const {
+			return (int64_t)std::round(this->frame * 1000.0 / this->fps);
+		}
+
+		/**
+		 * @brief Render the next frame of the scene.
+		 *
+		 * @param output Frame rendered (BGR).
+		 * @param truth Objects visible in the frame.
+		 */
+		void next(cv::Mat &output, std::vector<GroundTruth> &truth) {
+			truth.clear();
+
+			if (this->frame >= this->quiet_frames) {
+				this->spawn();
+			}
+
+			this->background.copyTo(output);
+
+			for (Actor &actor : this->objects) {
+				actor.position += actor.velocity;
+
+				cv::Rect box = actor.box() & cv::Rect(cv::Point(0, 0), this->size);
+				if (box.area() == 0) {
+					continue;
+				}
+
+				this->drawActor(output, actor);
+
+				GroundTruth object;
+				object.frame = this->frame;
+				object.id = actor.id;
+				object.category = actor.category;
+				object.box = box;
+				truth.push_back(object);
+			}
+
+			// Objects that left the frame
+			for (auto actor = this->objects.begin(); actor != this->objects.end();) {
+				if ((actor->box() & cv::Rect(cv::Point(0, 0), this->size)).area() == 0 && actor->entered) {
+					actor = this->objects.erase(actor);
+					continue;
+				}
+
+				actor->entered = actor->entered || (actor->box() & cv::Rect(cv::Point(0, 0), this->size)).area() > 0;
+				actor++;
+			}
+
+			// Lighting and sensor noise
+			if (this->lighting > 0.0 && this->lighting_period > 0) {
+				double gain = 1.0 + this->lighting * std::sin(2.0 * M_PI * this->frame / this->lighting_period);
+				output.convertTo(output, -1, gain, 0.0);
+			}
+
+			if (this->noise > 0.0) {
+				this->grain.create(this->size, CV_16SC3);
+				this->rng.fill(this->grain, cv::RNG::NORMAL, cv::Scalar::all(0), cv::Scalar::all(this->noise));
+				cv::add(output, this->grain, output, cv::noArray(), CV_8UC3);
+			}
+
+			this->frame++;
+		}
+
+		/**
+		 * @brief Render frames into a video file and write the ground truth as CSV (frame,id,category,x,y,width,height).
+		 *
+		 * @param video Path of the video file.
+		 * @param csv Path of the ground truth file.
+		 * @param frames Number of frames to render.
+		 * @return True if both files were written.
+		 */
+		bool write(std::string video, std::string csv, int frames) {
+			cv::VideoWriter writer(video, cv::VideoWriter::fourcc('M', 'J', 'P', 'G'), this->fps, this->size);
+			if (!writer.isOpened()) {
+				std::cout << "Error opening video writer " << video << std::endl;
+				return false;
+			}
+
+			std::ofstream file(csv);
+			if (!file.is_open()) {
+				std::cout << "Error opening ground truth file " << csv << std::endl;
+				return false;
+			}
+
+			file << "frame,id,category,x,y,width,height" << std::endl;
+
+			cv::Mat image;
+			std::vector<GroundTruth> truth;
+			for (int i = 0; i < frames; i++) {
+				this->next(image, truth);
+				writer.write(image);
+
+				for (const GroundTruth &object : truth) {
+					file << object.frame << "," << object.id << "," << object.category << "," << object.box.x << "," << object.box.y << "," << object.box.width << "," << object.box.height << std::endl;
+				}
+			}
+
+			return true;
+		}
+
+	private:
+		/**
+		 * @brief Object moving in the scene.
+		 */
+		struct Actor {
+			int id;
+
+			Category category;
+
+			cv::Point2f position;
+
+			cv::Point2f velocity;
+
+			cv::Size size;
+
+			cv::Scalar color;
+
+			/**
+			 * @brief Object was already visible, it is removed when it leaves the frame.
+			 */
+			bool entered = false;
+
+			cv::Rect box() const {
+				return cv::Rect(std::round(this->position.x - this->size.width / 2.0), std::round(this->position.y - this->size.height / 2.0), this->size.width, this->size.height);
+			}
+		};
+
+		uint64_t seed;
+
+		cv::RNG rng;
+
+		cv::Mat background;
+
+		cv::Mat grain;
+
+		std::vector<Actor> objects;
+
+		int next_id = 0;
+
+		/**
+		 * @brief Center line of each lane, the first half drives to the right and the second half to the left.
+		 */
+		std::vector<float> lanes() const {
+			float h = this->size.height;
+			return {h * 0.38f, h * 0.47f, h * 0.58f, h * 0.67f};
+		}
+
+		/**
+		 * @brief Center line of each sidewalk.
+		 */
+		std::vector<float> sidewalks() const {
+			float h = this->size.height;
+			return {h * 0.25f, h * 0.82f};
+		}
+
+		void drawBackground() {
+			float h = this->size.height;
+			float w = this->size.width;
+
+			this->background = cv::Mat(this->size, CV_8UC3, cv::Scalar(90, 120, 100));
+
+			// Buildings
+			for (int x = 0; x < w; x += 80) {
+				int height = this->rng.uniform((int)(h * 0.08), (int)(h * 0.18));
+				cv::Scalar color(this->rng.uniform(60, 160), this->rng.uniform(60, 160), this->rng.uniform(60, 160));
+				cv::rectangle(this->background, cv::Rect(x, h * 0.2 - height, 76, height), color, cv::FILLED);
+			}
+
+			// Sidewalks and road
+			cv::rectangle(this->background, cv::Rect(0, h * 0.2, w, h * 0.12), cv::Scalar(170, 170, 175), cv::FILLED);
+			cv::rectangle(this->background, cv::Rect(0, h * 0.76, w, h * 0.12), cv::Scalar(170, 170, 175), cv::FILLED);
+			cv::rectangle(this->background, cv::Rect(0, h * 0.32, w, h * 0.44), cv::Scalar(70, 70, 72), cv::FILLED);
+
+			// Lane markings
+			for (int x = 0; x < w; x += 60) {
+				cv::line(this->background, cv::Point(x, h * 0.425), cv::Point(x + 30, h * 0.425), cv::Scalar(220, 220, 220), 2);
+				cv::line(this->background, cv::Point(x, h * 0.625), cv::Point(x + 30, h * 0.625), cv::Scalar(220, 220, 220), 2);
+			}
+			cv::line(this->background, cv::Point(0, h * 0.525), cv::Point(w, h * 0.525), cv::Scalar(0, 200, 230), 3);
+
+			// Texture of the asphalt
+			cv::Mat texture(this->size, CV_16SC3);
+			this->rng.fill(texture, cv::RNG::NORMAL, cv::Scalar::all(0), cv::Scalar::all(6));
+			cv::add(this->background, texture, this->background, cv::noArray(), CV_8UC3);
+		}
+
+		/**
+		 * @brief Add new objects at the border of the frame, a lane only receives a vehicle when its entrance is free.
+		 */
+		void spawn() {
+			std::vector<float> lanes = this->lanes();
+			for (size_t lane = 0; lane < lanes.size(); lane++) {
+				if (this->rng.uniform(0.0, 1.0) >= this->vehicle_rate) {
+					continue;
+				}
+
+				bool right = lane < lanes.size() / 2;
+
+				Actor actor;
+				actor.category = vehicle;
+				actor.size = cv::Size(this->rng.uniform(90, 140), this->rng.uniform(40, 55));
+				actor.velocity = cv::Point2f((right ? 1 : -1) * this->rng.uniform(4.0f, 10.0f), 0);
+				actor.position = cv::Point2f(right ? -actor.size.width / 2.0f : this->size.width + actor.size.width / 2.0f, lanes[lane]);
+				actor.color = cv::Scalar(this->rng.uniform(0, 255), this->rng.uniform(0, 255), this->rng.uniform(0, 255));
+
+				if (this->blocked(actor)) {
+					continue;
+				}
+
+				actor.id = this->next_id++;
+				this->objects.push_back(actor);
+			}
+
+			std::vector<float> sidewalks = this->sidewalks();
+			for (size_t side = 0; side < sidewalks.size(); side++) {
+				if (this->rng.uniform(0.0, 1.0) >= this->pedestrian_rate) {
+					continue;
+				}
+
+				bool right = this->rng.uniform(0, 2) == 0;
+
+				Actor actor;
+				actor.category = pedestrian;
+				actor.size = cv::Size(this->rng.uniform(18, 26), this->rng.uniform(42, 56));
+				actor.velocity = cv::Point2f((right ? 1 : -1) * this->rng.uniform(1.0f, 2.5f), this->rng.uniform(-0.2f, 0.2f));
+				actor.position = cv::Point2f(right ? -actor.size.width / 2.0f : this->size.width + actor.size.width / 2.0f, sidewalks[side]);
+				actor.color = cv::Scalar(this->rng.uniform(0, 255), this->rng.uniform(0, 255), this->rng.uniform(0, 255));
+
+				if (this->blocked(actor)) {
+					continue;
+				}
+
+				actor.id = this->next_id++;
+				this->objects.push_back(actor);
+			}
+		}
+
+		/**
+		 * @brief Check if a new object would overlap (or be caught up by) an object already in its path.
+		 */
+		bool blocked(const Actor &actor) const {
+			for (const Actor &other : this->objects) {
+				if (other.category != actor.category || std::abs(other.position.y - actor.position.y) > actor.size.height || (other.velocity.x > 0) != (actor.velocity.x > 0)) {
+					continue;
+				}
+
+				// Gap needed so the new object does not reach the other before it leaves the frame
+				float gap = std::abs(other.position.x - actor.position.x) - (other.size.width + actor.size.width) / 2.0f;
+				float closing = std::abs(actor.velocity.x) - std::abs(other.velocity.x);
+				float remaining = std::abs(actor.velocity.x > 0 ? this->size.width - other.position.x : other.position.x) / std::max(0.1f, std::abs(other.velocity.x));
+
+				if (gap < actor.size.width || (closing > 0 && gap - closing * remaining < 0)) {
+					return true;
+				}
+			}
+
+			return false;
+		}
+
+		void drawActor(cv::Mat &image, const Actor &actor) const {
+			cv::Rect box = actor.box();
+
+			if (actor.category == vehicle) {
+				cv::rectangle(image, box, actor.color, cv::FILLED);
+
+				// Windshield and wheels
+				int front = actor.velocity.x > 0 ? box.x + box.width * 0.6 : box.x + box.width * 0.15;
+				cv::rectangle(image, cv::Rect(front, box.y + box.height * 0.15, box.width * 0.25, box.height * 0.7), cv::Scalar(40, 30, 30), cv::FILLED);
+				cv::circle(image, cv::Point(box.x + box.width * 0.2, box.y + box.height), box.height * 0.18, cv::Scalar(20, 20, 20), cv::FILLED);
+				cv::circle(image, cv::Point(box.x + box.width * 0.8, box.y + box.height), box.height * 0.18, cv::Scalar(20, 20, 20), cv::FILLED);
+			} else {
+				cv::ellipse(image, cv::Point(box.x + box.width / 2, box.y + box.height * 0.6), cv::Size(box.width / 2, box.height * 0.4), 0, 0, 360, actor.color, cv::FILLED);
+				cv::circle(image, cv::Point(box.x + box.width / 2, box.y + box.height * 0.12), box.width * 0.3, cv::Scalar(120, 150, 200), cv::FILLED);
+			}
+		}
+};
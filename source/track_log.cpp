@@ -0,0 +1,864 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "trajectory.cpp"
+
+#pragma once
+
+/**
+ * @brief Magic value at the start of a track log file.
+ */
+const char TRACK_LOG_MAGIC[4] = {'S', 'M', 'T', 'L'};
+
+/**
+ * @brief Magic value at the start of each chunk, used to validate the file while reading.
+ */
+const uint32_t TRACK_CHUNK_MAGIC = 0x4b434d53;
+
+/**
+ * @brief Version of the track log format.
+ */
+const uint32_t TRACK_LOG_VERSION = 2;
+
+/**
+ * @brief Header written once at the start of the log file.
+ */
+struct TrackLogHeader {
+	/**
+	 * @brief Magic value used to identify the file ("SMTL").
+	 */
+	char magic[4];
+
+	/**
+	 * @brief Version of the file format.
+	 */
+	uint32_t version;
+
+	/**
+	 * @brief Size in bytes of each record, allows readers to skip fields added in future versions.
+	 */
+	uint32_t record_size;
+
+	/**
+	 * @brief Identifier of the camera that produced the log.
+	 */
+	uint32_t camera;
+
+	/**
+	 * @brief Time when the file was created (milliseconds since epoch).
+	 */
+	int64_t created;
+
+	/**
+	 * @brief Time base of the timestamps, time (milliseconds since epoch) of timestamp 0.
+	 *
+	 * 0 when the timestamps are already times since epoch (live sources), the start time of the video when they are positions in a video file. Added in version 2, version 1 files use 0.
+	 */
+	int64_t time_origin;
+};
+
+/**
+ * @brief Size of the header of a version of the format.
+ */
+inline size_t trackLogHeaderSize(uint32_t version) {
+	return version < 2 ? 24 : sizeof(TrackLogHeader);
+}
+
+/**
+ * @brief Type of data stored in a chunk.
+ */
+enum TrackChunkType : uint32_t { records_chunk = 1, trajectories_chunk = 2, session_chunk = 3 };
+
+/**
+ * @brief Header of each chunk, chunks are written in a single write and contain a batch of records.
+ *
+ * Session chunks have no data, they are written each time the file is opened for writing and separate the tracks of different runs (track identifiers start again after a restart). The timestamps of a session chunk are the time when the file was opened.
+ */
+struct TrackChunkHeader {
+	uint32_t magic;
+
+	/**
+	 * @brief Type of the chunk data.
+	 */
+	uint32_t type;
+
+	/**
+	 * @brief Number of records in the chunk.
+	 */
+	uint32_t count;
+
+	/**
+	 * @brief Size in bytes of the chunk data (after the header), a multiple of 8 so that the next chunk stays aligned.
+	 */
+	uint32_t size;
+
+	/**
+	 * @brief Timestamp of the first and last record in the chunk, used to skip chunks while reading.
+	 */
+	int64_t first_timestamp;
+	int64_t last_timestamp;
+};
+
+/**
+ * @brief State of a track in a specific frame, fixed-size record stored in the log.
+ */
+struct TrackRecord {
+	/**
+	 * @brief Timestamp of the frame in milliseconds.
+	 */
+	int64_t timestamp;
+
+	/**
+	 * @brief Frame number.
+	 */
+	int32_t frame;
+
+	/**
+	 * @brief Identifier of the track.
+	 */
+	int32_t id;
+
+	/**
+	 * @brief Category of the object (Category enum value).
+	 */
+	uint8_t category;
+	uint8_t reserved[3];
+
+	/**
+	 * @brief Position of the object in the image.
+	 */
+	float x;
+	float y;
+
+	/**
+	 * @brief Bounding box of the object in the image.
+	 */
+	int32_t box_x;
+	int32_t box_y;
+	int32_t box_width;
+	int32_t box_height;
+
+	/**
+	 * @brief Estimated speed of the object (kph).
+	 */
+	float speed;
+};
+
+/**
+ * @brief Compressed trajectory of a track stored in a trajectories chunk, followed by size bytes of delta encoded key points (Trajectory::encode).
+ */
+struct TrajectoryEntry {
+	int32_t id;
+
+	/**
+	 * @brief Category of the object (Category enum value).
+	 */
+	uint8_t category;
+	uint8_t reserved;
+
+	/**
+	 * @brief Maximum speed of the track in tenths of kph, 0 in files written before the speed was stored.
+	 */
+	uint16_t max_speed;
+
+	/**
+	 * @brief Number of positions observed, the key points are a subset.
+	 */
+	uint32_t points;
+
+	/**
+	 * @brief Size in bytes of the encoded key points.
+	 */
+	uint32_t size;
+
+	/**
+	 * @brief Timestamp of the first and last position of the track.
+	 */
+	int64_t first_timestamp;
+	int64_t last_timestamp;
+};
+
+static_assert(sizeof(TrackLogHeader) == 32, "Track log header must be 32 bytes.");
+static_assert(sizeof(TrackChunkHeader) == 32, "Track chunk header must be 32 bytes.");
+static_assert(sizeof(TrackRecord) == 48, "Track record must be 48 bytes.");
+static_assert(sizeof(TrajectoryEntry) == 32, "Trajectory entry must be 32 bytes.");
+
+/**
+ * @brief Find the next chunk magic value.
+ *
+ * @param from First offset searched.
+ * @param to Offset after the last offset searched.
+ * @return Offset of the magic value, to if not found.
+ */
+inline size_t findTrackChunk(const uint8_t *data, size_t length, size_t from, size_t to) {
+	for (size_t offset = from; offset < to && offset + sizeof(uint32_t) <= length; offset++) {
+		if (memcmp(data + offset, &TRACK_CHUNK_MAGIC, sizeof(uint32_t)) == 0) {
+			return offset;
+		}
+	}
+
+	return to;
+}
+
+/**
+ * @brief Walk the chunks of a log file in memory, skipping the data of incomplete chunks.
+ *
+ * A crash while writing leaves a partial chunk, followed by the chunks appended after the restart. When the data after a chunk is not another chunk, the chunk is only kept if it does not contain the start of another chunk, and the reader resyncs on the next chunk magic value.
+ *
+ * @param data Contents of the file.
+ * @param length Size of the file.
+ * @param offset Offset of the first chunk (after the file header).
+ * @param record_size Size of each record.
+ * @param callback Function called with the offset of each valid chunk.
+ * @return End of the last valid chunk.
+ */
+template <typename Function>
+size_t scanTrackChunks(const uint8_t *data, size_t length, size_t offset, uint32_t record_size, Function callback) {
+	size_t valid_end = offset;
+	size_t skipped = 0;
+
+	while (offset + sizeof(TrackChunkHeader) <= length) {
+		TrackChunkHeader header;
+		memcpy(&header, data + offset, sizeof(header));
+
+		size_t end = offset + sizeof(TrackChunkHeader) + header.size;
+		bool valid = header.magic == TRACK_CHUNK_MAGIC && end <= length && (header.type != records_chunk || (uint64_t)header.count * record_size == header.size);
+
+		if (valid && end + sizeof(uint32_t) <= length && findTrackChunk(data, length, end, end + 1) != end) {
+			// The chunk was cut if the next chunk starts inside of it
+			valid = findTrackChunk(data, length, offset + 1, end) == end;
+		}
+
+		if (!valid) {
+			size_t next = findTrackChunk(data, length, offset + 1, length);
+			skipped += std::min(next, length) - offset;
+			offset = next;
+			continue;
+		}
+
+		callback(offset);
+		offset = end;
+		valid_end = end;
+	}
+
+	if (skipped > 0) {
+		std::cout << "Skipped " << skipped << " bytes of incomplete chunks in track log" << std::endl;
+	}
+
+	return valid_end;
+}
+
+/**
+ * @brief Append-only writer for the binary track log.
+ *
+ * Records are buffered in memory and written in chunks by a background thread, appending a record never waits for disk.
+ */
+class TrackLogWriter {
+	public:
+		/**
+		 * @brief Number of records written per chunk.
+		 */
+		size_t chunk_records = 4096;
+
+		/**
+		 * @brief Maximum number of records waiting to be written, new records are dropped when the disk cannot keep up.
+		 */
+		size_t max_pending = 1 << 20;
+
+		/**
+		 * @brief Maximum time in milliseconds that a record stays in memory before being written.
+		 */
+		int flush_interval = 1000;
+
+		/**
+		 * @brief Number of records dropped because the queue was full.
+		 */
+		uint64_t dropped = 0;
+
+		/**
+		 * @brief Number of records written to the file.
+		 */
+		std::atomic<uint64_t> written{0};
+
+		/**
+		 * @brief Open (or create) a log file, records are appended at the end of the file.
+		 *
+		 * An incomplete chunk left at the end of an existing file (e.g. crash while writing) is removed first. Existing files must have the same record size and time base.
+		 *
+		 * @param fname Path of the log file.
+		 * @param camera Identifier of the camera stored in the header of new files.
+		 * @param time_origin Time (ms since epoch) of timestamp 0, 0 if the timestamps are times since epoch.
+		 */
+		TrackLogWriter(std::string fname, uint32_t camera = 0, int64_t time_origin = 0) {
+			struct stat st;
+			bool exists = stat(fname.c_str(), &st) == 0 && st.st_size > 0;
+
+			if (exists && !this->recover(fname, time_origin)) {
+				return;
+			}
+
+			this->file.open(fname, std::ios::binary | std::ios::app);
+			if (!this->file.is_open()) {
+				std::cout << "Error opening track log " << fname << std::endl;
+				return;
+			}
+
+			if (!exists) {
+				TrackLogHeader header;
+				memcpy(header.magic, TRACK_LOG_MAGIC, 4);
+				header.version = TRACK_LOG_VERSION;
+				header.record_size = sizeof(TrackRecord);
+				header.camera = camera;
+				header.created = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+				header.time_origin = time_origin;
+				this->file.write((const char *)&header, sizeof(header));
+			}
+
+			TrackChunkHeader session;
+			session.magic = TRACK_CHUNK_MAGIC;
+			session.type = session_chunk;
+			session.count = 0;
+			session.size = 0;
+			session.first_timestamp = session.last_timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+			this->file.write((const char *)&session, sizeof(session));
+			this->file.flush();
+
+			this->worker = std::thread(&TrackLogWriter::run, this);
+		}
+
+		~TrackLogWriter() {
+			this->close();
+		}
+
+		/**
+		 * @brief Check if the log file is open for writing.
+		 */
+		bool isOpen() {
+			return this->file.is_open();
+		}
+
+		/**
+		 * @brief Add a record to the log, returns immediately.
+		 *
+		 * @param record Record to be appended.
+		 */
+		void append(const TrackRecord &record) {
+			std::unique_lock<std::mutex> lock(this->mutex);
+
+			if (this->pending.size() >= this->max_pending) {
+				this->dropped++;
+				return;
+			}
+
+			this->pending.push_back(record);
+
+			if (this->pending.size() >= this->chunk_records) {
+				this->condition.notify_one();
+			}
+		}
+
+		/**
+		 * @brief Add the compressed trajectory of a finished track to the log, returns immediately.
+		 *
+		 * @param id Identifier of the track.
+		 * @param category Category of the object.
+		 * @param trajectory Trajectory of the track.
+		 * @param max_speed Maximum speed of the track (kph).
+		 */
+		void appendTrajectory(int32_t id, uint8_t category, const Trajectory &trajectory, float max_speed = 0.0) {
+			if (trajectory.size() == 0) {
+				return;
+			}
+
+			std::vector<uint8_t> encoded = trajectory.encode();
+
+			TrajectoryEntry entry;
+			memset(&entry, 0, sizeof(entry));
+			entry.id = id;
+			entry.category = category;
+			entry.max_speed = std::min(65535.0f, std::max(0.0f, std::round(max_speed * 10.0f)));
+			entry.points = trajectory.size();
+			entry.size = encoded.size();
+			entry.first_timestamp = trajectory.front().timestamp;
+			entry.last_timestamp = trajectory.point(0).timestamp;
+
+			std::unique_lock<std::mutex> lock(this->mutex);
+
+			const uint8_t *bytes = (const uint8_t *)&entry;
+			this->pending_trajectories.insert(this->pending_trajectories.end(), bytes, bytes + sizeof(entry));
+			this->pending_trajectories.insert(this->pending_trajectories.end(), encoded.begin(), encoded.end());
+		}
+
+		/**
+		 * @brief Write all pending records and stop the writer thread.
+		 */
+		void close() {
+			{
+				std::unique_lock<std::mutex> lock(this->mutex);
+				if (this->stop) {
+					return;
+				}
+				this->stop = true;
+			}
+
+			this->condition.notify_one();
+
+			if (this->worker.joinable()) {
+				this->worker.join();
+			}
+
+			if (this->file.is_open()) {
+				this->file.close();
+			}
+		}
+
+	private:
+		std::ofstream file;
+
+		std::thread worker;
+
+		std::mutex mutex;
+
+		std::condition_variable condition;
+
+		/**
+		 * @brief Records waiting to be written.
+		 */
+		std::vector<TrackRecord> pending;
+
+		/**
+		 * @brief Trajectory entries waiting to be written.
+		 */
+		std::vector<uint8_t> pending_trajectories;
+
+		bool stop = false;
+
+		/**
+		 * @brief Check that records can be appended to an existing file and truncate it after the last complete chunk.
+		 *
+		 * @return False if the file cannot be appended to.
+		 */
+		bool recover(std::string fname, int64_t time_origin) {
+			int fd = open(fname.c_str(), O_RDWR);
+			if (fd < 0) {
+				std::cout << "Error opening track log " << fname << std::endl;
+				return false;
+			}
+
+			struct stat st;
+			if (fstat(fd, &st) != 0 || st.st_size < (off_t)trackLogHeaderSize(1)) {
+				std::cout << "Invalid track log " << fname << std::endl;
+				::close(fd);
+				return false;
+			}
+
+			void *ptr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+			if (ptr == MAP_FAILED) {
+				std::cout << "Error mapping track log " << fname << std::endl;
+				::close(fd);
+				return false;
+			}
+
+			const uint8_t *data = (const uint8_t *)ptr;
+			size_t length = st.st_size;
+
+			TrackLogHeader header;
+			memset(&header, 0, sizeof(header));
+			memcpy(&header, data, std::min(length, sizeof(header)));
+
+			bool valid = memcmp(header.magic, TRACK_LOG_MAGIC, 4) == 0 && header.version >= 1 && header.version <= TRACK_LOG_VERSION && length >= trackLogHeaderSize(header.version);
+			if (!valid) {
+				std::cout << "Invalid track log " << fname << std::endl;
+			} else if (header.record_size != sizeof(TrackRecord)) {
+				std::cout << "Track log " << fname << " has records of " << header.record_size << " bytes, expected " << sizeof(TrackRecord) << std::endl;
+				valid = false;
+			} else {
+				int64_t origin = header.version < 2 ? 0 : header.time_origin;
+				if (origin != time_origin) {
+					std::cout << "Track log " << fname << " uses a different time base, use another file" << std::endl;
+					valid = false;
+				}
+			}
+
+			size_t end = length;
+			if (valid) {
+				end = scanTrackChunks(data, length, trackLogHeaderSize(header.version), header.record_size, [](size_t) {});
+			}
+
+			munmap(ptr, length);
+
+			if (valid && end < length) {
+				std::cout << "Removed " << length - end << " bytes of incomplete chunks from the end of track log " << fname << std::endl;
+				if (ftruncate(fd, end) != 0) {
+					std::cout << "Error truncating track log " << fname << std::endl;
+					valid = false;
+				}
+			}
+
+			::close(fd);
+			return valid;
+		}
+
+		/**
+		 * @brief Writer thread, swaps the pending buffer and writes it in chunks.
+		 */
+		void run() {
+			std::vector<TrackRecord> batch;
+			std::vector<uint8_t> trajectories;
+
+			while (true) {
+				bool finish;
+				{
+					std::unique_lock<std::mutex> lock(this->mutex);
+					this->condition.wait_for(lock, std::chrono::milliseconds(this->flush_interval), [this] {
+						return this->stop || this->pending.size() >= this->chunk_records;
+					});
+
+					batch.swap(this->pending);
+					trajectories.swap(this->pending_trajectories);
+					finish = this->stop;
+				}
+
+				this->write(batch);
+				batch.clear();
+
+				this->writeTrajectories(trajectories);
+				trajectories.clear();
+
+				if (finish) {
+					break;
+				}
+			}
+		}
+
+		/**
+		 * @brief Write a batch of records as one or more chunks.
+		 */
+		void write(std::vector<TrackRecord> &batch) {
+			if (batch.empty() || !this->file.is_open()) {
+				return;
+			}
+
+			for (size_t start = 0; start < batch.size(); start += this->chunk_records) {
+				size_t count = std::min(this->chunk_records, batch.size() - start);
+
+				TrackChunkHeader header;
+				header.magic = TRACK_CHUNK_MAGIC;
+				header.type = records_chunk;
+				header.count = count;
+				header.size = count * sizeof(TrackRecord);
+				header.first_timestamp = batch[start].timestamp;
+				header.last_timestamp = batch[start + count - 1].timestamp;
+
+				this->file.write((const char *)&header, sizeof(header));
+				this->file.write((const char *)&batch[start], header.size);
+				this->written += count;
+			}
+
+			this->file.flush();
+		}
+
+		/**
+		 * @brief Write a batch of trajectory entries as a single chunk.
+		 */
+		void writeTrajectories(const std::vector<uint8_t> &entries) {
+			if (entries.empty() || !this->file.is_open()) {
+				return;
+			}
+
+			TrackChunkHeader header;
+			header.magic = TRACK_CHUNK_MAGIC;
+			header.type = trajectories_chunk;
+			header.count = 0;
+			header.size = entries.size();
+			header.first_timestamp = INT64_MAX;
+			header.last_timestamp = INT64_MIN;
+
+			for (size_t offset = 0; offset < entries.size();) {
+				TrajectoryEntry entry;
+				memcpy(&entry, &entries[offset], sizeof(entry));
+				header.first_timestamp = std::min(header.first_timestamp, entry.first_timestamp);
+				header.last_timestamp = std::max(header.last_timestamp, entry.last_timestamp);
+				header.count++;
+				offset += sizeof(TrajectoryEntry) + entry.size;
+			}
+
+			// Key points have a variable size, padding keeps the records of the next chunk aligned (readers stop before a padding shorter than an entry)
+			static const uint8_t padding[8] = {0};
+			size_t padded = (entries.size() + 7) / 8 * 8;
+			header.size = padded;
+
+			this->file.write((const char *)&header, sizeof(header));
+			this->file.write((const char *)entries.data(), entries.size());
+			this->file.write((const char *)padding, padded - entries.size());
+			this->file.flush();
+		}
+};
+
+/**
+ * @brief Chunk of records in a memory-mapped track log.
+ */
+struct TrackChunk {
+	/**
+	 * @brief Copy of the chunk header, chunks of older files are not always aligned.
+	 */
+	TrackChunkHeader header;
+
+	/**
+	 * @brief Pointer to the chunk data in the mapped file.
+	 */
+	const uint8_t *data;
+
+	/**
+	 * @brief Offset of the chunk in the file.
+	 */
+	size_t offset;
+
+	/**
+	 * @brief Number of session chunks before this chunk, track identifiers are unique within a session.
+	 */
+	uint32_t session;
+};
+
+/**
+ * @brief Reader for track log files, the file is memory-mapped and records are copied out one at a time (older files do not align the chunks).
+ */
+class TrackLogReader {
+	public:
+		/**
+		 * @brief Header of the file.
+		 */
+		TrackLogHeader header;
+
+		/**
+		 * @brief Chunks found in the file, incomplete chunks (e.g. crash while writing) are skipped.
+		 */
+		std::vector<TrackChunk> chunks;
+
+		/**
+		 * @brief Total number of records in the file.
+		 */
+		size_t count = 0;
+
+		/**
+		 * @brief Map a log file into memory and index its chunks.
+		 *
+		 * @param fname Path of the log file.
+		 */
+		TrackLogReader(std::string fname) {
+			int fd = open(fname.c_str(), O_RDONLY);
+			if (fd < 0) {
+				std::cout << "Error opening track log " << fname << std::endl;
+				return;
+			}
+
+			struct stat st;
+			if (fstat(fd, &st) != 0 || st.st_size < (off_t)trackLogHeaderSize(1)) {
+				std::cout << "Invalid track log " << fname << std::endl;
+				::close(fd);
+				return;
+			}
+
+			void *ptr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			::close(fd);
+
+			if (ptr == MAP_FAILED) {
+				std::cout << "Error mapping track log " << fname << std::endl;
+				return;
+			}
+
+			this->data = (const uint8_t *)ptr;
+			this->length = st.st_size;
+			madvise(ptr, this->length, MADV_SEQUENTIAL);
+
+			// Version 1 headers have no time base
+			memset(&this->header, 0, sizeof(TrackLogHeader));
+			memcpy(&this->header, this->data, std::min(this->length, sizeof(TrackLogHeader)));
+			if (this->header.version < 2) {
+				this->header.time_origin = 0;
+			}
+
+			if (memcmp(this->header.magic, TRACK_LOG_MAGIC, 4) != 0 || this->header.record_size < sizeof(TrackRecord) || this->length < trackLogHeaderSize(this->header.version)) {
+				std::cout << "Invalid track log " << fname << std::endl;
+				this->close();
+				return;
+			}
+
+			if (this->header.version < 1 || this->header.version > TRACK_LOG_VERSION) {
+				std::cout << "Track log " << fname << " has unsupported version " << this->header.version << std::endl;
+				this->close();
+				return;
+			}
+
+			this->index();
+		}
+
+		~TrackLogReader() {
+			this->close();
+		}
+
+		TrackLogReader(const TrackLogReader &) = delete;
+		TrackLogReader &operator=(const TrackLogReader &) = delete;
+
+		/**
+		 * @brief Check if the file was mapped successfully.
+		 */
+		bool isOpen() {
+			return this->data != nullptr;
+		}
+
+		/**
+		 * @brief Size of the mapped file in bytes.
+		 */
+		size_t size() const {
+			return this->length;
+		}
+
+		/**
+		 * @brief Get a record from a chunk.
+		 *
+		 * @param chunk Chunk to read from.
+		 * @param i Index of the record in the chunk.
+		 */
+		TrackRecord record(const TrackChunk &chunk, size_t i) const {
+			TrackRecord record;
+			memcpy(&record, chunk.data + i * this->header.record_size, sizeof(TrackRecord));
+			return record;
+		}
+
+		/**
+		 * @brief Iterate all records in the file.
+		 *
+		 * @param callback Function called for each record.
+		 */
+		template <typename Function>
+		void forEach(Function callback) const {
+			this->forEach(INT64_MIN, INT64_MAX, callback);
+		}
+
+		/**
+		 * @brief Iterate records in a time range, chunks outside of the range are skipped.
+		 *
+		 * @param start Minimum timestamp (inclusive).
+		 * @param end Maximum timestamp (inclusive).
+		 * @param callback Function called for each record.
+		 */
+		template <typename Function>
+		void forEach(int64_t start, int64_t end, Function callback) const {
+			for (const TrackChunk &chunk : this->chunks) {
+				if (chunk.header.type != records_chunk || chunk.header.last_timestamp < start || chunk.header.first_timestamp > end) {
+					continue;
+				}
+
+				for (uint32_t i = 0; i < chunk.header.count; i++) {
+					TrackRecord record = this->record(chunk, i);
+					if (record.timestamp >= start && record.timestamp <= end) {
+						callback(record);
+					}
+				}
+			}
+		}
+
+		/**
+		 * @brief Iterate the compressed trajectories of the tracks that overlap a time range.
+		 *
+		 * @param start Minimum timestamp (inclusive).
+		 * @param end Maximum timestamp (inclusive).
+		 * @param callback Function called with the entry and the decoded key points of each trajectory.
+		 */
+		template <typename Function>
+		void forEachTrajectory(int64_t start, int64_t end, Function callback) const {
+			for (const TrackChunk &chunk : this->chunks) {
+				if (chunk.header.type != trajectories_chunk || chunk.header.last_timestamp < start || chunk.header.first_timestamp > end) {
+					continue;
+				}
+
+				this->forEachTrajectory(chunk, [&](const TrajectoryEntry &entry, const std::vector<TrajectoryPoint> &points) {
+					if (entry.last_timestamp >= start && entry.first_timestamp <= end) {
+						callback(entry, points);
+					}
+				});
+			}
+		}
+
+		/**
+		 * @brief Iterate the compressed trajectories of a trajectories chunk.
+		 *
+		 * @param chunk Chunk to read from.
+		 * @param callback Function called with the entry and the decoded key points of each trajectory.
+		 */
+		template <typename Function>
+		void forEachTrajectory(const TrackChunk &chunk, Function callback) const {
+			for (size_t offset = 0; offset + sizeof(TrajectoryEntry) <= chunk.header.size;) {
+				TrajectoryEntry entry;
+				memcpy(&entry, chunk.data + offset, sizeof(entry));
+				offset += sizeof(TrajectoryEntry);
+
+				if (offset + entry.size > chunk.header.size) {
+					break;
+				}
+
+				callback(entry, Trajectory::decode(chunk.data + offset, entry.size));
+				offset += entry.size;
+			}
+		}
+
+		/**
+		 * @brief Unmap the file.
+		 */
+		void close() {
+			if (this->data != nullptr) {
+				munmap((void *)this->data, this->length);
+				this->data = nullptr;
+				this->length = 0;
+			}
+
+			this->chunks.clear();
+			this->count = 0;
+		}
+
+	private:
+		const uint8_t *data = nullptr;
+
+		size_t length = 0;
+
+		/**
+		 * @brief Walk the chunk headers to build the chunk list.
+		 */
+		void index() {
+			uint32_t session = 0;
+
+			scanTrackChunks(this->data, this->length, trackLogHeaderSize(this->header.version), this->header.record_size, [this, &session](size_t offset) {
+				TrackChunk chunk;
+				memcpy(&chunk.header, this->data + offset, sizeof(TrackChunkHeader));
+				chunk.data = this->data + offset + sizeof(TrackChunkHeader);
+				chunk.offset = offset;
+
+				if (chunk.header.type == session_chunk) {
+					session++;
+				}
+				chunk.session = session;
+
+				this->chunks.push_back(chunk);
+
+				if (chunk.header.type == records_chunk) {
+					this->count += chunk.header.count;
+				}
+			});
+		}
+};
@@ -0,0 +1,1339 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <future>
+#include <thread>
+#include <algorithm>
+#include <memory>
+#include <type_traits>
+#include <tuple>
+#include <cstdio>
+#include <cstdint>
+#include <math.h>
+
+#include "track_log.cpp"
+
+#pragma once
+
+/**
+ * @brief Point in image coordinates used by queries.
+ */
+struct QueryPoint {
+	float x;
+	float y;
+};
+
+/**
+ * @brief Polygon region of the image used to filter and group records.
+ */
+class QueryPolygon {
+	public:
+		/**
+		 * @brief Vertices of the polygon.
+		 */
+		std::vector<QueryPoint> points;
+
+		/**
+		 * @brief Bounding box of the polygon.
+		 */
+		float min_x = 0, min_y = 0, max_x = 0, max_y = 0;
+
+		QueryPolygon() {}
+
+		QueryPolygon(std::vector<QueryPoint> points) {
+			this->points = points;
+			this->updateBounds();
+		}
+
+		/**
+		 * @brief Check if the polygon has any points, an empty polygon matches the whole image.
+		 */
+		bool empty() const {
+			return this->points.size() < 3;
+		}
+
+		/**
+		 * @brief Recalculate the bounding box of the polygon.
+		 */
+		void updateBounds() {
+			if (this->points.empty()) {
+				return;
+			}
+
+			min_x = max_x = this->points[0].x;
+			min_y = max_y = this->points[0].y;
+
+			for (const QueryPoint &p : this->points) {
+				min_x = std::min(min_x, p.x);
+				min_y = std::min(min_y, p.y);
+				max_x = std::max(max_x, p.x);
+				max_y = std::max(max_y, p.y);
+			}
+		}
+
+		/**
+		 * @brief Check if a point is inside of the polygon (even-odd rule).
+		 */
+		bool contains(float x, float y) const {
+			if (x < min_x || x > max_x || y < min_y || y > max_y) {
+				return false;
+			}
+
+			bool inside = false;
+			size_t n = this->points.size();
+
+			for (size_t i = 0, j = n - 1; i < n; j = i++) {
+				const QueryPoint &a = this->points[i];
+				const QueryPoint &b = this->points[j];
+
+				if ((a.y > y) != (b.y > y) && x < (b.x - a.x) * (y - a.y) / (b.y - a.y) + a.x) {
+					inside = !inside;
+				}
+			}
+
+			return inside;
+		}
+
+		/**
+		 * @brief Check if a rectangle is completely inside of the polygon.
+		 *
+		 * All corners must be inside and no edge of the polygon can cross the rectangle.
+		 */
+		bool containsRect(float x, float y, float width, float height) const {
+			if (!this->contains(x, y) || !this->contains(x + width, y) || !this->contains(x, y + height) || !this->contains(x + width, y + height)) {
+				return false;
+			}
+
+			size_t n = this->points.size();
+			for (size_t i = 0, j = n - 1; i < n; j = i++) {
+				if (segmentIntersectsRect(this->points[j], this->points[i], x, y, width, height)) {
+					return false;
+				}
+			}
+
+			return true;
+		}
+
+		/**
+		 * @brief Check if a rectangle intersects the polygon.
+		 *
+		 * A corner of the rectangle is inside of the polygon, a vertex of the polygon is inside of the rectangle or an edge crosses the rectangle.
+		 */
+		bool intersectsRect(float x, float y, float width, float height) const {
+			if (!this->intersectsBounds(x, y, width, height)) {
+				return false;
+			}
+
+			if (this->contains(x, y) || this->contains(x + width, y) || this->contains(x, y + height) || this->contains(x + width, y + height)) {
+				return true;
+			}
+
+			size_t n = this->points.size();
+			for (size_t i = 0, j = n - 1; i < n; j = i++) {
+				const QueryPoint &p = this->points[i];
+				if ((p.x >= x && p.x <= x + width && p.y >= y && p.y <= y + height) || segmentIntersectsRect(this->points[j], p, x, y, width, height)) {
+					return true;
+				}
+			}
+
+			return false;
+		}
+
+		/**
+		 * @brief Check if a rectangle intersects the bounding box of the polygon.
+		 */
+		bool intersectsBounds(float x, float y, float width, float height) const {
+			return !(x > max_x || x + width < min_x || y > max_y || y + height < min_y);
+		}
+
+	private:
+		/**
+		 * @brief Check if a segment crosses the interior of a rectangle.
+		 */
+		static bool segmentIntersectsRect(QueryPoint a, QueryPoint b, float x, float y, float width, float height) {
+			// Liang-Barsky clipping
+			float t0 = 0.0, t1 = 1.0;
+			float dx = b.x - a.x, dy = b.y - a.y;
+			float p[4] = {-dx, dx, -dy, dy};
+			float q[4] = {a.x - x, x + width - a.x, a.y - y, y + height - a.y};
+
+			for (int i = 0; i < 4; i++) {
+				if (p[i] == 0) {
+					if (q[i] <= 0) {
+						return false;
+					}
+					continue;
+				}
+
+				float t = q[i] / p[i];
+				if (p[i] < 0) {
+					t0 = std::max(t0, t);
+				} else {
+					t1 = std::min(t1, t);
+				}
+
+				if (t0 >= t1) {
+					return false;
+				}
+			}
+
+			return true;
+		}
+};
+
+/**
+ * @brief Filter applied to the records of a query.
+ */
+class TrackQuery {
+	public:
+		/**
+		 * @brief Time range of the query in milliseconds (inclusive).
+		 */
+		int64_t start = INT64_MIN;
+		int64_t end = INT64_MAX;
+
+		/**
+		 * @brief Time of day window in milliseconds since midnight, disabled if negative. Used to query the same hours across several days.
+		 */
+		int64_t day_start = -1;
+		int64_t day_end = -1;
+
+		/**
+		 * @brief Offset in milliseconds added to timestamps to obtain local time of day.
+		 */
+		int64_t timezone_offset = 0;
+
+		/**
+		 * @brief Region of the image, empty polygon matches all positions.
+		 */
+		QueryPolygon polygon;
+
+		/**
+		 * @brief Speed range in kph.
+		 */
+		float min_speed = -INFINITY;
+		float max_speed = INFINITY;
+
+		/**
+		 * @brief Category to be matched, negative value matches all categories.
+		 */
+		int category = -1;
+
+		/**
+		 * @brief Camera to be matched, negative value matches all cameras.
+		 */
+		int64_t camera = -1;
+
+		/**
+		 * @brief Check if a timestamp is within the time of day window.
+		 */
+		bool matchDay(int64_t timestamp) const {
+			if (this->day_start < 0 || this->day_end < 0) {
+				return true;
+			}
+
+			const int64_t day = 86400000;
+			int64_t time = ((timestamp + this->timezone_offset) % day + day) % day;
+
+			if (this->day_start <= this->day_end) {
+				return time >= this->day_start && time <= this->day_end;
+			}
+
+			// Window wraps around midnight
+			return time >= this->day_start || time <= this->day_end;
+		}
+
+		/**
+		 * @brief Check if a record matches the non spatial part of the query.
+		 *
+		 * @param record Record to be checked.
+		 * @param time_origin Time base of the log of the record (TrackLogHeader::time_origin).
+		 */
+		bool matchRecord(const TrackRecord &record, int64_t time_origin = 0) const {
+			int64_t timestamp = record.timestamp + time_origin;
+			return timestamp >= this->start && timestamp <= this->end &&
+				record.speed >= this->min_speed && record.speed <= this->max_speed &&
+				(this->category < 0 || record.category == this->category) &&
+				this->matchDay(timestamp);
+		}
+};
+
+/**
+ * @brief Unique identifier of a track across logs and restarts.
+ *
+ * @param session Session of the track in the index (TrackIndex numbers the sessions of all the logs loaded).
+ * @param id Identifier of the track in its session.
+ */
+inline uint64_t trackKey(uint32_t session, int32_t id) {
+	return ((uint64_t)session << 32) | (uint32_t)id;
+}
+
+/**
+ * @brief Bit of a category in a mask of categories.
+ */
+inline uint32_t categoryBit(int category) {
+	return 1u << std::min(std::max(category, 0), 31);
+}
+
+/**
+ * @brief Label of a grid cell for a query, values >= 0 are cells where all the positions match (e.g. zone of the cell).
+ */
+enum CellLabel : int { cell_outside = -1, cell_boundary = -2 };
+
+/**
+ * @brief Column and row of the cell of positions outside of the grid (e.g. negative coordinates).
+ */
+const uint16_t TRACK_OVERFLOW_CELL = 0xffff;
+
+/**
+ * @brief Cell of the grid of a position.
+ */
+inline void trackCell(float x, float y, int cell_size, uint16_t &column, uint16_t &row) {
+	float c = x / cell_size;
+	float r = y / cell_size;
+
+	if (!(c >= 0 && r >= 0 && c < TRACK_OVERFLOW_CELL && r < TRACK_OVERFLOW_CELL)) {
+		column = row = TRACK_OVERFLOW_CELL;
+		return;
+	}
+
+	// truncation rounds down the non-negative values, without a call to floor
+	column = (uint16_t)c;
+	row = (uint16_t)r;
+}
+
+/**
+ * @brief Labels of the cells of the grid for a query (CellLabel or a label >= 0 when all the positions of the cell match), computed once per query.
+ */
+struct QueryGrid {
+	int cell_size = 64;
+	int columns = 0;
+	int rows = 0;
+	int overflow = cell_boundary;
+	std::vector<int> labels;
+
+	/**
+	 * @brief Label a grid with a function called with (x, y, size) of each cell.
+	 */
+	template <typename Classify>
+	void build(int cell_size, int columns, int rows, Classify classify) {
+		this->cell_size = cell_size;
+		this->columns = columns;
+		this->rows = rows;
+		this->labels.resize(columns * rows);
+
+		for (int row = 0; row < rows; row++) {
+			for (int column = 0; column < columns; column++) {
+				this->labels[row * columns + column] = classify((float)column * cell_size, (float)row * cell_size, (float)cell_size);
+			}
+		}
+
+		// the overflow cell can hold any position, so it takes the label of the whole plane
+		const float plane = 1e9f;
+		this->overflow = classify(-plane, -plane, 2 * plane);
+	}
+
+	/**
+	 * @brief Label of a cell, positions outside of the grid share the label of the overflow cell.
+	 */
+	int label(uint16_t column, uint16_t row) const {
+		if (column >= this->columns || row >= this->rows) {
+			return this->overflow;
+		}
+
+		return this->labels[row * this->columns + column];
+	}
+};
+
+/**
+ * @brief Records of a track in the cells of a chunk that a query resolved without reading them.
+ */
+struct ResolvedTrack {
+	uint32_t records = 0;
+
+	float max_speed = -INFINITY;
+
+	/**
+	 * @brief First and last timestamp of the track in the resolved cells, with the label of their cells.
+	 */
+	int64_t first_timestamp = INT64_MAX;
+	int first_label = cell_outside;
+	int64_t last_timestamp = INT64_MIN;
+	int last_label = cell_outside;
+};
+
+/**
+ * @brief Magic value at the start of an index file.
+ */
+const char TRACK_INDEX_MAGIC[4] = {'S', 'M', 'T', 'I'};
+
+/**
+ * @brief Version of the index file format.
+ */
+const uint32_t TRACK_INDEX_VERSION = 2;
+
+/**
+ * @brief Header of an index file (<log>.idx), followed by a ChunkSummary, its TrackSummary and its CellTrack entries for each chunk.
+ */
+struct TrackIndexHeader {
+	char magic[4];
+
+	uint32_t version;
+
+	/**
+	 * @brief Size of the log file when the index was written.
+	 */
+	uint64_t log_size;
+
+	/**
+	 * @brief Number of chunks summarized.
+	 */
+	uint32_t chunks;
+
+	/**
+	 * @brief Size of the grid cells in pixels.
+	 */
+	uint32_t cell_size;
+};
+
+/**
+ * @brief Summary of the records of a track in a chunk.
+ */
+struct TrackSummary {
+	int32_t id;
+
+	/**
+	 * @brief Category of the last record of the track.
+	 */
+	int32_t category;
+
+	/**
+	 * @brief Mask of the categories of the records (categoryBit).
+	 */
+	uint32_t categories;
+
+	uint32_t records;
+
+	float min_speed;
+	float max_speed;
+};
+
+/**
+ * @brief Summary of the records of a chunk.
+ *
+ * Used to skip the chunks that cannot match a query, and to answer counts with the track summaries when all the records of a chunk match.
+ */
+struct ChunkSummary {
+	/**
+	 * @brief Offset of the chunk in the log file.
+	 */
+	uint64_t offset;
+
+	/**
+	 * @brief Type and count of the chunk header, used to check that a saved summary still matches the log.
+	 */
+	uint32_t type;
+	uint32_t count;
+
+	/**
+	 * @brief Range of the timestamps of the records (time base of the log).
+	 */
+	int64_t min_timestamp;
+	int64_t max_timestamp;
+
+	/**
+	 * @brief Bounding box of the positions.
+	 */
+	float min_x;
+	float min_y;
+	float max_x;
+	float max_y;
+
+	float min_speed;
+	float max_speed;
+
+	/**
+	 * @brief Mask of the categories of the records (categoryBit).
+	 */
+	uint32_t categories;
+
+	uint32_t records;
+
+	/**
+	 * @brief Number of TrackSummary entries.
+	 */
+	uint32_t tracks;
+
+	/**
+	 * @brief Number of CellTrack entries.
+	 */
+	uint32_t cells;
+};
+
+/**
+ * @brief Records of a track in a cell of the spatial grid of a chunk.
+ *
+ * Queries resolve the cells completely inside or outside of their polygons (and O/D zones) from these entries, only the records of the cells on a border are read.
+ */
+struct CellTrack {
+	uint16_t column;
+	uint16_t row;
+
+	/**
+	 * @brief Index of the track in the TrackSummary entries of the chunk.
+	 */
+	uint32_t track;
+
+	uint32_t records;
+
+	float min_speed;
+	float max_speed;
+
+	uint32_t reserved;
+
+	/**
+	 * @brief Timestamps of the first and last record of the track in the cell (time base of the log).
+	 */
+	int64_t first_timestamp;
+	int64_t last_timestamp;
+};
+
+static_assert(sizeof(TrackIndexHeader) == 24, "Track index header must be 24 bytes.");
+static_assert(sizeof(TrackSummary) == 24, "Track summary must be 24 bytes.");
+static_assert(sizeof(ChunkSummary) == 72, "Chunk summary must be 72 bytes.");
+static_assert(sizeof(CellTrack) == 40, "Cell track must be 40 bytes.");
+
+/**
+ * @brief Chunk of records in the index, the records stay in the mapped log file.
+ *
+ * Trajectories chunks (logs written with --compact-log) are decoded into one record per key point, with the maximum speed of the track as speed.
+ */
+class IndexedChunk {
+	public:
+		ChunkSummary summary;
+
+		/**
+		 * @brief Summary of each track of the chunk, sorted by identifier.
+		 */
+		std::vector<TrackSummary> tracks;
+
+		/**
+		 * @brief Records of each track in each cell of the grid, sorted by row, column and track.
+		 */
+		std::vector<CellTrack> cells;
+
+		/**
+		 * @brief Size of the grid cells in pixels.
+		 */
+		int cell_size = 64;
+
+		uint32_t camera = 0;
+
+		/**
+		 * @brief Session of the chunk in the index.
+		 */
+		uint32_t session = 0;
+
+		/**
+		 * @brief Time base of the log, added to the timestamps.
+		 */
+		int64_t time_origin = 0;
+
+		/**
+		 * @brief Records of the chunk in the mapped file.
+		 */
+		const uint8_t *data = nullptr;
+
+		uint32_t record_size = sizeof(TrackRecord);
+
+		/**
+		 * @brief Records decoded from the trajectories of a trajectories chunk, used instead of the data.
+		 */
+		std::vector<TrackRecord> decoded;
+
+		/**
+		 * @brief Number of records.
+		 */
+		size_t size = 0;
+
+		TrackRecord record(size_t i) const {
+			if (!this->decoded.empty()) {
+				return this->decoded[i];
+			}
+
+			// Chunks of older files are not always aligned
+			TrackRecord record;
+			memcpy(&record, this->data + i * this->record_size, sizeof(TrackRecord));
+			return record;
+		}
+
+		/**
+		 * @brief Decode the key points of the trajectories of a chunk into records.
+		 */
+		void decode(const TrackLogReader &log, const TrackChunk &chunk) {
+			this->decoded.clear();
+
+			log.forEachTrajectory(chunk, [this](const TrajectoryEntry &entry, const std::vector<TrajectoryPoint> &points) {
+				TrackRecord record;
+				memset(&record, 0, sizeof(record));
+				record.id = entry.id;
+				record.category = entry.category;
+				record.speed = entry.max_speed / 10.0f;
+
+				for (const TrajectoryPoint &point : points) {
+					record.timestamp = point.timestamp;
+					record.x = point.x;
+					record.y = point.y;
+					this->decoded.push_back(record);
+				}
+			});
+
+			this->size = this->decoded.size();
+		}
+
+		/**
+		 * @brief Compute the summary from the records, offset, type and count must be set.
+		 */
+		void summarize() {
+			ChunkSummary &summary = this->summary;
+			summary.min_timestamp = INT64_MAX;
+			summary.max_timestamp = INT64_MIN;
+			summary.min_x = summary.min_y = summary.min_speed = INFINITY;
+			summary.max_x = summary.max_y = summary.max_speed = -INFINITY;
+			summary.categories = 0;
+			summary.records = this->size;
+
+			std::map<int32_t, TrackSummary> tracks;
+			std::map<std::tuple<uint16_t, uint16_t, int32_t>, CellTrack> cells;
+
+			for (size_t i = 0; i < this->size; i++) {
+				TrackRecord record = this->record(i);
+
+				summary.min_timestamp = std::min(summary.min_timestamp, record.timestamp);
+				summary.max_timestamp = std::max(summary.max_timestamp, record.timestamp);
+				summary.min_x = std::min(summary.min_x, record.x);
+				summary.min_y = std::min(summary.min_y, record.y);
+				summary.max_x = std::max(summary.max_x, record.x);
+				summary.max_y = std::max(summary.max_y, record.y);
+				summary.min_speed = std::min(summary.min_speed, record.speed);
+				summary.max_speed = std::max(summary.max_speed, record.speed);
+				summary.categories |= categoryBit(record.category);
+
+				auto it = tracks.find(record.id);
+				if (it == tracks.end()) {
+					it = tracks.emplace(record.id, TrackSummary{record.id, record.category, 0, 0, INFINITY, -INFINITY}).first;
+				}
+
+				TrackSummary &track = it->second;
+				track.category = record.category;
+				track.categories |= categoryBit(record.category);
+				track.records++;
+				track.min_speed = std::min(track.min_speed, record.speed);
+				track.max_speed = std::max(track.max_speed, record.speed);
+
+				uint16_t column, row;
+				trackCell(record.x, record.y, this->cell_size, column, row);
+
+				auto cell = cells.find(std::make_tuple(row, column, record.id));
+				if (cell == cells.end()) {
+					cell = cells.emplace(std::make_tuple(row, column, record.id), CellTrack{column, row, 0, 0, INFINITY, -INFINITY, 0, INT64_MAX, INT64_MIN}).first;
+				}
+
+				CellTrack &entry = cell->second;
+				entry.records++;
+				entry.min_speed = std::min(entry.min_speed, record.speed);
+				entry.max_speed = std::max(entry.max_speed, record.speed);
+				entry.first_timestamp = std::min(entry.first_timestamp, record.timestamp);
+				entry.last_timestamp = std::max(entry.last_timestamp, record.timestamp);
+			}
+
+			this->tracks.clear();
+			for (auto &track : tracks) {
+				this->tracks.push_back(track.second);
+			}
+			summary.tracks = this->tracks.size();
+
+			// Tracks are numbered in identifier order, the cells stay sorted by row, column and track
+			this->cells.clear();
+			for (auto &cell : cells) {
+				cell.second.track = this->findTrack(std::get<2>(cell.first));
+				this->cells.push_back(cell.second);
+			}
+			summary.cells = this->cells.size();
+		}
+
+		/**
+		 * @brief Index of a track in the track summaries.
+		 */
+		size_t findTrack(int32_t id) const {
+			auto it = std::lower_bound(this->tracks.begin(), this->tracks.end(), id, [](const TrackSummary &track, int32_t id) {
+				return track.id < id;
+			});
+			return it - this->tracks.begin();
+		}
+
+		/**
+		 * @brief Check if some records of the chunk can match a query.
+		 */
+		bool intersects(const TrackQuery &query) const {
+			const ChunkSummary &summary = this->summary;
+
+			if (summary.records == 0 || (query.camera >= 0 && this->camera != query.camera)) {
+				return false;
+			}
+			if (summary.max_timestamp + this->time_origin < query.start || summary.min_timestamp + this->time_origin > query.end) {
+				return false;
+			}
+			if (summary.max_speed < query.min_speed || summary.min_speed > query.max_speed) {
+				return false;
+			}
+			if (query.category >= 0 && (summary.categories & categoryBit(query.category)) == 0) {
+				return false;
+			}
+
+			return query.polygon.empty() || query.polygon.intersectsBounds(summary.min_x, summary.min_y, summary.max_x - summary.min_x, summary.max_y - summary.min_y);
+		}
+
+		/**
+		 * @brief Resolve the tracks of the chunk from its cells for a query, without reading the records.
+		 *
+		 * A track matches when all its records in the chunk match the non spatial part of the query, the records of a matching track in the cells with a label >= 0 are resolved.
+		 *
+		 * @param query Query to be executed.
+		 * @param grid Labels of the cells for the query.
+		 * @param status Status of each track: 0 no record matches, 1 all records match, 2 records have to be tested.
+		 * @param resolved Records resolved of each track.
+		 * @return True if the records of some cells have to be read (see scan()).
+		 */
+		bool resolve(const TrackQuery &query, const QueryGrid &grid, std::vector<uint8_t> &status, std::vector<ResolvedTrack> &resolved) const {
+			const ChunkSummary &summary = this->summary;
+			bool covered = (query.day_start < 0 || query.day_end < 0) && summary.min_timestamp + this->time_origin >= query.start && summary.max_timestamp + this->time_origin <= query.end;
+
+			status.resize(this->tracks.size());
+			resolved.assign(this->tracks.size(), ResolvedTrack());
+
+			for (size_t t = 0; t < this->tracks.size(); t++) {
+				const TrackSummary &track = this->tracks[t];
+
+				if (track.max_speed < query.min_speed || track.min_speed > query.max_speed || (query.category >= 0 && (track.categories & categoryBit(query.category)) == 0)) {
+					status[t] = 0;
+				} else if (covered && track.min_speed >= query.min_speed && track.max_speed <= query.max_speed && (query.category < 0 || track.categories == categoryBit(query.category))) {
+					status[t] = 1;
+				} else {
+					status[t] = 2;
+				}
+			}
+
+			bool partial = false;
+			for (const CellTrack &cell : this->cells) {
+				int label = grid.label(cell.column, cell.row);
+				if (label == cell_outside || status[cell.track] == 0) {
+					continue;
+				}
+
+				if (label < 0 || status[cell.track] != 1) {
+					partial = true;
+					continue;
+				}
+
+				ResolvedTrack &track = resolved[cell.track];
+				track.records += cell.records;
+				track.max_speed = std::max(track.max_speed, cell.max_speed);
+				if (cell.first_timestamp < track.first_timestamp) {
+					track.first_timestamp = cell.first_timestamp;
+					track.first_label = label;
+				}
+				if (cell.last_timestamp > track.last_timestamp) {
+					track.last_timestamp = cell.last_timestamp;
+					track.last_label = label;
+				}
+			}
+
+			return partial;
+		}
+
+		/**
+		 * @brief Visit the records of the chunk that match a query.
+		 */
+		template <typename Function>
+		void scan(const TrackQuery &query, Function callback) const {
+			bool inside = query.polygon.empty() || query.polygon.containsRect(this->summary.min_x, this->summary.min_y, this->summary.max_x - this->summary.min_x, this->summary.max_y - this->summary.min_y);
+
+			for (size_t i = 0; i < this->size; i++) {
+				TrackRecord record = this->record(i);
+				if (!query.matchRecord(record, this->time_origin)) {
+					continue;
+				}
+
+				if (!inside && !query.polygon.contains(record.x, record.y)) {
+					continue;
+				}
+
+				callback(record);
+			}
+		}
+
+		/**
+		 * @brief Visit the records that match a query and were not resolved by resolve().
+		 */
+		template <typename Function>
+		void scan(const TrackQuery &query, const QueryGrid &grid, const std::vector<uint8_t> &status, Function callback) const {
+			bool all_match = std::all_of(status.begin(), status.end(), [](uint8_t s) { return s == 1; });
+
+			for (size_t i = 0; i < this->size; i++) {
+				TrackRecord record = this->record(i);
+				if (!query.matchRecord(record, this->time_origin)) {
+					continue;
+				}
+
+				uint16_t column, row;
+				trackCell(record.x, record.y, this->cell_size, column, row);
+
+				int label = grid.label(column, row);
+				if (label == cell_outside) {
+					continue;
+				}
+
+				if (label >= 0) {
+					// Cell inside, the record was resolved if its track matches completely
+					if (all_match || status[this->findTrack(record.id)] == 1) {
+						continue;
+					}
+				} else if (!query.polygon.empty() && !query.polygon.contains(record.x, record.y)) {
+					continue;
+				}
+
+				callback(record);
+			}
+		}
+};
+
+/**
+ * @brief Result of a count query, number of distinct tracks per category.
+ */
+struct CountResult {
+	size_t tracks = 0;
+	size_t records = 0;
+	std::map<int, size_t> categories;
+};
+
+/**
+ * @brief Result of a speed histogram query, tracks are counted by their maximum speed in the query.
+ */
+struct HistogramResult {
+	float bin_size = 10.0;
+	std::vector<size_t> bins;
+};
+
+/**
+ * @brief Result of a origin/destination query, number of tracks that started in zone (row) and ended in zone (column).
+ */
+struct ODResult {
+	size_t zones = 0;
+	std::vector<size_t> matrix;
+
+	size_t at(size_t origin, size_t destination) const {
+		return this->matrix[origin * this->zones + destination];
+	}
+};
+
+/**
+ * @brief Index over a set of track logs, built from the chunks of the logs and their summaries.
+ *
+ * Log files are kept memory mapped, a query only reads the records of the chunks that can match it. Summaries are saved next to each log (<log>.idx) so that loading a log again only reads the chunks appended since.
+ *
+ * Each chunk summary has a coarse spatial grid (records of each track in each cell), polygon, count, histogram and O/D queries take the cells completely inside or outside of their regions from the grid and only read the records of the cells on a border.
+ */
+class TrackIndex {
+	public:
+		/**
+		 * @brief Number of threads used to run queries.
+		 */
+		unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+
+		/**
+		 * @brief Read and write the summaries in an index file next to each log.
+		 */
+		bool save_summaries = true;
+
+		/**
+		 * @brief Size of the spatial grid cells in pixels, index files written with another size are rebuilt.
+		 */
+		int cell_size = 64;
+
+		/**
+		 * @brief Logs loaded in the index.
+		 */
+		std::vector<std::unique_ptr<TrackLogReader>> logs;
+
+		/**
+		 * @brief Chunks of the index in the order of the logs.
+		 */
+		std::vector<IndexedChunk> chunks;
+
+		/**
+		 * @brief Load a log file into the index.
+		 *
+		 * @param fname Path of the log file.
+		 * @return True if the file was loaded.
+		 */
+		bool load(std::string fname) {
+			std::unique_ptr<TrackLogReader> log(new TrackLogReader(fname));
+			if (!log->isOpen()) {
+				return false;
+			}
+
+			std::vector<IndexedChunk> saved;
+			if (this->save_summaries) {
+				this->readSummaries(fname + ".idx", log->size(), saved);
+			}
+
+			// Trajectories are only used for the sessions without records (--compact-log)
+			std::unordered_set<uint32_t> recorded;
+			for (const TrackChunk &chunk : log->chunks) {
+				if (chunk.header.type == records_chunk) {
+					recorded.insert(chunk.session);
+				}
+			}
+
+			size_t first = this->chunks.size();
+			size_t next = 0;
+			size_t summarized = 0;
+			uint32_t sessions = 0;
+
+			for (const TrackChunk &chunk : log->chunks) {
+				sessions = std::max(sessions, chunk.session + 1);
+
+				bool trajectories = chunk.header.type == trajectories_chunk && recorded.count(chunk.session) == 0;
+				if (chunk.header.type != records_chunk && !trajectories) {
+					continue;
+				}
+
+				IndexedChunk indexed;
+				indexed.camera = log->header.camera;
+				indexed.session = this->sessions + chunk.session;
+				indexed.time_origin = log->header.time_origin;
+				indexed.data = chunk.data;
+				indexed.record_size = log->header.record_size;
+				indexed.size = chunk.header.count;
+				indexed.cell_size = this->cell_size;
+
+				if (trajectories) {
+					indexed.decode(*log, chunk);
+				}
+
+				// Saved summaries are valid until the first chunk that changed
+				if (next < saved.size() && saved[next].summary.offset == chunk.offset && saved[next].summary.type == chunk.header.type && saved[next].summary.count == chunk.header.count) {
+					indexed.summary = saved[next].summary;
+					indexed.tracks.swap(saved[next].tracks);
+					indexed.cells.swap(saved[next].cells);
+					next++;
+				} else {
+					next = saved.size();
+					indexed.summary.offset = chunk.offset;
+					indexed.summary.type = chunk.header.type;
+					indexed.summary.count = chunk.header.count;
+					indexed.summarize();
+					summarized++;
+				}
+
+				for (const CellTrack &cell : indexed.cells) {
+					if (cell.column != TRACK_OVERFLOW_CELL) {
+						this->columns = std::max(this->columns, cell.column + 1);
+						this->rows = std::max(this->rows, cell.row + 1);
+					}
+				}
+
+				this->chunks.push_back(std::move(indexed));
+			}
+
+			if (this->save_summaries && (summarized > 0 || next < saved.size())) {
+				this->writeSummaries(fname + ".idx", log->size(), first);
+			}
+
+			this->sessions += sessions;
+			this->logs.push_back(std::move(log));
+			return true;
+		}
+
+		/**
+		 * @brief Total number of records indexed.
+		 */
+		size_t size() const {
+			size_t count = 0;
+			for (const IndexedChunk &chunk : this->chunks) {
+				count += chunk.summary.records;
+			}
+			return count;
+		}
+
+		/**
+		 * @brief Run a query in parallel over the chunks that can match it.
+		 *
+		 * Each thread builds its own state with the visit function, states are combined with the merge function.
+		 *
+		 * @param query Query to be executed.
+		 * @param visit Function called with (state, session, record) for each record that matches.
+		 * @param merge Function called with (target, source) to combine the states of the threads.
+		 */
+		template <typename State, typename Visit, typename Merge>
+		State execute(const TrackQuery &query, Visit visit, Merge merge) const {
+			return this->execute<State>(query, nullptr, visit, nullptr, merge);
+		}
+
+		/**
+		 * @brief Run a query in parallel, the cells of the grid completely inside or outside of the query polygon are resolved from the chunk summaries.
+		 *
+		 * @param query Query to be executed.
+		 * @param visit Function called with (state, session, record) for each record that matches and was not resolved.
+		 * @param visit_track Function called with (state, session, track summary, resolved records) for each track with records resolved in a chunk.
+		 * @param merge Function called with (target, source) to combine the states of the threads.
+		 */
+		template <typename State, typename Visit, typename VisitTrack, typename Merge>
+		State execute(const TrackQuery &query, Visit visit, VisitTrack visit_track, Merge merge) const {
+			return this->execute<State>(query, [&query](float x, float y, float size) {
+				return classifyCell(query.polygon, x, y, size);
+			}, visit, visit_track, merge);
+		}
+
+		/**
+		 * @brief Run a query in parallel, cells of the grid are labelled by a classify function and the records of the labelled cells are resolved from the chunk summaries.
+		 *
+		 * @param query Query to be executed.
+		 * @param classify Function called with (x, y, size) of each cell, returns a label >= 0 when all the positions of the cell match the query (e.g. zone of the cell), cell_outside when none match and cell_boundary when the positions have to be tested.
+		 * @param visit Function called with (state, session, record) for each record that matches and was not resolved.
+		 * @param visit_track Function called with (state, session, track summary, resolved records) for each track with records resolved in a chunk, null to always visit the records.
+		 * @param merge Function called with (target, source) to combine the states of the threads.
+		 */
+		template <typename State, typename Classify, typename Visit, typename VisitTrack, typename Merge>
+		State execute(const TrackQuery &query, Classify classify, Visit visit, VisitTrack visit_track, Merge merge) const {
+			std::vector<const IndexedChunk *> selected;
+			for (const IndexedChunk &chunk : this->chunks) {
+				if (chunk.intersects(query)) {
+					selected.push_back(&chunk);
+				}
+			}
+
+			// Cells are labelled once for all the chunks
+			QueryGrid grid;
+			if constexpr (!std::is_same<VisitTrack, std::nullptr_t>::value) {
+				grid.build(this->cell_size, this->columns, this->rows, classify);
+			}
+
+			// Buffers of each worker
+			struct Buffers {
+				std::vector<uint8_t> status;
+				std::vector<ResolvedTrack> resolved;
+			};
+
+			auto process = [&](State &state, const IndexedChunk *chunk, Buffers &buffers) {
+				if constexpr (std::is_same<VisitTrack, std::nullptr_t>::value) {
+					chunk->scan(query, [&](const TrackRecord &record) {
+						visit(state, chunk->session, record);
+					});
+				} else {
+					bool partial = chunk->resolve(query, grid, buffers.status, buffers.resolved);
+
+					for (size_t t = 0; t < buffers.resolved.size(); t++) {
+						if (buffers.resolved[t].records > 0) {
+							visit_track(state, chunk->session, chunk->tracks[t], buffers.resolved[t]);
+						}
+					}
+
+					if (partial) {
+						chunk->scan(query, grid, buffers.status, [&](const TrackRecord &record) {
+							visit(state, chunk->session, record);
+						});
+					}
+				}
+			};
+
+			size_t workers = std::min<size_t>(this->threads, selected.size());
+			if (workers <= 1) {
+				State state;
+				Buffers buffers;
+				for (const IndexedChunk *chunk : selected) {
+					process(state, chunk, buffers);
+				}
+				return state;
+			}
+
+			// Chunks are distributed round robin between the workers
+			std::vector<std::future<State>> futures;
+			for (size_t w = 0; w < workers; w++) {
+				futures.push_back(std::async(std::launch::async, [&, w]() {
+					State state;
+					Buffers buffers;
+					for (size_t i = w; i < selected.size(); i += workers) {
+						process(state, selected[i], buffers);
+					}
+					return state;
+				}));
+			}
+
+			State result = futures[0].get();
+			for (size_t w = 1; w < workers; w++) {
+				State state = futures[w].get();
+				merge(result, state);
+			}
+
+			return result;
+		}
+
+		/**
+		 * @brief Label of a cell for a polygon, 0 when the cell is inside (an empty polygon contains all the cells).
+		 */
+		static int classifyCell(const QueryPolygon &polygon, float x, float y, float size) {
+			if (polygon.empty()) {
+				return 0;
+			}
+			if (!polygon.intersectsRect(x, y, size, size)) {
+				return cell_outside;
+			}
+
+			return polygon.containsRect(x, y, size, size) ? 0 : (int)cell_boundary;
+		}
+
+		/**
+		 * @brief Count the distinct tracks that match a query.
+		 */
+		CountResult count(const TrackQuery &query) const {
+			typedef std::unordered_map<uint64_t, int> Tracks;
+			struct State {
+				Tracks tracks;
+				size_t records = 0;
+			};
+
+			State state = this->execute<State>(query, [](State &state, uint32_t session, const TrackRecord &record) {
+				state.tracks[trackKey(session, record.id)] = record.category;
+				state.records++;
+			}, [](State &state, uint32_t session, const TrackSummary &track, const ResolvedTrack &resolved) {
+				state.tracks[trackKey(session, track.id)] = track.category;
+				state.records += resolved.records;
+			}, [](State &target, State &source) {
+				target.tracks.insert(source.tracks.begin(), source.tracks.end());
+				target.records += source.records;
+			});
+
+			CountResult result;
+			result.tracks = state.tracks.size();
+			result.records = state.records;
+			for (auto &track : state.tracks) {
+				result.categories[track.second]++;
+			}
+
+			return result;
+		}
+
+		/**
+		 * @brief Histogram of the maximum speed of each track that matches a query.
+		 *
+		 * @param query Query to be executed.
+		 * @param bin_size Size of each bin in kph.
+		 * @param bins Number of bins, the last bin accumulates all speeds above.
+		 */
+		HistogramResult speedHistogram(const TrackQuery &query, float bin_size = 10.0, size_t bins = 20) const {
+			typedef std::unordered_map<uint64_t, float> State;
+
+			State speeds = this->execute<State>(query, [](State &state, uint32_t session, const TrackRecord &record) {
+				float &speed = state[trackKey(session, record.id)];
+				speed = std::max(speed, record.speed);
+			}, [](State &state, uint32_t session, const TrackSummary &track, const ResolvedTrack &resolved) {
+				float &speed = state[trackKey(session, track.id)];
+				speed = std::max(speed, resolved.max_speed);
+			}, [](State &target, State &source) {
+				for (auto &track : source) {
+					float &speed = target[track.first];
+					speed = std::max(speed, track.second);
+				}
+			});
+
+			HistogramResult result;
+			result.bin_size = bin_size;
+			result.bins.assign(bins, 0);
+
+			for (auto &track : speeds) {
+				size_t bin = std::min(bins - 1, (size_t)std::max(0.0f, track.second / bin_size));
+				result.bins[bin]++;
+			}
+
+			return result;
+		}
+
+		/**
+		 * @brief Origin/destination matrix between zones for the tracks that match a query.
+		 *
+		 * The origin of a track is the first zone where it was seen and the destination is the last. Cells of the grid inside of a zone are resolved from the chunk summaries, only the records of the cells on the border of a zone are read.
+		 *
+		 * @param query Query to be executed.
+		 * @param zones List of zones, a point belongs to the first zone that contains it.
+		 */
+		ODResult originDestination(const TrackQuery &query, const std::vector<QueryPolygon> &zones) const {
+			struct Visit {
+				int64_t first_timestamp = INT64_MAX;
+				int64_t last_timestamp = INT64_MIN;
+				int origin = -1;
+				int destination = -1;
+			};
+			typedef std::unordered_map<uint64_t, Visit> State;
+
+			// Label of a cell is the zone of all its positions
+			auto classify = [&query, &zones](float x, float y, float size) {
+				int label = classifyCell(query.polygon, x, y, size);
+				if (label != 0) {
+					return label;
+				}
+
+				for (size_t z = 0; z < zones.size(); z++) {
+					if (zones[z].empty()) {
+						continue;
+					}
+
+					int zone = classifyCell(zones[z], x, y, size);
+					if (zone != cell_outside) {
+						return zone == 0 ? (int)z : (int)cell_boundary;
+					}
+				}
+
+				return (int)cell_outside;
+			};
+
+			auto update = [](Visit &visit, int64_t first_timestamp, int64_t last_timestamp, int origin, int destination) {
+				if (first_timestamp < visit.first_timestamp) {
+					visit.first_timestamp = first_timestamp;
+					visit.origin = origin;
+				}
+				if (last_timestamp > visit.last_timestamp) {
+					visit.last_timestamp = last_timestamp;
+					visit.destination = destination;
+				}
+			};
+
+			State visits = this->execute<State>(query, classify, [&zones, &update](State &state, uint32_t session, const TrackRecord &record) {
+				int zone = -1;
+				for (size_t z = 0; z < zones.size(); z++) {
+					if (zones[z].contains(record.x, record.y)) {
+						zone = z;
+						break;
+					}
+				}
+
+				if (zone < 0) {
+					return;
+				}
+
+				update(state[trackKey(session, record.id)], record.timestamp, record.timestamp, zone, zone);
+			}, [&update](State &state, uint32_t session, const TrackSummary &track, const ResolvedTrack &resolved) {
+				update(state[trackKey(session, track.id)], resolved.first_timestamp, resolved.last_timestamp, resolved.first_label, resolved.last_label);
+			}, [&update](State &target, State &source) {
+				for (auto &entry : source) {
+					const Visit &visit = entry.second;
+					update(target[entry.first], visit.first_timestamp, visit.last_timestamp, visit.origin, visit.destination);
+				}
+			});
+
+			ODResult result;
+			result.zones = zones.size();
+			result.matrix.assign(zones.size() * zones.size(), 0);
+
+			for (auto &entry : visits) {
+				const Visit &visit = entry.second;
+				if (visit.origin >= 0 && visit.destination >= 0) {
+					result.matrix[visit.origin * zones.size() + visit.destination]++;
+				}
+			}
+
+			return result;
+		}
+
+	private:
+		/**
+		 * @brief Number of sessions of the logs loaded.
+		 */
+		uint32_t sessions = 0;
+
+		/**
+		 * @brief Size of the grid that covers the cells of all the chunks.
+		 */
+		int columns = 0;
+		int rows = 0;
+
+		/**
+		 * @brief Read the summaries saved in an index file.
+		 *
+		 * @param fname Path of the index file.
+		 * @param log_size Size of the log file, an index written for a larger file is ignored.
+		 * @param saved Chunks with their summary and track summaries.
+		 * @return False if the file does not exist or is not valid.
+		 */
+		bool readSummaries(std::string fname, size_t log_size, std::vector<IndexedChunk> &saved) {
+			std::ifstream file(fname, std::ios::binary);
+			if (!file.is_open()) {
+				return false;
+			}
+
+			TrackIndexHeader header;
+			if (!file.read((char *)&header, sizeof(header)) || memcmp(header.magic, TRACK_INDEX_MAGIC, 4) != 0 || header.version != TRACK_INDEX_VERSION || header.log_size > log_size || header.cell_size != (uint32_t)this->cell_size) {
+				return false;
+			}
+
+			for (uint32_t i = 0; i < header.chunks; i++) {
+				IndexedChunk chunk;
+				if (!file.read((char *)&chunk.summary, sizeof(ChunkSummary))) {
+					saved.clear();
+					return false;
+				}
+
+				chunk.tracks.resize(chunk.summary.tracks);
+				chunk.cells.resize(chunk.summary.cells);
+				if (!file.read((char *)chunk.tracks.data(), chunk.tracks.size() * sizeof(TrackSummary)) || !file.read((char *)chunk.cells.data(), chunk.cells.size() * sizeof(CellTrack))) {
+					saved.clear();
+					return false;
+				}
+
+				saved.push_back(std::move(chunk));
+			}
+
+			return true;
+		}
+
+		/**
+		 * @brief Save the summaries of the chunks of a log, the file is replaced atomically.
+		 *
+		 * @param fname Path of the index file.
+		 * @param log_size Size of the log file.
+		 * @param first First chunk of the log in the index.
+		 */
+		void writeSummaries(std::string fname, size_t log_size, size_t first) {
+			std::string temporary = fname + ".tmp";
+			std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+			if (!file.is_open()) {
+				std::cout << "Error writing index " << fname << std::endl;
+				return;
+			}
+
+			TrackIndexHeader header;
+			memcpy(header.magic, TRACK_INDEX_MAGIC, 4);
+			header.version = TRACK_INDEX_VERSION;
+			header.log_size = log_size;
+			header.chunks = this->chunks.size() - first;
+			header.cell_size = this->cell_size;
+			file.write((const char *)&header, sizeof(header));
+
+			for (size_t i = first; i < this->chunks.size(); i++) {
+				const IndexedChunk &chunk = this->chunks[i];
+				file.write((const char *)&chunk.summary, sizeof(ChunkSummary));
+				file.write((const char *)chunk.tracks.data(), chunk.tracks.size() * sizeof(TrackSummary));
+				file.write((const char *)chunk.cells.data(), chunk.cells.size() * sizeof(CellTrack));
+			}
+
+			file.close();
+			if (!file || rename(temporary.c_str(), fname.c_str()) != 0) {
+				std::cout << "Error writing index " << fname << std::endl;
+				remove(temporary.c_str());
+			}
+		}
+};
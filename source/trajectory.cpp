@@ -0,0 +1,302 @@
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+
+#pragma once
+
+/**
+ * @brief Point of a trajectory with the time when the object was there.
+ */
+struct TrajectoryPoint {
+	int32_t x;
+	int32_t y;
+
+	/**
+	 * @brief Timestamp of the frame (ms).
+	 */
+	int64_t timestamp;
+};
+
+/**
+ * @brief Trajectory of an object compressed online with a bounded error.
+ *
+ * The newest points are kept exactly in a small ring, used by the queries of the tracker (direction, speed, line crossing). Older points are reduced to key points with an opening window: a point becomes a key point when the segment from the previous key point to the newest point no longer passes within tolerance of all the points in between. The distance is measured at the time of each point (synchronized euclidean distance), so positions and speeds interpolated between key points keep the bound. Key points are stored as zigzag varint deltas, a few bytes per key point.
+ */
+class Trajectory {
+	public:
+		/**
+		 * @brief Maximum distance (pixels) between a point and its position interpolated from the key points.
+		 */
+		float tolerance = 1.5;
+
+		/**
+		 * @brief Time (ms) that the newest exact points should cover, the ring grows up to max_capacity until its points cover it.
+		 */
+		int64_t span = 0;
+
+		/**
+		 * @brief Largest number of exact points kept.
+		 */
+		static constexpr size_t max_capacity = 256;
+
+		Trajectory(size_t capacity = 16) {
+			this->capacity = capacity;
+			this->ring.reserve(capacity);
+		}
+
+		/**
+		 * @brief Add a point at the end of the trajectory.
+		 */
+		void push(int32_t x, int32_t y, int64_t timestamp) {
+			TrajectoryPoint point = {x, y, timestamp};
+
+			// Keep the oldest point while the ring covers less than the span (high frame rates)
+			if (this->ring.size() == this->capacity && this->capacity < max_capacity) {
+				const TrajectoryPoint &oldest = this->point(this->capacity - 1);
+				if (timestamp > oldest.timestamp && timestamp - oldest.timestamp < this->span) {
+					std::rotate(this->ring.begin(), this->ring.begin() + this->head, this->ring.end());
+					this->head = this->ring.size();
+					this->capacity = std::min(this->capacity * 2, max_capacity);
+					this->ring.reserve(this->capacity);
+				}
+			}
+
+			if (this->count == 0) {
+				this->first = point;
+				this->emit(point);
+			} else if (this->since_key >= this->capacity - 1 || !this->fits(point)) {
+				// Newest point in the ring closes the segment
+				this->emit(this->point(0));
+				this->since_key = 0;
+			}
+
+			if (this->ring.size() < this->capacity) {
+				this->ring.push_back(point);
+			} else {
+				this->ring[this->head] = point;
+			}
+			this->head = (this->head + 1) % this->capacity;
+
+			if (this->count > 0) {
+				this->since_key++;
+			}
+			this->count++;
+		}
+
+		/**
+		 * @brief Total number of points added.
+		 */
+		size_t size() const {
+			return this->count;
+		}
+
+		/**
+		 * @brief First point of the trajectory.
+		 */
+		const TrajectoryPoint &front() const {
+			return this->first;
+		}
+
+		/**
+		 * @brief Number of newest points available exactly.
+		 */
+		size_t recent() const {
+			return this->ring.size();
+		}
+
+		/**
+		 * @brief Get one of the newest points.
+		 *
+		 * @param age Position from the end of the trajectory, 0 is the newest point, must be lower than recent().
+		 */
+		const TrajectoryPoint &point(size_t age) const {
+			return this->ring[(this->head + this->capacity - 1 - age) % this->capacity];
+		}
+
+		/**
+		 * @brief Number of key points (including the newest point).
+		 */
+		size_t keypoints() const {
+			return this->keys + (this->since_key > 0 ? 1 : 0);
+		}
+
+		/**
+		 * @brief Compressed trajectory, key points followed by the newest point.
+		 */
+		std::vector<uint8_t> encode() const {
+			std::vector<uint8_t> data = this->data;
+
+			if (this->since_key > 0) {
+				const TrajectoryPoint &newest = this->point(0);
+				writeVarint(data, newest.x - this->last_key.x);
+				writeVarint(data, newest.y - this->last_key.y);
+				writeVarint(data, newest.timestamp - this->last_key.timestamp);
+			}
+
+			return data;
+		}
+
+		/**
+		 * @brief Decode the key points of a compressed trajectory.
+		 *
+		 * @param data Output of encode().
+		 * @param size Size of the data in bytes.
+		 * @return Key points, empty if the data is invalid.
+		 */
+		static std::vector<TrajectoryPoint> decode(const uint8_t *data, size_t size) {
+			std::vector<TrajectoryPoint> points;
+			TrajectoryPoint point = {0, 0, 0};
+			size_t offset = 0;
+
+			while (offset < size) {
+				int64_t dx, dy, dt;
+				if (!readVarint(data, size, offset, dx) || !readVarint(data, size, offset, dy) || !readVarint(data, size, offset, dt)) {
+					return {};
+				}
+
+				point.x += dx;
+				point.y += dy;
+				point.timestamp += dt;
+				points.push_back(point);
+			}
+
+			return points;
+		}
+
+		/**
+		 * @brief Position at a time interpolated from key points.
+		 *
+		 * @param points Key points ordered by time.
+		 * @param timestamp Time (ms), clamped to the time covered by the points.
+		 */
+		static TrajectoryPoint interpolate(const std::vector<TrajectoryPoint> &points, int64_t timestamp) {
+			if (points.empty()) {
+				return {0, 0, timestamp};
+			}
+
+			if (timestamp <= points.front().timestamp) {
+				return points.front();
+			}
+
+			for (size_t i = 1; i < points.size(); i++) {
+				if (timestamp <= points[i].timestamp) {
+					return lerp(points[i - 1], points[i], timestamp);
+				}
+			}
+
+			return points.back();
+		}
+
+		/**
+		 * @brief Approximate memory used by the trajectory (bytes).
+		 */
+		size_t memory() const {
+			return sizeof(Trajectory) + this->ring.capacity() * sizeof(TrajectoryPoint) + this->data.capacity();
+		}
+
+	private:
+		/**
+		 * @brief Newest points, circular buffer.
+		 */
+		std::vector<TrajectoryPoint> ring;
+
+		size_t capacity;
+
+		/**
+		 * @brief Position in the ring where the next point is written.
+		 */
+		size_t head = 0;
+
+		size_t count = 0;
+
+		/**
+		 * @brief Number of points after the last key point.
+		 */
+		size_t since_key = 0;
+
+		/**
+		 * @brief Delta encoded key points.
+		 */
+		std::vector<uint8_t> data;
+
+		TrajectoryPoint last_key = {0, 0, 0};
+
+		TrajectoryPoint first = {0, 0, 0};
+
+		size_t keys = 0;
+
+		/**
+		 * @brief Check if the points after the last key point stay within tolerance of the segment from the last key point to a new point.
+		 */
+		bool fits(const TrajectoryPoint &end) const {
+			if (end.timestamp <= this->last_key.timestamp) {
+				return false;
+			}
+
+			for (size_t age = 0; age < this->since_key; age++) {
+				const TrajectoryPoint &p = this->point(age);
+				TrajectoryPoint expected = lerp(this->last_key, end, p.timestamp);
+
+				float dx = p.x - expected.x;
+				float dy = p.y - expected.y;
+				if (dx * dx + dy * dy > this->tolerance * this->tolerance) {
+					return false;
+				}
+			}
+
+			return true;
+		}
+
+		/**
+		 * @brief Append a key point to the encoded data.
+		 */
+		void emit(const TrajectoryPoint &point) {
+			writeVarint(this->data, point.x - this->last_key.x);
+			writeVarint(this->data, point.y - this->last_key.y);
+			writeVarint(this->data, point.timestamp - this->last_key.timestamp);
+
+			this->last_key = point;
+			this->keys++;
+		}
+
+		static TrajectoryPoint lerp(const TrajectoryPoint &a, const TrajectoryPoint &b, int64_t timestamp) {
+			if (b.timestamp == a.timestamp) {
+				return b;
+			}
+
+			double t = (double)(timestamp - a.timestamp) / (b.timestamp - a.timestamp);
+			return {(int32_t)std::lround(a.x + (b.x - a.x) * t), (int32_t)std::lround(a.y + (b.y - a.y) * t), timestamp};
+		}
+
+		static void writeVarint(std::vector<uint8_t> &data, int64_t value) {
+			uint64_t zigzag = ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+
+			while (zigzag >= 0x80) {
+				data.push_back((uint8_t)(zigzag | 0x80));
+				zigzag >>= 7;
+			}
+			data.push_back((uint8_t)zigzag);
+		}
+
+		static bool readVarint(const uint8_t *data, size_t size, size_t &offset, int64_t &value) {
+			uint64_t zigzag = 0;
+
+			for (int shift = 0; shift < 64; shift += 7) {
+				if (offset >= size) {
+					return false;
+				}
+
+				uint8_t byte = data[offset++];
+				zigzag |= (uint64_t)(byte & 0x7f) << shift;
+
+				if ((byte & 0x80) == 0) {
+					value = (int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1);
+					return true;
+				}
+			}
+
+			return false;
+		}
+};
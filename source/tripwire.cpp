@@ -0,0 +1,416 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <algorithm>
+#include <cstdint>
+
+#include <opencv2/core.hpp>
+
+#include "street_object.cpp"
+#include "math_utils.cpp"
+
+#pragma once
+
+/**
+ * @brief Line of the image where objects are counted when they cross it.
+ */
+struct CountingLine {
+	/**
+	 * @brief Name of the line (e.g. lane), used in the output.
+	 */
+	std::string name;
+
+	cv::Point a;
+
+	cv::Point b;
+};
+
+/**
+ * @brief Counts and speeds aggregated for a line, direction and category during an interval.
+ */
+struct FlowCount {
+	int line;
+
+	/**
+	 * @brief Direction of the crossing, 0 when crossing to the right side of the line looking from a to b in the image, 1 to the left side.
+	 */
+	int direction;
+
+	Category category;
+
+	uint64_t count;
+
+	/**
+	 * @brief Number of crossings in each speed bin.
+	 */
+	std::vector<uint64_t> speeds;
+};
+
+/**
+ * @brief Counts of all the lines in an interval.
+ */
+struct FlowSnapshot {
+	/**
+	 * @brief Start of the interval (ms).
+	 */
+	int64_t start;
+
+	/**
+	 * @brief End of the interval (ms).
+	 */
+	int64_t end;
+
+	/**
+	 * @brief Counts of each line, direction and category with at least one crossing.
+	 */
+	std::vector<FlowCount> counts;
+};
+
+/**
+ * @brief Counts objects crossing virtual lines, per line, direction and category, with speed histograms.
+ *
+ * Only the last step of each object updated in the frame is tested, so the cost is O(active tracks * lines) per frame. Counters are atomic and can be read from other threads at any time, the counts of each interval are written to a CSV file in a separate thread.
+ */
+class TripwireCounter {
+	public:
+		/**
+		 * @brief Number of directions of a line.
+		 */
+		static const int directions = 2;
+
+		/**
+		 * @brief Number of object categories.
+		 */
+		static const int categories = 3;
+
+		/**
+		 * @brief Maximum number of lines, the lines crossed by each object are stored in a bit mask.
+		 */
+		static const int max_lines = 32;
+
+		/**
+		 * @brief Lines being counted.
+		 */
+		std::vector<CountingLine> lines;
+
+		/**
+		 * @brief Width of each speed histogram bin (kph).
+		 */
+		float speed_bin = 10.0;
+
+		/**
+		 * @brief Number of speed histogram bins, the last bin counts all the speeds above it. Must be set before the lines.
+		 */
+		int speed_bins = 16;
+
+		/**
+		 * @brief Duration of each interval (ms), counts are flushed and reset at the end of each interval.
+		 */
+		int64_t flush_interval = 60000;
+
+		~TripwireCounter() {
+			this->close();
+		}
+
+		/**
+		 * @brief Load the lines from a YAML/XML file (cv::FileStorage).
+		 *
+		 * Each line has a name and its two points, e.g. "lines: [ { name: "north", points: [ 100, 500, 900, 500 ] } ]".
+		 *
+		 * @param fname Path of the file.
+		 * @return True if the file was loaded.
+		 */
+		bool load(std::string fname) {
+			cv::FileStorage fs(fname, cv::FileStorage::READ);
+			if (!fs.isOpened()) {
+				std::cout << "Error opening counting lines " << fname << std::endl;
+				return false;
+			}
+
+			std::vector<CountingLine> lines;
+			for (cv::FileNode node : fs["lines"]) {
+				std::vector<int> points;
+				node["points"] >> points;
+				if (points.size() != 4) {
+					std::cout << "Counting line needs two points" << std::endl;
+					continue;
+				}
+
+				CountingLine line;
+				line.name = node["name"].empty() ? std::to_string(lines.size()) : (std::string)node["name"];
+				line.a = cv::Point(points[0], points[1]);
+				line.b = cv::Point(points[2], points[3]);
+				lines.push_back(line);
+			}
+
+			this->setLines(lines);
+
+			return true;
+		}
+
+		/**
+		 * @brief Set the lines being counted and reset the counters.
+		 */
+		void setLines(const std::vector<CountingLine> &lines) {
+			this->lines = lines;
+			if (this->lines.size() > (size_t)max_lines) {
+				std::cout << "Only " << max_lines << " counting lines are supported" << std::endl;
+				this->lines.resize(max_lines);
+			}
+
+			this->stride = 1 + this->speed_bins;
+			this->length = this->lines.size() * directions * categories * this->stride;
+			this->counters.reset(new std::atomic<uint64_t>[this->length]);
+			for (size_t i = 0; i < this->length; i++) {
+				this->counters[i] = 0;
+			}
+		}
+
+		/**
+		 * @brief Check if there are lines to count.
+		 */
+		bool empty() const {
+			return this->lines.empty();
+		}
+
+		/**
+		 * @brief Write the counts of each interval into a CSV file.
+		 *
+		 * @param fname Path of the CSV file, appended if it already exists.
+		 * @return True if the file was opened.
+		 */
+		bool open(std::string fname) {
+			bool exists = std::ifstream(fname).good();
+
+			this->file.open(fname, std::ios::app);
+			if (!this->file.is_open()) {
+				std::cout << "Error opening counts file " << fname << std::endl;
+				return false;
+			}
+
+			if (!exists) {
+				this->file << "start,end,line,direction,category,count";
+				for (int b = 0; b < this->speed_bins; b++) {
+					this->file << ",speed_" << (int)(b * this->speed_bin);
+				}
+				this->file << std::endl;
+			}
+
+			this->worker = std::thread(&TripwireCounter::run, this);
+
+			return true;
+		}
+
+		/**
+		 * @brief Test the last step of the objects updated in this frame against all the lines.
+		 *
+		 * @param objects Objects visible in the scene.
+		 * @param frame Frame number, only objects updated in this frame are tested.
+		 * @param timestamp Timestamp of the frame (ms), used to close the intervals.
+		 */
+		void update(std::vector<StreetObject> &objects, int frame, int64_t timestamp) {
+			if (this->lines.empty()) {
+				return;
+			}
+
+			int64_t start = this->interval_start.load();
+			if (start == INT64_MIN) {
+				this->interval_start = timestamp - timestamp % this->flush_interval;
+			} else if (timestamp >= start + this->flush_interval) {
+				this->flush(timestamp - timestamp % this->flush_interval);
+			}
+
+			for (StreetObject &obj : objects) {
+				if (obj.frame != frame || obj.trajectory.recent() < 2) {
+					continue;
+				}
+
+				cv::Point from(obj.trajectory.point(1).x, obj.trajectory.point(1).y);
+				cv::Point to(obj.trajectory.point(0).x, obj.trajectory.point(0).y);
+
+				for (size_t l = 0; l < this->lines.size(); l++) {
+					const CountingLine &line = this->lines[l];
+
+					// Each object is counted once per line
+					if (obj.crossed & (1u << l)) {
+						continue;
+					}
+
+					if (!intersectSegments(from, to, line.a, line.b)) {
+						continue;
+					}
+
+					obj.crossed |= 1u << l;
+
+					int direction = lineSide(line.a, line.b, to) > 0 ? 0 : 1;
+					this->count(l, direction, obj.category, obj.speed);
+				}
+			}
+		}
+
+		/**
+		 * @brief Add a crossing to the counters, can be called from any thread.
+		 */
+		void count(int line, int direction, Category category, float speed) {
+			int bin = std::min(this->speed_bins - 1, std::max(0, (int)(speed / this->speed_bin)));
+
+			std::atomic<uint64_t> *counter = this->counter(line, direction, category);
+			counter[0].fetch_add(1, std::memory_order_relaxed);
+			counter[1 + bin].fetch_add(1, std::memory_order_relaxed);
+		}
+
+		/**
+		 * @brief Read the counts of the current interval, can be called from any thread.
+		 *
+		 * @param reset Reset the counters after reading them.
+		 */
+		FlowSnapshot snapshot(bool reset = false) {
+			FlowSnapshot snapshot;
+			snapshot.start = this->interval_start.load();
+			snapshot.end = snapshot.start + this->flush_interval;
+
+			for (size_t l = 0; l < this->lines.size(); l++) {
+				for (int d = 0; d < directions; d++) {
+					for (int c = 0; c < categories; c++) {
+						std::atomic<uint64_t> *counter = this->counter(l, d, (Category)c);
+
+						FlowCount count;
+						count.line = l;
+						count.direction = d;
+						count.category = (Category)c;
+						count.count = reset ? counter[0].exchange(0, std::memory_order_relaxed) : counter[0].load(std::memory_order_relaxed);
+						count.speeds.resize(this->speed_bins);
+						for (int b = 0; b < this->speed_bins; b++) {
+							count.speeds[b] = reset ? counter[1 + b].exchange(0, std::memory_order_relaxed) : counter[1 + b].load(std::memory_order_relaxed);
+						}
+
+						if (count.count > 0) {
+							snapshot.counts.push_back(count);
+						}
+					}
+				}
+			}
+
+			return snapshot;
+		}
+
+		/**
+		 * @brief Write the counts of the current interval and stop the writer thread.
+		 */
+		void close() {
+			if (this->closed) {
+				return;
+			}
+			this->closed = true;
+
+			int64_t start = this->interval_start.load();
+			if (!this->lines.empty() && start != INT64_MIN) {
+				this->flush(start + this->flush_interval);
+			}
+
+			{
+				std::unique_lock<std::mutex> lock(this->mutex);
+				this->stop = true;
+			}
+
+			this->condition.notify_one();
+
+			if (this->worker.joinable()) {
+				this->worker.join();
+			}
+		}
+
+	private:
+		/**
+		 * @brief Counters of all lines, directions and categories, each entry has the count followed by the speed bins.
+		 */
+		std::unique_ptr<std::atomic<uint64_t>[]> counters;
+
+		size_t stride = 0;
+
+		size_t length = 0;
+
+		/**
+		 * @brief Start of the current interval, written by the processing thread and read by snapshot() from any thread.
+		 */
+		std::atomic<int64_t> interval_start{INT64_MIN};
+
+		std::ofstream file;
+
+		std::thread worker;
+
+		std::mutex mutex;
+
+		std::condition_variable condition;
+
+		/**
+		 * @brief Snapshots waiting to be written.
+		 */
+		std::deque<FlowSnapshot> queue;
+
+		bool stop = false;
+
+		bool closed = false;
+
+		std::atomic<uint64_t> *counter(int line, int direction, Category category) {
+			return &this->counters[((line * directions + direction) * categories + category) * this->stride];
+		}
+
+		/**
+		 * @brief Close the current interval and queue its counts to be written.
+		 *
+		 * @param next Start of the next interval.
+		 */
+		void flush(int64_t next) {
+			FlowSnapshot snapshot = this->snapshot(true);
+			this->interval_start = next;
+
+			if (!this->worker.joinable()) {
+				return;
+			}
+
+			std::unique_lock<std::mutex> lock(this->mutex);
+			this->queue.push_back(std::move(snapshot));
+			this->condition.notify_one();
+		}
+
+		/**
+		 * @brief Writer thread, writes the snapshots into the CSV file.
+		 */
+		void run() {
+			while (true) {
+				FlowSnapshot snapshot;
+				{
+					std::unique_lock<std::mutex> lock(this->mutex);
+					this->condition.wait(lock, [this] {
+						return this->stop || !this->queue.empty();
+					});
+
+					if (this->queue.empty()) {
+						break;
+					}
+
+					snapshot = std::move(this->queue.front());
+					this->queue.pop_front();
+				}
+
+				for (const FlowCount &count : snapshot.counts) {
+					this->file << snapshot.start << "," << snapshot.end << "," << this->lines[count.line].name << "," << count.direction << "," << count.category << "," << count.count;
+					for (uint64_t speed : count.speeds) {
+						this->file << "," << speed;
+					}
+					this->file << "\n";
+				}
+				this->file.flush();
+			}
+
+			this->file.close();
+		}
+};
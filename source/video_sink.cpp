@@ -0,0 +1,240 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdint>
+#include <math.h>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/videoio.hpp>
+
+#include "street_object.cpp"
+
+#pragma once
+
+/**
+ * @brief Information of a track drawn over a frame.
+ */
+struct TrackOverlay {
+	int id;
+	Category category;
+	cv::Point position;
+	cv::Point direction;
+	cv::Rect box;
+	float speed;
+};
+
+/**
+ * @brief Draw track overlays into a frame.
+ *
+ * @param frame Frame to draw into.
+ * @param overlays Tracks to be drawn.
+ * @param scale Scale of the frame relative to the coordinates of the tracks.
+ */
+void drawOverlays(cv::Mat &frame, const std::vector<TrackOverlay> &overlays, double scale = 1.0) {
+	for (const TrackOverlay &overlay : overlays) {
+		cv::Point pos = overlay.position * scale;
+
+		cv::Scalar color = overlay.category == vehicle ? cv::Scalar(0,255,0) : overlay.category == pedestrian ? cv::Scalar(255,0,0) : cv::Scalar(0,0,255);
+		cv::circle(frame, pos, 5, color, cv::FILLED, cv::LINE_8);
+
+		cv::line(frame, pos, pos + overlay.direction * (2 * scale), color, 1, cv::LINE_8);
+
+		cv::putText(frame, std::to_string(overlay.id), cv::Point(pos.x + 10, pos.y), cv::FONT_HERSHEY_PLAIN, 1.0, color, 1, cv::LINE_AA);
+
+		int speed = std::round(overlay.speed);
+		cv::putText(frame, std::to_string(speed) + " kph", cv::Point(pos.x + 10, pos.y + 20), cv::FONT_HERSHEY_PLAIN, 1.0, color, 1, cv::LINE_AA);
+
+		cv::Rect rect = overlay.box;
+		cv::rectangle(frame, cv::Point(rect.x * scale, rect.y * scale), cv::Point((rect.x + rect.width) * scale, (rect.y + rect.height) * scale), color, 1);
+	}
+}
+
+/**
+ * @brief Writes annotated video in a separate thread.
+ *
+ * Receives the frames as they were processed (not modified) and the overlays of the tracks, drawing, resizing and encoding happen in the sink thread. Frames are dropped when the encoder does not keep up, the pipeline never waits for the sink.
+ */
+class VideoSink {
+	public:
+		/**
+		 * @brief Frame rate of the output video, frames pushed faster are skipped.
+		 */
+		double fps = 10.0;
+
+		/**
+		 * @brief Scale of the output video relative to the frames pushed.
+		 */
+		double scale = 0.5;
+
+		/**
+		 * @brief Maximum number of frames waiting to be encoded.
+		 */
+		size_t capacity = 8;
+
+		/**
+		 * @brief Codec of the output video.
+		 */
+		int fourcc = cv::VideoWriter::fourcc('m', 'p', '4', 'v');
+
+		/**
+		 * @brief Number of frames written to the output.
+		 */
+		std::atomic<uint64_t> written{0};
+
+		/**
+		 * @brief Number of frames dropped because the queue was full.
+		 */
+		std::atomic<uint64_t> dropped{0};
+
+		/**
+		 * @brief Create a sink, the output file is created when the first frame is written.
+		 *
+		 * @param fname Path of the output video.
+		 * @param fps Frame rate of the output video.
+		 * @param scale Scale of the output relative to the input frames.
+		 */
+		VideoSink(std::string fname, double fps = 10.0, double scale = 0.5) {
+			this->fname = fname;
+			this->fps = fps;
+			this->scale = scale;
+			this->worker = std::thread(&VideoSink::run, this);
+		}
+
+		~VideoSink() {
+			this->close();
+		}
+
+		/**
+		 * @brief Submit a frame to the sink, returns immediately.
+		 *
+		 * The frame data is shared with the sink and must not be modified after being pushed.
+		 *
+		 * @param frame Frame processed.
+		 * @param overlays Tracks to draw over the frame.
+		 * @param timestamp Timestamp of the frame (ms), used to reduce the frame rate.
+		 * @return True if the frame was queued, false if it was skipped or dropped.
+		 */
+		bool push(const cv::Mat &frame, std::vector<TrackOverlay> overlays, int64_t timestamp) {
+			// Reduce frame rate
+			if (this->last_timestamp != INT64_MIN && timestamp - this->last_timestamp < 1000.0 / this->fps) {
+				return false;
+			}
+
+			std::unique_lock<std::mutex> lock(this->mutex);
+
+			if (this->stop) {
+				return false;
+			}
+
+			if (this->queue.size() >= this->capacity) {
+				this->dropped++;
+				return false;
+			}
+
+			this->last_timestamp = timestamp;
+
+			Item item;
+			item.frame = frame;
+			item.overlays = std::move(overlays);
+			this->queue.push_back(std::move(item));
+			this->condition.notify_one();
+
+			return true;
+		}
+
+		/**
+		 * @brief Write the frames in the queue and close the output file.
+		 */
+		void close() {
+			{
+				std::unique_lock<std::mutex> lock(this->mutex);
+				if (this->stop) {
+					return;
+				}
+				this->stop = true;
+			}
+
+			this->condition.notify_one();
+
+			if (this->worker.joinable()) {
+				this->worker.join();
+			}
+		}
+
+	private:
+		/**
+		 * @brief Frame waiting to be rendered.
+		 */
+		struct Item {
+			cv::Mat frame;
+			std::vector<TrackOverlay> overlays;
+		};
+
+		std::string fname;
+
+		cv::VideoWriter writer;
+
+		int64_t last_timestamp = INT64_MIN;
+
+		std::thread worker;
+
+		std::mutex mutex;
+
+		std::condition_variable condition;
+
+		std::deque<Item> queue;
+
+		bool stop = false;
+
+		/**
+		 * @brief Sink thread, renders and encodes the queued frames.
+		 */
+		void run() {
+			cv::Mat output;
+
+			while (true) {
+				Item item;
+				{
+					std::unique_lock<std::mutex> lock(this->mutex);
+					this->condition.wait(lock, [this] {
+						return this->stop || !this->queue.empty();
+					});
+
+					if (this->queue.empty()) {
+						break;
+					}
+
+					item = std::move(this->queue.front());
+					this->queue.pop_front();
+				}
+
+				// Render into a separate buffer, the frame is shared with the pipeline
+				if (this->scale != 1.0) {
+					cv::resize(item.frame, output, cv::Size(), this->scale, this->scale, cv::INTER_AREA);
+				} else {
+					item.frame.copyTo(output);
+				}
+
+				drawOverlays(output, item.overlays, this->scale);
+
+				if (!this->writer.isOpened()) {
+					this->writer.open(this->fname, this->fourcc, this->fps, output.size());
+					if (!this->writer.isOpened()) {
+						std::cout << "Error opening video output " << this->fname << std::endl;
+						break;
+					}
+				}
+
+				this->writer.write(output);
+				this->written++;
+			}
+
+			this->writer.release();
+		}
+};
@@ -1,5 +1,6 @@
 #include <sstream>
 #include <fstream>
+#include <algorithm>
 
 #include <opencv2/opencv.hpp>
 
@@ -68,6 +69,31 @@ class YOLODetector {
 		 */
 		const float CONFIDENCE_THRESHOLD = 0.2;
 
+		/**
+		 * @brief Overlap between neighbour tiles in pixels, should be larger than the small objects to detect.
+		 */
+		int tile_overlap = 96;
+
+		/**
+		 * @brief Number of tiles processed in each forward pass, values above 1 require a model exported with a dynamic batch size.
+		 */
+		int tile_batch = 1;
+
+		/**
+		 * @brief Minimum number of foreground pixels for a tile to be processed.
+		 */
+		int tile_min_foreground = 50;
+
+		/**
+		 * @brief Maximum number of tiles processed per frame, the tiles with more foreground are kept (0 for no limit). Bounds the cost of frames with motion everywhere (rain, lighting changes).
+		 */
+		int max_tiles = 16;
+
+		/**
+		 * @brief Also process the whole frame scaled to the input size, detects objects larger than the overlap.
+		 */
+		bool tile_full_frame = true;
+
 		/**
 		 * @brief DNN model used to detect objects.
 		 */
@@ -91,8 +117,17 @@ class YOLODetector {
 			this->input_width = width;
 			this->input_height = height;
 
-			// Load model.
-			this->net = cv::dnn::readNet(modelf); 
+			// Load model, the network can also be injected directly when no path is provided.
+			if (!modelf.empty()) {
+				this->net = cv::dnn::readNet(modelf);
+			}
+		}
+
+		/**
+		 * @brief Check if the detector has a model loaded.
+		 */
+		bool empty() {
+			return this->net.empty();
 		}
 
 
@@ -100,14 +135,17 @@ class YOLODetector {
 		 * @brief Process a frame to detect objects using the YOLO V5 model.
 		 * 
 		 * @param frame Frame to be processed
+		 * @return Detections before non maximum suppression, the vector is reused by the next call.
 		 */
-		std::vector<YOLOObject> detect(cv::Mat *frame, std::string debug_window = "YOLO") {
-			std::vector<cv::Mat> detections = this->classify(*frame);
-			std::vector<YOLOObject> objects = this->extractDetections(*frame, detections);
+		const std::vector<YOLOObject> &detect(cv::Mat *frame, std::string debug_window = "YOLO") {
+			std::vector<cv::Mat> &predictions = this->classify(*frame);
+
+			this->candidates.clear();
+			this->extractDetections(*frame, predictions, this->candidates);
 
 			if (this->debug) {
 				cv::Mat clone = frame->clone();
-				cv::Mat img = this->drawPredictions(clone, detections);
+				cv::Mat img = this->drawPredictions(clone, predictions);
 
 				// The function getPerfProfile returns the overall time for inference(t) and the timings for each of the layers(in layersTimes)
 				std::vector<double> layersTimes;
@@ -121,27 +159,185 @@ class YOLODetector {
 			}
 
 
-			return objects;
+			return this->candidates;
 		}
 
 		/**
 		 * @brief Extract detections from the detection matrix.
 		 * 
+		 * @param detections Vector where the detections are appended.
 		 */
-		std::vector<YOLOObject> extractDetections(cv::Mat &frame, std::vector<cv::Mat> &predictions) {
-			std::vector<YOLOObject> detections;
-
+		void extractDetections(cv::Mat &frame, std::vector<cv::Mat> &predictions, std::vector<YOLOObject> &detections) {
 			// Resizing factor.
 			float x_factor = frame.cols / this->input_width;
 			float y_factor = frame.rows / this->input_height;
 
-			// Predition data pointer
-			float *data = (float *)predictions[0].data;
+			// Shape of the output depends on the model and input size (e.g. 1x25200x85 for 640x640 COCO)
+			int rows, dimensions;
+			this->outputShape(predictions[0], rows, dimensions);
+
+			this->extractRows((float *)predictions[0].data, rows, dimensions, x_factor, y_factor, detections);
+		}
+
+		/**
+		 * @brief Process a high resolution frame in overlapping tiles of the network input size, small objects keep their size instead of being scaled down with the whole frame.
+		 * 
+		 * Tiles without foreground are skipped, at most max_tiles of the remaining tiles (most foreground first) are processed in batches of tile_batch images. Detections of tiles touching a seam are dropped (the overlapping tile or the whole frame pass sees the complete object) and the rest are merged with non maximum suppression.
+		 * 
+		 * @param frame Frame to be processed.
+		 * @param foreground Binary mask of moving pixels with the size of the frame, optional.
+		 * @return Detections in frame coordinates after non maximum suppression, the vector is reused by the next call.
+		 */
+		const std::vector<YOLOObject> &detectTiled(cv::Mat *frame, const cv::Mat *foreground = nullptr, std::string debug_window = "YOLO") {
+			int tile_width = this->input_width;
+			int tile_height = this->input_height;
 
-			// size_t size = predictions[0].GetTensorTypeAndShapeInfo().GetElementCount(); // 1x25200x85=2142000
-			const int dimensions = 85; // 0,1,2,3 ->box,4->confidence，5-85 -> coco classes confidence 
-			int rows = 25200; // size / dimensions; //25200
+			// Small frames do not need tiles
+			if (frame->cols <= tile_width && frame->rows <= tile_height) {
+				return this->suppress(this->detect(frame, debug_window));
+			}
 
+			// Large objects are detected in the whole frame
+			this->candidates.clear();
+			if (this->tile_full_frame) {
+				this->extractDetections(*frame, this->classify(*frame), this->candidates);
+			}
+
+			tileOffsets(frame->cols, tile_width, this->tile_overlap, this->xs);
+			tileOffsets(frame->rows, tile_height, this->tile_overlap, this->ys);
+
+			// Buffers are members, frames after the first do not allocate them again
+			std::vector<cv::Rect> &tiles = this->tiles;
+			std::vector<int> &tile_foreground = this->tile_foreground;
+			tiles.clear();
+			tile_foreground.clear();
+			for (int y : this->ys) {
+				for (int x : this->xs) {
+					cv::Rect tile = cv::Rect(x, y, tile_width, tile_height) & cv::Rect(0, 0, frame->cols, frame->rows);
+
+					int pixels = 0;
+					if (foreground != nullptr && !foreground->empty()) {
+						pixels = cv::countNonZero((*foreground)(tile));
+						if (pixels < this->tile_min_foreground) {
+							continue;
+						}
+					}
+
+					tiles.push_back(tile);
+					tile_foreground.push_back(pixels);
+				}
+			}
+
+			// Keep the tiles with more foreground, in their original order
+			if (this->max_tiles > 0 && tiles.size() > (size_t)this->max_tiles) {
+				std::vector<size_t> &order = this->order;
+				order.resize(tiles.size());
+				for (size_t t = 0; t < order.size(); t++) {
+					order[t] = t;
+				}
+
+				std::stable_sort(order.begin(), order.end(), [&tile_foreground](size_t a, size_t b) {
+					return tile_foreground[a] > tile_foreground[b];
+				});
+				order.resize(this->max_tiles);
+				std::sort(order.begin(), order.end());
+
+				this->kept_tiles.clear();
+				for (size_t t : order) {
+					this->kept_tiles.push_back(tiles[t]);
+				}
+				tiles.swap(this->kept_tiles);
+			}
+
+			for (size_t first = 0, count = 0; first < tiles.size(); first += count) {
+				count = std::min(tiles.size() - first, (size_t)std::max(1, this->tile_batch));
+
+				this->images.clear();
+				for (size_t t = first; t < first + count; t++) {
+					this->images.push_back((*frame)(tiles[t]));
+				}
+
+				cv::dnn::blobFromImages(this->images, this->blob, 1./255., cv::Size(tile_width, tile_height), cv::Scalar(), true, false);
+				this->net.setInput(this->blob);
+
+				std::vector<cv::Mat> &predictions = this->predictions;
+				this->net.forward(predictions, this->outputNames());
+
+				int rows, dimensions;
+				this->outputShape(predictions[0], rows, dimensions);
+
+				for (size_t t = 0; t < count; t++) {
+					const cv::Rect &tile = tiles[first + t];
+
+					std::vector<YOLOObject> &tile_detections = this->tile_detections;
+					tile_detections.clear();
+					float *data = (float *)predictions[0].data + t * rows * dimensions;
+					this->extractRows(data, rows, dimensions, tile.width / this->input_width, tile.height / this->input_height, tile_detections);
+
+					for (YOLOObject &detection : tile_detections) {
+						if (touchesSeam(detection.box, tile, frame->size())) {
+							continue;
+						}
+
+						detection.box.x += tile.x;
+						detection.box.y += tile.y;
+						this->candidates.push_back(detection);
+					}
+				}
+			}
+
+			const std::vector<YOLOObject> &detections = this->suppress(this->candidates);
+
+			if (this->debug) {
+				cv::Mat clone = frame->clone();
+				for (const cv::Rect &tile : tiles) {
+					cv::rectangle(clone, tile, YELLOW, 1);
+				}
+				for (const YOLOObject &detection : detections) {
+					cv::rectangle(clone, detection.box, BLUE, 3);
+				}
+
+				cv::imshow(debug_window, clone);
+			}
+
+			return detections;
+		}
+
+		/**
+		 * @brief Apply non maximum suppression to a list of detections.
+		 * 
+		 * @param detections Detections extracted from the network output.
+		 * @return Detections that were kept, the vector is reused by the next call.
+		 */
+		const std::vector<YOLOObject> &suppress(const std::vector<YOLOObject> &detections) {
+			this->boxes.clear();
+			this->confidences.clear();
+			for (const YOLOObject &detection : detections) {
+				this->boxes.push_back(detection.box);
+				this->confidences.push_back(detection.confidence);
+			}
+
+			cv::dnn::NMSBoxes(this->boxes, this->confidences, SCORE_THRESHOLD, NMS_THRESHOLD, this->indices);
+
+			this->detections.clear();
+			for (int idx : this->indices) {
+				this->detections.push_back(detections[idx]);
+			}
+
+			return this->detections;
+		}
+
+		/**
+		 * @brief Extract the detections above the thresholds from the rows of a network output.
+		 * 
+		 * @param data First row of the output.
+		 * @param rows Number of rows.
+		 * @param dimensions Number of values of each row (4 box, 1 confidence and the scores of each class).
+		 * @param x_factor Horizontal scale from the network input to the image.
+		 * @param y_factor Vertical scale from the network input to the image.
+		 * @param detections Vector where the detections are appended.
+		 */
+		void extractRows(float *data, int rows, int dimensions, float x_factor, float y_factor, std::vector<YOLOObject> &detections) {
 			// Iterate through all detections.
 			for (int i = 0; i < rows; ++i) 
 			{
@@ -152,8 +348,8 @@ class YOLODetector {
 				{
 					float *classes_scores = data + 5;
 
-					// Create a 1x85 cv::Mat and store class scores of 80 classes.
-					cv::Mat scores(1, this->classes.size(), CV_32FC1, classes_scores);
+					// Create a 1xN cv::Mat with the scores of all classes.
+					cv::Mat scores(1, dimensions - 5, CV_32FC1, classes_scores);
 
 					// Perform minMaxLoc and acquire index of best class score.
 					cv::Point class_id;
@@ -189,11 +385,54 @@ class YOLODetector {
 				// Jump to the next column.
 				data += dimensions;
 			}
+		}
+
+		/**
+		 * @brief Start of each tile along one axis, tiles overlap and the last tile ends at the border of the image.
+		 */
+		static void tileOffsets(int length, int tile, int overlap, std::vector<int> &offsets) {
+			offsets.clear();
+			int step = std::max(1, tile - overlap);
+
+			for (int start = 0; ; start += step) {
+				if (start + tile >= length) {
+					offsets.push_back(std::max(0, length - tile));
+					break;
+				}
+				offsets.push_back(start);
+			}
+		}
 
+		/**
+		 * @brief Check if a box (in tile coordinates) touches a border of the tile that is not a border of the frame.
+		 */
+		static bool touchesSeam(const cv::Rect &box, const cv::Rect &tile, cv::Size frame) {
+			const int margin = 2;
 
-			return detections;
+			return (box.x <= margin && tile.x > 0) ||
+				(box.y <= margin && tile.y > 0) ||
+				(box.x + box.width >= tile.width - margin && tile.x + tile.width < frame.width) ||
+				(box.y + box.height >= tile.height - margin && tile.y + tile.height < frame.height);
 		}
 
+		/**
+		 * @brief Get the number of detections and values per detection from the shape of the output tensor.
+		 * 
+		 * Output can be [batch x rows x dimensions] or [rows x dimensions].
+		 * 
+		 * @param output Output tensor of the network.
+		 * @param rows Number of detections.
+		 * @param dimensions Number of values of each detection (4 box, 1 confidence and the scores of each class).
+		 */
+		void outputShape(const cv::Mat &output, int &rows, int &dimensions) {
+			if (output.dims >= 3) {
+				rows = output.size[output.dims - 2];
+				dimensions = output.size[output.dims - 1];
+			} else {
+				rows = output.rows;
+				dimensions = output.cols;
+			}
+		}
 
 		/**
 		 * @brief Load list of classes from file, line by line.
@@ -246,22 +485,31 @@ class YOLODetector {
 		 * @brief Detect object in an image using the loaded model.
 		 * 
 		 * @param frame Frame to detect object in.
-		 * @return std::vector<cv::Mat> 
+		 * @return std::vector<cv::Mat> Outputs of the network, reused by the next call.
 		 */
-		std::vector<cv::Mat> classify(cv::Mat &frame)
+		std::vector<cv::Mat> &classify(cv::Mat &frame)
 		{
 			// Convert to blob.
-			cv::Mat blob;
-			cv::dnn::blobFromImage(frame, blob, 1./255., cv::Size(this->input_width, this->input_height), cv::Scalar(), true, false);
+			cv::dnn::blobFromImage(frame, this->blob, 1./255., cv::Size(this->input_width, this->input_height), cv::Scalar(), true, false);
 
 			// Network input
-			this->net.setInput(blob);
+			this->net.setInput(this->blob);
 
 			// Forward propagate.
-			std::vector<cv::Mat> predictions;
-			this->net.forward(predictions, this->net.getUnconnectedOutLayersNames());
+			this->net.forward(this->predictions, this->outputNames());
+
+			return this->predictions;
+		}
+
+		/**
+		 * @brief Names of the output layers, read from the network once.
+		 */
+		const std::vector<std::string> &outputNames() {
+			if (this->output_names.empty()) {
+				this->output_names = this->net.getUnconnectedOutLayersNames();
+			}
 
-			return predictions;
+			return this->output_names;
 		}
 
 		/**
@@ -286,14 +534,9 @@ class YOLODetector {
 			// Predition data pointer
 			float *data = (float *)predictions[0].data;
 			
-			// Size of the prediction data. Should be a [1 x size] matrix.
-			cv::Size s = predictions[0].size();
-
-			// Dimension of each detection. From [0:3]-> bouding box, 4->confidence，5-85 -> coco classes confidence.
-			const int dimensions = 85; 
-
-			// Output size of the classifier 
-			int rows = s.width;
+			// Dimension of each detection. From [0:3]-> bouding box, 4->confidence，5-85 -> classes confidence.
+			int rows, dimensions;
+			this->outputShape(predictions[0], rows, dimensions);
 
 			// Iterate through all detections.
 			for (int i = 0; i < rows; ++i) 
@@ -305,8 +548,8 @@ class YOLODetector {
 				{
 					float *classes_scores = data + 5;
 
-					// Create a 1x85 cv::Mat and store class scores of 80 classes.
-					cv::Mat scores(1, this->classes.size(), CV_32FC1, classes_scores);
+					// Create a 1xN cv::Mat with the scores of all classes.
+					cv::Mat scores(1, dimensions - 5, CV_32FC1, classes_scores);
 
 					// Perform minMaxLoc and acquire index of best class score.
 					cv::Point class_id;
@@ -363,7 +606,8 @@ class YOLODetector {
 
 				// Get the label for the class name and its confidence.
 				std::string label = cv::format("%.2f", confidences[idx]);
-				label = this->classes[class_ids[idx]] + ":" + label;
+				std::string name = class_ids[idx] < (int)this->classes.size() ? this->classes[class_ids[idx]] : std::to_string(class_ids[idx]);
+				label = name + ":" + label;
 				
 				// Draw class labels.
 				drawBox(frame, label, left, top);
@@ -371,4 +615,46 @@ class YOLODetector {
 
 			return frame;
 		}
+
+	private:
+		/**
+		 * @brief Buffers of each call, reused so that steady state frames do not allocate them.
+		 */
+		cv::Mat blob;
+
+		std::vector<cv::Mat> predictions;
+
+		std::vector<cv::Mat> images;
+
+		std::vector<std::string> output_names;
+
+		std::vector<int> xs;
+
+		std::vector<int> ys;
+
+		std::vector<cv::Rect> tiles;
+
+		std::vector<cv::Rect> kept_tiles;
+
+		std::vector<int> tile_foreground;
+
+		std::vector<size_t> order;
+
+		std::vector<YOLOObject> tile_detections;
+
+		/**
+		 * @brief Detections before non maximum suppression.
+		 */
+		std::vector<YOLOObject> candidates;
+
+		std::vector<cv::Rect> boxes;
+
+		std::vector<float> confidences;
+
+		std::vector<int> indices;
+
+		/**
+		 * @brief Detections after non maximum suppression.
+		 */
+		std::vector<YOLOObject> detections;
 };
\ No newline at end of file